@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <mqueue.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "msgbus.h"
+#include "msgbus_ring.h"
+#include "msgbus_port.h"
+
+/*
+ * 消息总线吞吐和延迟测试：以基准配置为中心，依次改变数据长度、订阅用户数量、主题数量、发布线程数量和派发分片数量，
+ * 分别在POSIX消息队列和进程内环形通道上测试，每组测试在独立子进程中运行，输出CSV。
+ * 延迟为发布调用前到订阅线程收到消息的时间，吞吐为全部订阅用户收齐消息所用时间内的发布速率。
+ */
+
+#define BENCH_MSG_NUM 20000u         /* 每组测试的默认发布消息数量 */
+#define BENCH_MSG_BUFF_SIZE 16384    /* 接收缓冲区大小 */
+#define BENCH_RING_SIZE (1u << 20)   /* 环形通道大小 */
+#define BENCH_MQ_MSG_SIZE 4352       /* 消息队列单条消息上限，17个队列不超过默认的每用户800KB配额 */
+#define BENCH_MQ_MAX_MSG 10          /* 消息队列深度，系统默认上限 */
+#define BENCH_RECV_TIMEOUT_MS 2000   /* 订阅线程等待超时，超时后按丢失统计 */
+#define BENCH_SUB_MAX 16
+#define BENCH_TOPIC_MAX 1024
+#define BENCH_PUB_MAX 8
+#define BENCH_SHARD_MAX 4
+
+/* 测试使用的通道，写接口在通道满时等待而不是丢弃，使测试结果反映背压下的持续吞吐 */
+typedef struct
+{
+    const char *name;
+    msgbus_channel_t (*create)(uint32_t idx);
+    void (*destroy)(msgbus_channel_t channel, uint32_t idx);
+    int (*read)(msgbus_channel_t channel, void *buff, int buff_size, int timeout_ms);
+    channel_msg_write_handler_t write;
+    channel_msg_writev_handler_t writev;
+} bench_port_t;
+
+typedef struct
+{
+    const char *sweep;    /* 本组测试改变的参数 */
+    uint32_t payload;     /* 数据长度 */
+    uint32_t sub_num;     /* 订阅用户数量 */
+    uint32_t topic_num;   /* 主题数量 */
+    uint32_t pub_num;     /* 发布线程数量 */
+    uint32_t shard_num;   /* 派发分片数量，0：由系统线程派发 */
+} bench_case_t;
+
+typedef struct
+{
+    const bench_port_t *port;
+    const bench_case_t *bench_case;
+    uint32_t msg_num;
+    pthread_barrier_t start_barrier;
+    volatile int stop;
+    msgbus_channel_t sys_channel;
+    msgbus_channel_t sub_channel[BENCH_SUB_MAX];
+    msgbus_channel_t shard_channel[BENCH_SHARD_MAX];
+    msgbus_topic_t topics[BENCH_TOPIC_MAX];
+    uint64_t *latency[BENCH_SUB_MAX];
+    uint32_t recv_num[BENCH_SUB_MAX];
+    uint32_t pub_fail_num;
+    uint64_t start_ns;
+    uint64_t pub_end_ns[BENCH_PUB_MAX];
+    uint64_t recv_end_ns[BENCH_SUB_MAX];
+} bench_ctx_t;
+
+typedef struct
+{
+    bench_ctx_t *ctx;
+    uint32_t idx;
+} bench_thread_arg_t;
+
+/* 基准配置为64byte、1个订阅用户、1个主题、1个发布线程、不分片，每个扫描只改变其中一项，
+ * 分片扫描使用256个主题和4个发布线程，主题足够分散时派发吞吐随分片数量增加 */
+static const bench_case_t bench_case_list[] = {
+    {"payload", 16, 1, 1, 1, 0},
+    {"payload", 64, 1, 1, 1, 0},
+    {"payload", 256, 1, 1, 1, 0},
+    {"payload", 1024, 1, 1, 1, 0},
+    {"payload", 4096, 1, 1, 1, 0},
+    {"subs", 64, 2, 1, 1, 0},
+    {"subs", 64, 4, 1, 1, 0},
+    {"subs", 64, 8, 1, 1, 0},
+    {"subs", 64, 16, 1, 1, 0},
+    {"topics", 64, 1, 16, 1, 0},
+    {"topics", 64, 1, 256, 1, 0},
+    {"topics", 64, 1, 1024, 1, 0},
+    {"pubs", 64, 1, 1, 2, 0},
+    {"pubs", 64, 1, 1, 4, 0},
+    {"pubs", 64, 1, 1, 8, 0},
+    {"shards", 64, 1, 256, 4, 0},
+    {"shards", 64, 1, 256, 4, 1},
+    {"shards", 64, 1, 256, 4, 2},
+    {"shards", 64, 1, 256, 4, 4},
+};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static msgbus_channel_t bench_ring_create(uint32_t idx)
+{
+    (void)idx;
+    return msgbus_ring_create(BENCH_RING_SIZE, MSGBUS_RING_FLAG_WAKEUP);
+}
+
+static void bench_ring_destroy(msgbus_channel_t channel, uint32_t idx)
+{
+    (void)idx;
+    msgbus_ring_destroy(channel);
+}
+
+static int bench_ring_read(msgbus_channel_t channel, void *buff, int buff_size, int timeout_ms)
+{
+    return msgbus_ring_read(channel, buff, buff_size, timeout_ms);
+}
+
+static int bench_ring_write(msgbus_channel_t channel, const void *msg, int msg_size, int prio)
+{
+    while (msgbus_ring_write(channel, msg, msg_size, prio) != 0)
+    {
+        sched_yield();
+    }
+    return 0;
+}
+
+static int bench_ring_writev(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio)
+{
+    while (msgbus_ring_writev(channel, iov, iov_num, prio) != 0)
+    {
+        sched_yield();
+    }
+    return 0;
+}
+
+static void bench_mq_name(char *name, size_t size, uint32_t idx)
+{
+    snprintf(name, size, "/msgbus_bench_%d_%" PRIu32, (int)getpid(), idx);
+}
+
+static msgbus_channel_t bench_mq_create(uint32_t idx)
+{
+    char name[64];
+    struct mq_attr mq_attr;
+    mqd_t mq;
+
+    bench_mq_name(name, sizeof name, idx);
+    memset(&mq_attr, 0, sizeof mq_attr);
+    mq_attr.mq_maxmsg = BENCH_MQ_MAX_MSG;
+    mq_attr.mq_msgsize = BENCH_MQ_MSG_SIZE;
+    mq = mq_open(name, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR, &mq_attr);
+    if (mq == (mqd_t)-1)
+    {
+        return NULL;
+    }
+    // 打开后立即删除名字，进程异常退出时队列也会随描述符关闭而释放
+    mq_unlink(name);
+    // 消息队列描述符加1后作为通道，避免描述符0与NULL混淆
+    return (msgbus_channel_t)(intptr_t)(mq + 1);
+}
+
+static void bench_mq_destroy(msgbus_channel_t channel, uint32_t idx)
+{
+    (void)idx;
+    mq_close((mqd_t)((intptr_t)channel - 1));
+}
+
+static int bench_mq_read(msgbus_channel_t channel, void *buff, int buff_size, int timeout_ms)
+{
+    struct timespec ts;
+    ssize_t res;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    res = mq_timedreceive((mqd_t)((intptr_t)channel - 1), buff, buff_size, NULL, &ts);
+    if (res < 0)
+    {
+        return errno == ETIMEDOUT ? 0 : -1;
+    }
+    return (int)res;
+}
+
+static int bench_mq_write(msgbus_channel_t channel, const void *msg, int msg_size, int prio)
+{
+    return mq_send((mqd_t)((intptr_t)channel - 1), msg, msg_size, prio);
+}
+
+static int bench_mq_writev(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio)
+{
+    char msg_buff[BENCH_MQ_MSG_SIZE];
+    int msg_size = 0;
+
+    for (int i = 0; i < iov_num; i++)
+    {
+        if (msg_size + iov[i].len > (int)sizeof msg_buff)
+        {
+            return -1;
+        }
+        memcpy(msg_buff + msg_size, iov[i].base, iov[i].len);
+        msg_size += iov[i].len;
+    }
+    return bench_mq_write(channel, msg_buff, msg_size, prio);
+}
+
+static const bench_port_t bench_port_list[] = {
+    {"ring", bench_ring_create, bench_ring_destroy, bench_ring_read, bench_ring_write, bench_ring_writev},
+    {"mq", bench_mq_create, bench_mq_destroy, bench_mq_read, bench_mq_write, bench_mq_writev},
+};
+
+static void *bench_sys_thread(void *arg)
+{
+    bench_ctx_t *ctx = arg;
+    char *msg_buff = malloc(BENCH_MSG_BUFF_SIZE);
+
+    while (!ctx->stop)
+    {
+        if (ctx->port->read(ctx->sys_channel, msg_buff, BENCH_MSG_BUFF_SIZE, 100) > 0)
+        {
+            msgbus_system_msg_handler((msgbus_msg_t *)msg_buff);
+        }
+    }
+    free(msg_buff);
+    return NULL;
+}
+
+static void *bench_shard_thread(void *arg)
+{
+    bench_thread_arg_t *thread_arg = arg;
+    bench_ctx_t *ctx = thread_arg->ctx;
+    msgbus_channel_t channel = ctx->shard_channel[thread_arg->idx];
+    char *msg_buff = malloc(BENCH_MSG_BUFF_SIZE);
+
+    while (!ctx->stop)
+    {
+        if (ctx->port->read(channel, msg_buff, BENCH_MSG_BUFF_SIZE, 100) > 0)
+        {
+            msgbus_shard_msg_handler((msgbus_msg_t *)msg_buff);
+        }
+    }
+    free(msg_buff);
+    return NULL;
+}
+
+static void *bench_sub_thread(void *arg)
+{
+    bench_thread_arg_t *thread_arg = arg;
+    bench_ctx_t *ctx = thread_arg->ctx;
+    uint32_t idx = thread_arg->idx;
+    char *msg_buff = malloc(BENCH_MSG_BUFF_SIZE);
+    msgbus_msg_t *msg = (msgbus_msg_t *)msg_buff;
+
+    pthread_barrier_wait(&ctx->start_barrier);
+    while (ctx->recv_num[idx] < ctx->msg_num)
+    {
+        uint64_t pub_ns;
+        int res = ctx->port->read(ctx->sub_channel[idx], msg_buff, BENCH_MSG_BUFF_SIZE, BENCH_RECV_TIMEOUT_MS);
+
+        if (res <= 0)
+        {
+            break;
+        }
+        memcpy(&pub_ns, msg->msg_data, sizeof pub_ns);
+        ctx->latency[idx][ctx->recv_num[idx]++] = bench_now_ns() - pub_ns;
+        ctx->recv_end_ns[idx] = bench_now_ns();
+    }
+    free(msg_buff);
+    return NULL;
+}
+
+static void *bench_pub_thread(void *arg)
+{
+    bench_thread_arg_t *thread_arg = arg;
+    bench_ctx_t *ctx = thread_arg->ctx;
+    const bench_case_t *bench_case = ctx->bench_case;
+    uint32_t idx = thread_arg->idx;
+    uint32_t pub_msg_num = ctx->msg_num / bench_case->pub_num;
+    uint8_t *payload = calloc(1, bench_case->payload);
+
+    if (idx < ctx->msg_num % bench_case->pub_num)
+    {
+        pub_msg_num++;
+    }
+    pthread_barrier_wait(&ctx->start_barrier);
+    for (uint32_t i = 0; i < pub_msg_num; i++)
+    {
+        uint64_t pub_ns = bench_now_ns();
+
+        memcpy(payload, &pub_ns, sizeof pub_ns);
+        if (msgbus_publish(ctx->topics[(idx + i) % bench_case->topic_num], payload, bench_case->payload) != 0)
+        {
+            MBUS_ATOMIC_ADD(&ctx->pub_fail_num, 1);
+        }
+    }
+    ctx->pub_end_ns[idx] = bench_now_ns();
+    free(payload);
+    return NULL;
+}
+
+static int bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t bench_percentile(const uint64_t *sorted, uint64_t num, double q)
+{
+    return num ? sorted[(uint64_t)((num - 1) * q + 0.5)] : 0;
+}
+
+/* 释放测试通道 */
+static void bench_release(bench_ctx_t *ctx)
+{
+    if (ctx->sys_channel)
+    {
+        ctx->port->destroy(ctx->sys_channel, 0);
+    }
+    for (uint32_t i = 0; i < BENCH_SUB_MAX; i++)
+    {
+        if (ctx->sub_channel[i])
+        {
+            ctx->port->destroy(ctx->sub_channel[i], i + 1);
+        }
+    }
+    for (uint32_t i = 0; i < BENCH_SHARD_MAX; i++)
+    {
+        if (ctx->shard_channel[i])
+        {
+            ctx->port->destroy(ctx->shard_channel[i], BENCH_SUB_MAX + 1 + i);
+        }
+    }
+}
+
+/* 运行一组测试并输出一行CSV，在子进程中调用 */
+static int bench_run_case(const bench_port_t *port, const bench_case_t *bench_case, uint32_t msg_num)
+{
+    bench_ctx_t *ctx = calloc(1, sizeof(bench_ctx_t));
+    bench_thread_arg_t sub_arg[BENCH_SUB_MAX], pub_arg[BENCH_PUB_MAX], shard_arg[BENCH_SHARD_MAX];
+    pthread_t sys_thread, sub_thread[BENCH_SUB_MAX], pub_thread[BENCH_PUB_MAX], shard_thread[BENCH_SHARD_MAX];
+    uint64_t *latency_all, latency_num = 0, pub_end_ns = 0, recv_end_ns = 0, lost_num;
+    msgbus_config_t config;
+
+    ctx->port = port;
+    ctx->bench_case = bench_case;
+    ctx->msg_num = msg_num;
+    ctx->sys_channel = port->create(0);
+    if (ctx->sys_channel == NULL)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < bench_case->sub_num; i++)
+    {
+        ctx->sub_channel[i] = port->create(i + 1);
+        ctx->latency[i] = malloc(sizeof(uint64_t) * msg_num);
+        if (ctx->sub_channel[i] == NULL || ctx->latency[i] == NULL)
+        {
+            fprintf(stderr, "port %s create channel %" PRIu32 " failed\n", port->name, i + 1);
+            bench_release(ctx);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < bench_case->shard_num; i++)
+    {
+        ctx->shard_channel[i] = port->create(BENCH_SUB_MAX + 1 + i);
+        if (ctx->shard_channel[i] == NULL)
+        {
+            fprintf(stderr, "port %s create shard channel %" PRIu32 " failed\n", port->name, i);
+            bench_release(ctx);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < bench_case->topic_num; i++)
+    {
+        ctx->topics[i] = i + 1;
+    }
+
+    memset(&config, 0, sizeof config);
+    config.local_bus_id = 1;
+    config.system_channel = ctx->sys_channel;
+    config.channel_msg_write_handler = port->write;
+    config.channel_msg_writev_handler = port->writev;
+    config.shard_num = bench_case->shard_num;
+    config.shard_channel_list = ctx->shard_channel;
+    msgbus_init(&config);
+    pthread_create(&sys_thread, NULL, bench_sys_thread, ctx);
+    for (uint32_t i = 0; i < bench_case->shard_num; i++)
+    {
+        shard_arg[i].ctx = ctx;
+        shard_arg[i].idx = i;
+        pthread_create(&shard_thread[i], NULL, bench_shard_thread, &shard_arg[i]);
+    }
+    // 订阅在发布之前写入系统通道（或广播到各分片），按顺序处理，发布时主题已经存在
+    for (uint32_t i = 0; i < bench_case->sub_num; i++)
+    {
+        msgbus_subscribe(ctx->sub_channel[i], i + 1, ctx->topics, bench_case->topic_num);
+    }
+
+    pthread_barrier_init(&ctx->start_barrier, NULL, bench_case->sub_num + bench_case->pub_num + 1);
+    for (uint32_t i = 0; i < bench_case->sub_num; i++)
+    {
+        sub_arg[i].ctx = ctx;
+        sub_arg[i].idx = i;
+        pthread_create(&sub_thread[i], NULL, bench_sub_thread, &sub_arg[i]);
+    }
+    for (uint32_t i = 0; i < bench_case->pub_num; i++)
+    {
+        pub_arg[i].ctx = ctx;
+        pub_arg[i].idx = i;
+        pthread_create(&pub_thread[i], NULL, bench_pub_thread, &pub_arg[i]);
+    }
+    ctx->start_ns = bench_now_ns();
+    pthread_barrier_wait(&ctx->start_barrier);
+    for (uint32_t i = 0; i < bench_case->pub_num; i++)
+    {
+        pthread_join(pub_thread[i], NULL);
+        pub_end_ns = ctx->pub_end_ns[i] > pub_end_ns ? ctx->pub_end_ns[i] : pub_end_ns;
+    }
+    for (uint32_t i = 0; i < bench_case->sub_num; i++)
+    {
+        pthread_join(sub_thread[i], NULL);
+        recv_end_ns = ctx->recv_end_ns[i] > recv_end_ns ? ctx->recv_end_ns[i] : recv_end_ns;
+    }
+    ctx->stop = 1;
+    pthread_join(sys_thread, NULL);
+    for (uint32_t i = 0; i < bench_case->shard_num; i++)
+    {
+        pthread_join(shard_thread[i], NULL);
+    }
+
+    latency_all = malloc(sizeof(uint64_t) * msg_num * bench_case->sub_num);
+    for (uint32_t i = 0; i < bench_case->sub_num; i++)
+    {
+        memcpy(&latency_all[latency_num], ctx->latency[i], sizeof(uint64_t) * ctx->recv_num[i]);
+        latency_num += ctx->recv_num[i];
+    }
+    qsort(latency_all, latency_num, sizeof(uint64_t), bench_cmp_u64);
+    lost_num = (uint64_t)msg_num * bench_case->sub_num - latency_num;
+    if (recv_end_ns <= ctx->start_ns)
+    {
+        recv_end_ns = ctx->start_ns + 1;
+    }
+
+    printf("%s,%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%.3f,%.0f,%.0f,%.1f,"
+           "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu32 "\n",
+           port->name, bench_case->sweep, bench_case->payload, bench_case->sub_num, bench_case->topic_num,
+           bench_case->pub_num, bench_case->shard_num, msg_num, (recv_end_ns - ctx->start_ns) / 1e6,
+           msg_num / ((pub_end_ns - ctx->start_ns) / 1e9),
+           latency_num / ((recv_end_ns - ctx->start_ns) / 1e9),
+           latency_num * (double)bench_case->payload / ((recv_end_ns - ctx->start_ns) / 1e3),
+           bench_percentile(latency_all, latency_num, 0.5), bench_percentile(latency_all, latency_num, 0.99),
+           bench_percentile(latency_all, latency_num, 0.999), latency_num ? latency_all[latency_num - 1] : 0,
+           lost_num, ctx->pub_fail_num);
+    fflush(stdout);
+
+    bench_release(ctx);
+    return lost_num ? 1 : 0;
+}
+
+static void bench_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-n msg_num] [-p ring|mq]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t msg_num = BENCH_MSG_NUM;
+    const char *port_name = NULL;
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "n:p:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            msg_num = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            port_name = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (msg_num == 0)
+    {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    printf("port,sweep,payload,subs,topics,pubs,shards,msgs,elapsed_ms,pub_msg_per_s,deliver_msg_per_s,deliver_mb_per_s,"
+           "p50_ns,p99_ns,p999_ns,max_ns,lost,pub_fail\n");
+    fflush(stdout);
+    for (size_t p = 0; p < sizeof bench_port_list / sizeof bench_port_list[0]; p++)
+    {
+        const bench_port_t *port = &bench_port_list[p];
+        msgbus_channel_t probe;
+
+        if (port_name && strcmp(port_name, port->name) != 0)
+        {
+            continue;
+        }
+        // 系统不支持该通道时跳过，例如未挂载/dev/mqueue
+        probe = port->create(0);
+        if (probe == NULL)
+        {
+            fprintf(stderr, "port %s unavailable, skipped\n", port->name);
+            continue;
+        }
+        port->destroy(probe, 0);
+
+        for (size_t n = 0; n < sizeof bench_case_list / sizeof bench_case_list[0]; n++)
+        {
+            // 每组测试在独立进程中运行，消息总线和内存池状态互不影响
+            pid_t pid = fork();
+            int status;
+
+            if (pid == 0)
+            {
+                _exit(bench_run_case(port, &bench_case_list[n], msg_num) == 0 ? 0 : 1);
+            }
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            {
+                fprintf(stderr, "port %s sweep %s case %zu failed\n", port->name, bench_case_list[n].sweep, n);
+                ret = 1;
+            }
+        }
+    }
+
+    return ret;
+}
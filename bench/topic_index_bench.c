@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "topic_index.h"
+
+/* 主题查找延迟测试：分别在100、1万、100万个主题下比较各索引的单次查找耗时，输出CSV */
+
+#define LOOKUP_NUM 4000000u
+
+static const uint32_t topic_num_list[] = {100, 10000, 1000000};
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint32_t bench_rand(uint32_t *seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/* 生成topic_num个互不相同的主题，dense为1时编号连续，否则在24bit空间中随机分布 */
+static void bench_make_topics(uint32_t *topics, uint32_t topic_num, int dense, uint32_t seed)
+{
+    uint32_t step = dense ? 1 : (0xFFFFFFu - 0x100u) / topic_num;
+
+    for (uint32_t i = 0; i < topic_num; i++)
+    {
+        topics[i] = 1 + i * step + (dense || step < 2 ? 0 : bench_rand(&seed) % step);
+    }
+    for (uint32_t i = topic_num - 1; i > 0; i--)
+    {
+        uint32_t j = bench_rand(&seed) % (i + 1);
+        uint32_t tmp = topics[i];
+
+        topics[i] = topics[j];
+        topics[j] = tmp;
+    }
+}
+
+int main(void)
+{
+    const int index_type_list[] = {TOPIC_INDEX_RBTREE, TOPIC_INDEX_RADIX, TOPIC_INDEX_HASH};
+    uint32_t *lookup_list = malloc(sizeof(uint32_t) * LOOKUP_NUM);
+
+    printf("index,layout,topics,insert_ns,lookup_ns\n");
+    for (size_t n = 0; n < sizeof topic_num_list / sizeof topic_num_list[0]; n++)
+    {
+        uint32_t topic_num = topic_num_list[n];
+        uint32_t *topics = malloc(sizeof(uint32_t) * topic_num);
+
+        for (int dense = 1; dense >= 0; dense--)
+        {
+            uint32_t seed = 0x12345678u;
+
+            bench_make_topics(topics, topic_num, dense, seed);
+            for (uint32_t i = 0; i < LOOKUP_NUM; i++)
+            {
+                lookup_list[i] = topics[bench_rand(&seed) % topic_num];
+            }
+            for (size_t t = 0; t < sizeof index_type_list / sizeof index_type_list[0]; t++)
+            {
+                topic_index_t index;
+                uintptr_t check = 0;
+                uint64_t start, insert_ns, lookup_ns;
+
+                topic_index_init(&index, topic_index_ops_get(index_type_list[t]));
+                start = bench_now_ns();
+                for (uint32_t i = 0; i < topic_num; i++)
+                {
+                    topic_index_insert(&index, topics[i], (void *)(uintptr_t)topics[i]);
+                }
+                insert_ns = bench_now_ns() - start;
+
+                start = bench_now_ns();
+                for (uint32_t i = 0; i < LOOKUP_NUM; i++)
+                {
+                    check += (uintptr_t)topic_index_search(&index, lookup_list[i]);
+                }
+                lookup_ns = bench_now_ns() - start;
+                if (check == 0)
+                {
+                    fprintf(stderr, "lookup failed\n");
+                }
+                printf("%s,%s,%" PRIu32 ",%.1f,%.1f\n", index.ops->name, dense ? "dense" : "sparse",
+                       topic_num, (double)insert_ns / topic_num, (double)lookup_ns / LOOKUP_NUM);
+                topic_index_deinit(&index);
+            }
+        }
+        free(topics);
+    }
+    free(lookup_list);
+
+    return 0;
+}
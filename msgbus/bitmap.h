@@ -1,121 +1,184 @@
-
-
 #ifndef __BITMAT_H__
 #define __BITMAT_H__
 
 #include <stdint.h>
 #include <string.h>
 
-#define BITMAP_ARRAY_SIZE 1
-#define BITMAT_SIMPLE 1
-typedef struct
+/* 位图宽度，即支持的外部总线数量，32的整数倍，最大1024，编译时定义（如BITMAP_BIT_NUM=256），所有模块需一致 */
+#ifndef BITMAP_BIT_NUM
+#define BITMAP_BIT_NUM 32
+#endif
+#if (BITMAP_BIT_NUM % 32) || BITMAP_BIT_NUM < 32 || BITMAP_BIT_NUM > 1024
+#error "BITMAP_BIT_NUM must be a multiple of 32 in [32, 1024]"
+#endif
+#define BITMAP_ARRAY_SIZE (BITMAP_BIT_NUM / 32)
+
+/* 按字查找置位和计数，GCC/Clang使用内建指令，其他编译器使用可移植实现 */
+#if defined(__GNUC__)
+#define BITMAP_CTZ(_word) ((uint32_t)__builtin_ctz(_word))
+#define BITMAP_POPCOUNT(_word) ((uint32_t)__builtin_popcount(_word))
+#else
+static inline uint32_t bitmap_ctz(uint32_t word)
 {
-    union
+    uint32_t n = 0;
+
+    while (!(word & 1u))
     {
-        uint32_t bitmap[BITMAP_ARRAY_SIZE];
-        uint32_t *bitmap_ptr;
-    };
-#ifndef BITMAT_SIMPLE
-    uint32_t use_ptr : 1;
-    uint32_t bit_num_max : 16; /* 最大支持的bit位计数 */
+        word >>= 1;
+        n++;
+    }
+    return n;
+}
+static inline uint32_t bitmap_popcount(uint32_t word)
+{
+    word = word - ((word >> 1) & 0x55555555u);
+    word = (word & 0x33333333u) + ((word >> 2) & 0x33333333u);
+    return (((word + (word >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+#define BITMAP_CTZ(_word) bitmap_ctz(_word)
+#define BITMAP_POPCOUNT(_word) bitmap_popcount(_word)
+#endif
+
+/*
+ * bit编号从1开始，bit n保存在bitmap[(n-1)/32]的第(n-1)%32位。
+ * 多字位图另有一个摘要字，第i位表示bitmap[i]不为0，遍历和合并只访问非0的字，
+ * 耗时与置位的数量成正比，与位图宽度无关。
+ */
+typedef struct
+{
+    uint32_t bitmap[BITMAP_ARRAY_SIZE];
+#if BITMAP_ARRAY_SIZE > 1
+    uint32_t summary; /* 非0字摘要 */
 #endif
 } bitmap_t;
 
+/* 位图宽度由BITMAP_BIT_NUM决定，不再使用外部缓冲区，参数保留以兼容原有调用 */
 static inline void bitmap_init(bitmap_t *pbitmap, uint32_t *pbitmap_buff, uint32_t bitmap_size)
 {
+    (void)pbitmap_buff;
+    (void)bitmap_size;
     memset(pbitmap, 0, sizeof(bitmap_t));
-#ifndef BITMAT_SIMPLE
-    if (pbitmap_buff)
+}
+
+/* 置位，bit编号为0时清空位图 */
+static inline void bitmap_set(bitmap_t *pbitmap, uint32_t bit_id)
+{
+    if (bit_id == 0)
+    {
+        memset(pbitmap, 0, sizeof(bitmap_t));
+    }
+    else if (bit_id <= BITMAP_BIT_NUM)
+    {
+        pbitmap->bitmap[(bit_id - 1) >> 5] |= 1u << ((bit_id - 1) & 31);
+#if BITMAP_ARRAY_SIZE > 1
+        pbitmap->summary |= 1u << ((bit_id - 1) >> 5);
+#endif
+    }
+}
+
+static inline void bitmap_unset(bitmap_t *pbitmap, uint32_t bit_id)
+{
+    if (bit_id && bit_id <= BITMAP_BIT_NUM)
     {
-        pbitmap->use_ptr = 1;
-        pbitmap->bitmap_ptr = pbitmap_buff;
-        memset(pbitmap->bitmap_ptr, 0, bitmap_size * sizeof(uint32_t));
-        pbitmap->bit_num_max = bitmap_size * sizeof(uint32_t) * 8;
+        uint32_t idx = (bit_id - 1) >> 5;
+
+        pbitmap->bitmap[idx] &= ~(1u << ((bit_id - 1) & 31));
+#if BITMAP_ARRAY_SIZE > 1
+        if (pbitmap->bitmap[idx] == 0)
+        {
+            pbitmap->summary &= ~(1u << idx);
+        }
+#endif
     }
-    else
+}
+
+static inline uint32_t bitmap_is_set(const bitmap_t *pbitmap, uint32_t bit_id)
+{
+    if (bit_id == 0 || bit_id > BITMAP_BIT_NUM)
     {
-        pbitmap->use_ptr = 0;
-        memset(pbitmap->bitmap, 0, BITMAP_ARRAY_SIZE * sizeof(uint32_t));
-        pbitmap->bit_num_max = BITMAP_ARRAY_SIZE * sizeof(uint32_t) * 8;
+        return 0;
     }
+    return pbitmap->bitmap[(bit_id - 1) >> 5] & (1u << ((bit_id - 1) & 31));
+}
+
+static inline uint32_t bitmap_is_empty(const bitmap_t *pbitmap)
+{
+#if BITMAP_ARRAY_SIZE > 1
+    return pbitmap->summary == 0;
+#else
+    return pbitmap->bitmap[0] == 0;
 #endif
 }
 
-#define bitmap_set(_pmap, _bitid)                                \
-    do                                                           \
-    {                                                            \
-        if (_bitid != 0)                                         \
-        {                                                        \
-            (_pmap)->bitmap[0] |= 1 << ((_bitid) - 1);           \
-        }                                                        \
-        else                                                     \
-        {                                                        \
-            memset((_pmap)->bitmap, 0, sizeof((_pmap)->bitmap)); \
-        }                                                        \
-    } while (0)
-
-#define bitmap_unset(_pmap, _bitid)                       \
-    do                                                    \
-    {                                                     \
-        if (_bitid)                                       \
-        {                                                 \
-            (_pmap)->bitmap[0] &= ~(1 << ((_bitid) - 1)); \
-        }                                                 \
-    } while (0)
-
-#define bitmap_is_set(_pmap, _bitid) ((_pmap)->bitmap[0] & 1 << ((_bitid) - 1))
-
-static inline uint32_t bitmap_next(bitmap_t *pbitmap, uint32_t bit_id)
+/* 返回bit_id之后的第一个置位编号，bit_id为0时从头查找，0：没有更多置位 */
+static inline uint32_t bitmap_next(const bitmap_t *pbitmap, uint32_t bit_id)
 {
-    uint32_t bit_index = bit_id;
+    uint32_t idx = bit_id >> 5;
+    uint32_t word;
 
-    if (pbitmap->bitmap[0] >> bit_index)
+    if (idx >= BITMAP_ARRAY_SIZE)
+    {
+        return 0;
+    }
+    word = pbitmap->bitmap[idx] & (~0u << (bit_id & 31));
+    if (word == 0)
     {
-        for (uint32_t i = bit_index; i < 32; i++)
+#if BITMAP_ARRAY_SIZE > 1
+        // 通过摘要直接跳到下一个非0字
+        uint32_t summary = pbitmap->summary & (~1u << idx);
+
+        if (summary == 0)
         {
-            if (pbitmap->bitmap[0] & (1u << i))
-            {
-                return i + 1;
-            }
+            return 0;
         }
+        idx = BITMAP_CTZ(summary);
+        word = pbitmap->bitmap[idx];
+#else
+        return 0;
+#endif
     }
 
-    return 0;
+    return (idx << 5) + BITMAP_CTZ(word) + 1;
 }
-static inline uint32_t bitmap_get_free(bitmap_t *pbitmap)
+
+/* 返回第一个未置位的编号，0：已满 */
+static inline uint32_t bitmap_get_free(const bitmap_t *pbitmap)
 {
-    for (uint32_t i = 0; i < 32; i++)
+    for (uint32_t i = 0; i < BITMAP_ARRAY_SIZE; i++)
     {
-        if (!(pbitmap->bitmap[0] & (1u << i)))
+        if (~pbitmap->bitmap[i])
         {
-            return i + 1;
+            return (i << 5) + BITMAP_CTZ(~pbitmap->bitmap[i]) + 1;
         }
     }
     return 0;
 }
-static inline uint32_t bitmap_cnt(bitmap_t *pbitmap)
+
+static inline uint32_t bitmap_cnt(const bitmap_t *pbitmap)
 {
+#if BITMAP_ARRAY_SIZE > 1
     uint32_t count = 0;
-    if (pbitmap->bitmap[0])
+
+    for (uint32_t summary = pbitmap->summary; summary; summary &= summary - 1)
     {
-        for (uint32_t i = 0; i < 32; i++)
-        {
-            if (pbitmap->bitmap[0] & (1u << i))
-            {
-                count++;
-            }
-        }
+        count += BITMAP_POPCOUNT(pbitmap->bitmap[BITMAP_CTZ(summary)]);
     }
     return count;
+#else
+    return BITMAP_POPCOUNT(pbitmap->bitmap[0]);
+#endif
 }
 
-static inline uint32_t bitmap_cmp(bitmap_t *pbitmap1, bitmap_t *pbitmap2)
+/* 返回两个位图第一个不同的bit编号，0：相同 */
+static inline uint32_t bitmap_cmp(const bitmap_t *pbitmap1, const bitmap_t *pbitmap2)
 {
-    for (uint32_t i = 0; i < 32; i++)
+    for (uint32_t i = 0; i < BITMAP_ARRAY_SIZE; i++)
     {
-        if ((pbitmap1->bitmap[0] & (1u << i)) != (pbitmap2->bitmap[0] & (1u << i)))
+        uint32_t diff = pbitmap1->bitmap[i] ^ pbitmap2->bitmap[i];
+
+        if (diff)
         {
-            return i + 1;
+            return (i << 5) + BITMAP_CTZ(diff) + 1;
         }
     }
     return 0;
@@ -125,4 +188,20 @@ static inline void bitmap_copy(bitmap_t *pbitmap_dest, const bitmap_t *pbitmap_s
 {
     memcpy(pbitmap_dest, pbitmap_src, sizeof(bitmap_t));
 }
-#endif
\ No newline at end of file
+
+static inline void bitmap_or(bitmap_t *pbitmap_dest, const bitmap_t *pbitmap_src)
+{
+#if BITMAP_ARRAY_SIZE > 1
+    // 只合并源位图中非0的字
+    for (uint32_t summary = pbitmap_src->summary; summary; summary &= summary - 1)
+    {
+        uint32_t idx = BITMAP_CTZ(summary);
+
+        pbitmap_dest->bitmap[idx] |= pbitmap_src->bitmap[idx];
+    }
+    pbitmap_dest->summary |= pbitmap_src->summary;
+#else
+    pbitmap_dest->bitmap[0] |= pbitmap_src->bitmap[0];
+#endif
+}
+#endif
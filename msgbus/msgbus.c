@@ -1,14 +1,25 @@
 #include "msgbus.h"
 #include "rbtree.h"
-#include "sslist.h"
+#include "rbtree_augmented.h"
+#include "sdlist.h"
 #include "bitmap.h"
+#include "topic_index.h"
 #include "msgbus_port.h"
+#include "msgbus_trace.h"
 
 enum
 {
     TOPIC_BUS_SUB = MSG_TOPIC_SYSTEM_TOPIC_MAX,
     TOPIC_BUS_SYNC,
     TOPIC_BUS_EXT_SYNC,
+    TOPIC_BUS_LOANED,
+    TOPIC_BUS_BATCH,
+    TOPIC_BUS_STATS,
+    TOPIC_BUS_UNSUB,
+    TOPIC_BUS_LANE,
+    TOPIC_BUS_BACKPRESSURE,
+    TOPIC_BUS_EXT_DELTA,
+    TOPIC_BUS_EXT_ACK,
 };
 
 /* 获取用户主题，通过最大值限制来实现 */
@@ -20,503 +31,5197 @@ enum
 /* 检查topic是否为强制分发 */
 #define MSG_TOPIC_IS_DISPATCHED(__topic) ((__topic) & (0x40u << 24))
 
+/* 获取发布时设置的优先级 */
+#define MSG_TOPIC_GET_PRIO(__topic) (((__topic) >> 24) & 0x3u)
+
+/* 是否为订阅、同步等会修改主题表的控制消息 */
+static inline int msgbus_is_control_msg(uint32_t topic)
+{
+    return topic == TOPIC_BUS_SUB || topic == TOPIC_BUS_UNSUB || topic == TOPIC_BUS_SYNC ||
+           topic == TOPIC_BUS_EXT_SYNC || topic == TOPIC_BUS_BACKPRESSURE || topic == TOPIC_BUS_EXT_DELTA ||
+           topic == TOPIC_BUS_EXT_ACK;
+}
+
+// 订阅用户计数器
+typedef struct
+{
+    uint64_t deliver_cnt;    // 投递成功次数
+    uint64_t deliver_bytes;  // 投递成功的数据字节数
+    uint64_t write_fail_cnt; // 通道写入失败次数
+    uint64_t drop_cnt;       // 丢弃的消息数量
+    uint64_t conflate_cnt;   // 合并订阅中被覆盖的消息数量
+} sub_counter_t;
+
+// 主题计数器
+typedef struct
+{
+    uint64_t publish_cnt;    // 派发次数
+    uint64_t publish_bytes;  // 派发的数据字节数
+    uint64_t fanout_cnt;     // 投递给订阅用户和外部总线的总次数
+    uint64_t write_fail_cnt; // 通道写入失败次数
+    uint64_t drop_cnt;       // 没有任何接收者而丢弃的次数
+} topic_counter_t;
+
+// 总线计数器
+typedef struct
+{
+    uint64_t publish_cnt;    // 本地发布次数
+    uint64_t dispatch_cnt;   // 派发次数
+    uint64_t no_topic_cnt;   // 发布的主题不存在的次数
+    uint64_t write_fail_cnt; // 通道写入失败总次数
+} bus_counter_t;
+
+// 溢出环中积压的消息
+typedef struct
+{
+    int prio;         // 写入通道时的优先级
+    msgbus_msg_t msg; // 消息副本，必须在最后
+} backlog_msg_t;
+
+// 订阅通道的背压状态，每个设置了背压策略的通道一个，总线销毁前不释放
+typedef struct sub_channel
+{
+    struct sub_channel *next;             // 背压状态链表，只在头部插入
+    msgbus_channel_t channel;             // 订阅通道
+    msgbus_channel_t spill_channel;       // 旁路通道
+    uint32_t policy;                      // 背压策略
+    int timeout_ms;                       // 有限阻塞的最长等待时间
+    mbus_lock_t lock;                     // 溢出环锁
+    uint32_t ring_size;                   // 溢出环容量
+    uint32_t ring_head;                   // 溢出环中最旧消息的下标
+    uint32_t backlog;                     // 溢出环中积压的消息数量
+    backlog_msg_t **ring;                 // 溢出环
+    msgbus_backpressure_stats_t stats;    // 背压统计
+} sub_channel_t;
+
+// 合并订阅的最新值槽位，每个合并订阅节点一个，通道中最多只有一条引用它的合并通知
+typedef struct
+{
+    uint32_t refcnt;      // 引用计数，订阅节点和通道中的合并通知各持有一个
+    msgbus_msg_t *latest; // 尚未读取的最新消息，NULL：没有待读取的消息
+} conflate_slot_t;
+
+// 增量同步日志中的帧，对端应答前保留，出现缺口时按顺序重发
+typedef struct
+{
+    struct list_head node; // 日志节点
+    msgbus_msg_t msg;      // 增量同步帧，必须在最后
+} delta_log_t;
+
+// 与外部总线之间的增量同步状态，发送和接收方向各自独立编号
 typedef struct
 {
-    struct slist_head node;      // 订阅列表节点
+    uint32_t tx_gen;      // 最后一次发给该总线的主题表代数，发送全量同步后为0
+    uint32_t rx_gen;      // 已应用的该总线的主题表代数，收到全量同步后为0
+    uint32_t log_num;     // 日志中的帧数量
+    struct list_head log; // 尚未应答的增量帧，按代数排序
+} ext_peer_t;
+
+// 转发到一个外部总线的合并帧，多条消息拼接为一条TOPIC_BUS_BATCH消息发送
+typedef struct
+{
+    mbus_lock_t lock;    // 合并帧锁，直接派发和分片模式下多个线程同时转发
+    int prio;            // 帧中消息的优先级，优先级不同时先发送已合并的消息
+    uint32_t num;        // 帧中的消息数量
+    uint64_t first_us;   // 帧中第一条消息的合并时间
+    msgbus_msg_t *frame; // 合并帧，容量为ext_coalesce_bytes，第一次转发时申请
+} egress_frame_t;
+
+// 分片的控制通道，控制消息不写入分片通道，分片通道满时也不会丢失
+typedef struct
+{
+    mbus_lock_t lock;      // 控制通道锁
+    uint32_t pending;      // 控制通道中待处理的消息数量
+    struct list_head list; // 控制通道，分片处理每条消息前先处理完其中的消息
+} shard_lane_t;
+
+typedef struct sub_user_node
+{
+    struct list_head node;       // 订阅列表节点
+    struct sub_user_node *hash_next; // 订阅哈希表冲突链
+    struct topic_node *topic_node;   // 所属主题
+    uint32_t hash;                   // 订阅参数的哈希值
     msgbus_user_t user_id;       // 用户标识符
     msgbus_channel_t channel;    // 接收数据队列
     uint32_t user_local_sub : 1; // 用户本地订阅
+    uint32_t user_shared_sub : 1; // 用户共享订阅，只接收共享消息描述符
+    msgbus_sub_cb_t sub_cb;       // 回调订阅的回调函数，NULL：通过通道接收
+    void *cb_ctx;                 // 回调参数
+    sub_channel_t *sub_chan;      // 订阅通道的背压状态，NULL：未设置背压策略
+    conflate_slot_t *conflate_slot; // 合并订阅的最新值槽位，NULL：非合并订阅
+    sub_counter_t counter;        // 订阅用户计数器
 } sub_user_node_t;
 
-typedef struct
+typedef struct topic_node
 {
     struct rb_node node;             // 树节点
-    uint32_t topic_key;              // 主题键
-    struct slist_head sub_user_list; // 订阅的用户列表
+    uint32_t topic_key;              // 主题键，范围节点为范围下限
+    uint32_t topic_hi;               // 范围上限，精确主题节点与topic_key相同
+    uint32_t subtree_hi;             // 区间树中子树的最大范围上限，只用于范围节点
+    struct list_head sub_user_list;  // 订阅的用户列表
     bitmap_t sub_bus_map;            // 外部总线订阅表
+    topic_counter_t counter;         // 主题计数器
 } topic_node_t;
 
-typedef struct
+typedef struct msgbus_context
 {
     struct rb_root topic_tree;                         // 主题红黑树
+    struct rb_root range_tree;                         // 主题范围区间树，按下限、上限排序
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+    topic_index_t topic_index;                         // 主题查找索引
+#endif
     msgbus_channel_t sys_channel;                      // 内部事件队列
     msgbus_channel_t ext_bus_channel;                  // 外部总线队列
     channel_msg_write_handler_t channel_write_handler; // 发送数据回调
+    channel_msg_writev_handler_t channel_writev_handler; // 聚合发送数据回调
+    channel_wait_handler_t channel_wait_handler;       // 等待通道消息回调
+    channel_fd_handler_t channel_fd_handler;           // 通道就绪描述符回调
     uint16_t bus_id;                                   // 当前总线编号
-    uint16_t topic_total;                              // 当前主题总数量（本地+外部总线）
-    uint16_t topic_local_num;                          // 本地已订阅的主题数量
+    // 以下计数只由系统线程修改，msgbus_stats_get在其他线程中原子读取
+    uint32_t topic_total;                              // 当前主题总数量（本地+外部总线）
+    uint32_t topic_local_num;                          // 本地已订阅的主题数量
+    uint32_t range_total;                              // 当前主题范围总数量（本地+外部总线）
+    // 以下配置标记初始化后只读，发布线程读取，不与运行中修改的标记共用存储单元
     uint16_t init_flag : 1;                            // 已初始化标记
     uint16_t selfness_flag : 1;                        // 自私模式，不同步外部总线的主题
-    uint16_t sync_start_flag : 1;                      // 开始同步主题标记
-    uint16_t sync_over_flag : 1;                       // 已完成同步主题标记
+    uint16_t direct_flag : 1;                          // 直接派发模式
+    uint16_t multicast_flag : 1;                       // 外部总线组播模式
+    uint16_t compact_flag : 1;                         // 外部总线紧凑格式
+    uint8_t sync_start_flag;                           // 开始同步主题标记，只由系统线程读写
+    uint8_t sync_over_flag;                            // 已完成同步主题标记，只由系统线程读写
     bitmap_t ext_bus_map;                              // 外部总线表
     bitmap_t ext_bus_map_sync;                         // 已同步外部总线表
+    bitmap_t ext_bus_map_sent;                         // 已发送全量同步的外部总线表，之后的变化以增量发送
+    bitmap_t ext_bus_map_delta;                        // 已协商增量同步的外部总线表，只向其中的总线发送增量
+    bitmap_t ext_bus_map_stale;                        // 能力协商前主题表已变化的外部总线表，收到其全量同步后补发
+    bitmap_t ext_bus_map_compact;                      // 已协商紧凑格式的外部总线表
+    uint32_t topic_gen;                                // 主题表代数，每次向外部总线发送增量时递增
+    ext_peer_t ext_peer[MSGBUS_EXT_BUS_MAX];           // 各外部总线的增量同步状态，下标为总线ID-1
+    struct topic_snapshot *snapshot;                   // 直接派发使用的主题表快照
+    sub_user_node_t **sub_hash;                        // 订阅哈希表，按主题和订阅参数查找订阅节点
+    uint32_t sub_hash_shift;                           // 哈希值右移位数，表长为2^(32-shift)
+    uint32_t sub_num;                                  // 订阅节点总数
+    sub_channel_t *sub_chan_list;                      // 设置了背压策略的订阅通道
+    uint16_t shard_num;                                // 分片数量，0：不分片
+    uint32_t coalesce_bytes;                           // 外部总线合并帧的长度上限，0：不合并
+    uint32_t coalesce_us;                              // 合并帧的最长等待时间，0：只在帧满或主动发送时发送
+    msgbus_channel_t shard_channel[MBUS_SHARD_MAX];    // 各分片的消息通道
+    void *mem;                                         // 动态创建的实例申请的内存，默认实例为NULL
+    // 以下字段由发布线程频繁修改，与系统线程读取的配置分开缓存行
+    MBUS_CACHELINE_ALIGNED uint32_t snapshot_epoch;    // 快照读者当前纪元
+    uint32_t snapshot_readers[2];                      // 各纪元中正在访问快照的读者数量
+    uint32_t backlog_total;                            // 各通道溢出环中积压的消息总数
+    uint32_t direct_queued;                            // 直接派发模式下仍在通道中排队的本地发布消息数量
+    MBUS_CACHELINE_ALIGNED mbus_lock_t shard_lock;     // 控制消息广播锁，保证各分片收到的控制消息顺序一致
+    uint32_t shard_arrive;                             // 已处理到当前控制消息的分片数量
+    uint32_t shard_gen;                                // 已执行的控制消息代数
+    shard_lane_t shard_lane[MBUS_SHARD_MAX];           // 各分片的控制通道
+    MBUS_CACHELINE_ALIGNED mbus_lock_t lane_lock;      // 控制通道锁
+    uint32_t lane_pending;                             // 控制通道中待处理的消息数量
+    struct list_head ctrl_lane;                        // 控制通道，系统线程处理每条消息前先处理完其中的消息
+    MBUS_CACHELINE_ALIGNED uint32_t egress_pending;    // 有消息等待发送的合并帧数量
+    egress_frame_t egress[MSGBUS_EXT_BUS_MAX];         // 各外部总线的合并帧，下标为总线ID-1
+    MBUS_CACHELINE_ALIGNED bus_counter_t counter;      // 总线计数器
+    msgbus_ext_bus_stats_t ext_bus_stats[MSGBUS_EXT_BUS_MAX]; // 外部总线计数器
 } msgbus_context_t;
 
 typedef struct
 {
     msgbus_channel_t channel;     // 收到订阅数据的发送队列
     msgbus_user_t user_id;        // 订阅的用户
+    msgbus_sub_cb_t sub_cb;       // 回调订阅的回调函数
+    void *cb_ctx;                 // 回调参数
     uint32_t topic_num;           // 主题数量
+    uint32_t range_num;           // 主题范围数量，范围列表在主题列表之后
     msgbus_topic_t topic_list[0]; // 订阅的主题列表
 } topic_sub_data_t;
 
-// 总线同步主题数据体
+// 总线同步主题数据体，主题列表之后为范围数量和范围列表，旧版本的同步数据没有范围部分
 typedef struct
 {
     uint32_t topic_num;           // 主题数量
     msgbus_topic_t topic_list[0]; // 订阅的主题列表
 } topic_sync_data_t;
 
-static msgbus_context_t msgbus_ctx;
+// 同步数据之后的能力标记，旧版本的同步数据没有该字段
+#define TOPIC_SYNC_CAP_DELTA 0x1u   // 支持增量同步
+#define TOPIC_SYNC_CAP_COMPACT 0x2u // 支持紧凑格式的外部总线帧
+
+// 主题同步状态的变化，记录需要通知的外部总线，同一批变化中先撤销后新增
+typedef struct
+{
+    uint32_t topic;    // 主题键，范围为下限
+    uint32_t topic_hi; // 范围上限，精确主题与topic相同
+    bitmap_t add_map;  // 需要新增该主题的外部总线表
+    bitmap_t del_map;  // 需要撤销该主题的外部总线表
+} topic_delta_t;
+
+#define TOPIC_DELTA_RESET 0x1u // 携带完整的主题表，替换对端记录的本总线全部主题
+
+// 增量同步数据体，之后依次为撤销和新增两段同步数据（主题列表、范围数量、范围列表）
+typedef struct
+{
+    uint32_t gen;      // 本帧之后的主题表代数
+    uint32_t base_gen; // 对端应用本帧前应处于的代数，不一致说明中间有帧丢失
+    uint32_t flags;    // TOPIC_DELTA_RESET
+    uint8_t data[0];   // 撤销和新增的同步数据
+} topic_delta_data_t;
+
+// 增量同步应答数据体
+typedef struct
+{
+    uint32_t gen;  // 已应用的代数
+    uint32_t nack; // 1：出现缺口，请求重发gen之后的增量
+} topic_delta_ack_t;
+
+// 控制通道中的消息，本地的控制消息不经过系统通道，避免排在发布消息之后
+typedef struct
+{
+    struct list_head node; // 控制通道节点
+    msgbus_msg_t msg;      // 控制消息，必须在最后
+} lane_msg_t;
+
+// 分片控制通道中的消息，所有分片共用一份，最后处理完的分片释放
+typedef struct
+{
+    struct list_head node[MBUS_SHARD_MAX]; // 各分片的控制通道节点
+    uint32_t ref;                          // 尚未处理该消息的分片数量
+    msgbus_msg_t msg;                      // 控制消息，必须在最后
+} shard_lane_msg_t;
+
+// 修改主题表时记录的同步变化，以及取消订阅或外部总线撤销时回收的节点
+typedef struct
+{
+    topic_delta_t *delta_list;       // 需要同步给外部总线的变化，NULL：不需要记录
+    uint32_t delta_num;              // 变化的数量
+    struct list_head free_sub_list;  // 待释放的订阅用户
+    struct list_head free_topic_list; // 待释放的主题节点
+} topic_reclaim_t;
+
+// 引用计数的共享消息，多个订阅者共用同一份数据，最后一个释放者回收
+typedef struct
+{
+    uint32_t refcnt;  // 引用计数
+    msgbus_msg_t msg; // 消息，必须在最后
+} msgbus_shared_buf_t;
+
+// 共享消息描述符数据体，投递给共享订阅用户
+typedef struct
+{
+    msgbus_msg_t *shared_msg; // 共享消息
+} topic_shared_desc_t;
+
+// 合并通知数据体，投递给合并订阅用户
+typedef struct
+{
+    conflate_slot_t *slot; // 最新值槽位
+} topic_conflate_desc_t;
+
+// 主题表快照中的订阅用户
+typedef struct
+{
+    msgbus_user_t user_id;        // 用户标识符
+    msgbus_channel_t channel;     // 接收数据队列
+    uint32_t user_shared_sub : 1; // 用户共享订阅
+    msgbus_sub_cb_t sub_cb;       // 回调订阅的回调函数
+    void *cb_ctx;                 // 回调参数
+    sub_channel_t *sub_chan;      // 订阅通道的背压状态
+    conflate_slot_t *conflate_slot; // 合并订阅的最新值槽位
+    sub_counter_t *counter;       // 订阅节点的计数器
+} snapshot_sub_t;
+
+// 主题表快照中的主题
+typedef struct
+{
+    uint32_t topic_key;      // 主题键，范围为下限
+    uint32_t topic_hi;       // 范围上限
+    uint32_t subtree_hi;     // 以该范围为根的隐式子树的最大上限
+    uint32_t sub_num;        // 订阅用户数量
+    snapshot_sub_t *sub_list; // 订阅用户列表
+    bitmap_t sub_bus_map;    // 外部总线订阅表
+    topic_counter_t *counter; // 主题节点的计数器
+} snapshot_topic_t;
+
+/*
+ * 只读的主题表快照，按主题键排序，由系统线程生成，发布线程在纪元保护下直接访问。
+ * 范围列表按下限排序，以二分的中点为根组成隐式区间树，中点保存所在子区间的最大上限。
+ */
+typedef struct topic_snapshot
+{
+    uint32_t topic_num;             // 主题数量
+    uint32_t range_num;             // 主题范围数量
+    snapshot_topic_t *range_list;   // 主题范围列表
+    snapshot_topic_t topic_list[0]; // 主题列表，之后为范围列表和订阅用户列表
+} topic_snapshot_t;
+
+// 一次派发的状态，精确主题和命中的各主题范围依次投递
+typedef struct
+{
+    msgbus_context_t *ctx;            // 总线实例
+    msgbus_msg_t *bus_msg;            // 派发的消息
+    msgbus_shared_buf_t *shared_buf;  // 共享消息，投递共享订阅用户时使用
+    uint32_t user_topic;              // 用户主题
+    uint32_t match_num;               // 命中的主题和范围数量
+    uint32_t shared_sub_cnt;          // 共享订阅用户数量，最后统一投递
+    uint32_t fanout;                  // 投递和转发次数
+    int32_t err;                      // 派发结果，有写入失败时为第一次失败的结果，没有接收者时为-1
+    uint32_t fail_num;                // 写入失败次数
+    int prio;                         // 发布时设置的优先级，投递和转发时传给通道
+    bitmap_t sub_bus_map;             // 命中的主题和范围订阅的外部总线并集，每个总线只转发一次
+} msgbus_dispatch_t;
+
+// 统计遍历请求数据体
+typedef struct
+{
+    msgbus_stats_walk_cb_t walk_cb; // 遍历回调
+    void *arg;                      // 回调参数
+} topic_stats_data_t;
+
+// 设置背压策略数据体
+typedef struct
+{
+    msgbus_channel_t channel;  // 订阅通道
+    msgbus_backpressure_t bp;  // 背压配置
+} topic_bp_data_t;
+
+// 借用缓冲区发布数据体，只传递借出消息的指针，不拷贝数据
+typedef struct
+{
+    msgbus_msg_t *loan_msg; // 借出的消息
+} topic_loan_data_t;
+
+/* 默认总线实例，供不带总线参数的接口使用 */
+static msgbus_context_t msgbus_default_ctx MBUS_CACHELINE_ALIGNED;
 /* 本地总线编号 */
-#define LOCAL_BUS_ID (msgbus_ctx.bus_id)
+#define LOCAL_BUS_ID (ctx->bus_id)
 
 #define SIZEOF_MSGBUS_MSG(_pmsg) ((_pmsg)->len + sizeof(msgbus_msg_t))
 
-static topic_node_t *msg_topic_search(struct rb_root *root, uint32_t topic)
+/* 订阅哈希表初始的哈希值右移位数，表长64 */
+#define SUB_HASH_SHIFT_INIT 26u
+
+/* 批量消息中每条消息按4byte对齐 */
+#define MSGBUS_BATCH_ALIGN(_len) (((_len) + 3u) & ~3u)
+/* 批量消息数据的最大长度，加上消息头后仍可作为int传给通道写入接口 */
+#define MSGBUS_BATCH_LEN_MAX ((uint32_t)INT32_MAX - (uint32_t)sizeof(msgbus_msg_t))
+
+static const char msgbus_batch_pad[4];
+
+/* 批量消息中offset处的一条消息，剩余长度放不下消息头或对齐后的数据时返回NULL；先比较未对齐的长度，避免对齐时回绕 */
+static inline msgbus_msg_t *msgbus_batch_item(msgbus_msg_t *bus_msg, uint32_t offset)
 {
-    struct rb_node *node = root->rb_node;
+    msgbus_msg_t *item_msg;
+    uint32_t remain;
 
-    while (node)
+    if (offset > bus_msg->len || bus_msg->len - offset < sizeof(msgbus_msg_t))
     {
-        topic_node_t *data = rb_entry(node, topic_node_t, node);
-        int32_t result;
+        return NULL;
+    }
+    item_msg = (msgbus_msg_t *)(bus_msg->msg_data + offset);
+    remain = bus_msg->len - offset - sizeof(msgbus_msg_t);
+    if (item_msg->len > remain || MSGBUS_BATCH_ALIGN(item_msg->len) > remain)
+    {
+        return NULL;
+    }
+    return item_msg;
+}
 
-        result = topic - data->topic_key;
+/*
+ * 外部总线紧凑格式的版本号。紧凑帧的数据为：版本号（1byte）、主题键、数据体，数据体到帧尾结束，
+ * 不携带user_id，接收端以来源总线编号还原。除批量消息外，数据体按主题转换其中的整数字段，其余数据原样拷贝：
+ *   批量消息：逐条为主题键、数据长度和数据，不再对齐；
+ *   全量同步：一个同步段；增量同步：代数、基准代数、标记，撤销和新增两个同步段；增量应答：代数、nack。
+ * 同步段为主题数量、各主题与前一个主题的差值、范围数量、各范围下限与前一个下限的差值及范围宽度。
+ * 整数均为varint（每byte 7位，最高位表示后面还有），主题表按顺序排列，差值通常只占1byte。
+ */
+#define MSGBUS_WIRE_VERSION 1u
 
-        if (result < 0)
-            node = node->rb_left;
-        else if (result > 0)
-            node = node->rb_right;
-        else
-            return data;
+/* 紧凑编码后长度的上限，32位整数编码后最多5byte */
+#define MSGBUS_WIRE_BOUND(_len) ((_len) + (_len) / 4u + 16u)
+
+// 紧凑格式的转换游标，编码时输入为原格式，解码时输入为紧凑格式
+typedef struct
+{
+    const uint8_t *in;   // 输入数据
+    uint32_t in_len;     // 输入数据长度
+    uint32_t in_pos;     // 已读取的位置
+    uint8_t *out;        // 输出缓冲区，NULL：只计算输出长度
+    uint32_t out_pos;    // 已输出的长度
+    uint32_t src_bus_id; // 来源总线编号，解码时作为各消息的user_id
+    int err;             // 输入数据不完整或格式错误
+} wire_cursor_t;
+
+static inline void wire_put(wire_cursor_t *cursor, const void *data, uint32_t len)
+{
+    if (cursor->out && len)
+    {
+        memcpy(cursor->out + cursor->out_pos, data, len);
     }
-    return NULL;
+    cursor->out_pos += len;
 }
 
-static int32_t msg_topic_insert(struct rb_root *root, topic_node_t *data)
+static inline void wire_put_u32(wire_cursor_t *cursor, uint32_t value)
 {
-    struct rb_node **new = &(root->rb_node), *parent = NULL;
+    wire_put(cursor, &value, sizeof(uint32_t));
+}
 
-    /* Figure out where to put new node */
-    while (*new)
-    {
-        topic_node_t *this = rb_entry(*new, topic_node_t, node);
-        int32_t result = data->topic_key - this->topic_key;
+static inline void wire_put_varint(wire_cursor_t *cursor, uint32_t value)
+{
+    uint8_t buf[5];
+    uint32_t n = 0;
 
-        parent = *new;
-        if (result < 0)
-            new = &((*new)->rb_left);
-        else if (result > 0)
-            new = &((*new)->rb_right);
-        else
-            return -1;
+    while (value >= 0x80u)
+    {
+        buf[n++] = (uint8_t)(value | 0x80u);
+        value >>= 7;
     }
+    buf[n++] = (uint8_t)value;
+    wire_put(cursor, buf, n);
+}
 
-    /* Add new node and rebalance tree. */
-    rb_link_node(&data->node, parent, new);
-    rb_insert_color(&data->node, root);
+/* 读取len字节，数据不足时置错误标记并返回NULL */
+static inline const uint8_t *wire_get(wire_cursor_t *cursor, uint32_t len)
+{
+    const uint8_t *data;
 
-    return 0;
+    if (cursor->err || cursor->in_len - cursor->in_pos < len)
+    {
+        cursor->err = 1;
+        return NULL;
+    }
+    data = cursor->in + cursor->in_pos;
+    cursor->in_pos += len;
+
+    return data;
 }
 
-static int32_t msgbus_proc_event_publish(msgbus_msg_t *bus_msg)
+static inline uint32_t wire_get_u32(wire_cursor_t *cursor)
 {
-    int32_t err = -1;
-    topic_node_t *topic_node;
-    uint32_t user_topic;
-    uint32_t sender_bus_id = bus_msg->user_id;
+    const uint8_t *data = wire_get(cursor, sizeof(uint32_t));
+    uint32_t value = 0;
 
-    user_topic = GET_USER_TOPIC(bus_msg->topic);
-    MBUS_PRINTF("[MBUS] proc event pub, topic: %" PRIu32 " bus id:%" PRIu32 "\r\n",
-                bus_msg->topic, bus_msg->user_id);
-    topic_node = msg_topic_search(&msgbus_ctx.topic_tree, user_topic);
-    // 分发给本地订阅该主题的用户
-    if (topic_node)
+    if (data)
     {
-        sub_user_node_t *sub_user;
-        struct slist_head *pos;
+        memcpy(&value, data, sizeof(uint32_t));
+    }
+    return value;
+}
 
-        slist_for_each(pos, &topic_node->sub_user_list)
+static uint32_t wire_get_varint(wire_cursor_t *cursor)
+{
+    const uint8_t *data;
+    uint32_t value = 0;
+
+    for (uint32_t shift = 0; shift < 35; shift += 7)
+    {
+        if ((data = wire_get(cursor, 1)) == NULL)
         {
-            // 遍历订阅用户列表，依次发送消息
-            sub_user = slist_entry(pos, sub_user_node_t, node);
-            bus_msg->user_id = sub_user->user_id;
-            bus_msg->topic = user_topic;
-            err = msgbus_ctx.channel_write_handler(sub_user->channel, (const void *)bus_msg,
-                                                   SIZEOF_MSGBUS_MSG(bus_msg));
-            // MBUS_ASSERT(err == 0);
-            if (err != 0)
-            {
-                MBUS_PRINTF("[MBUS] Publish channel:%p,Topic:%" PRIu32 " failed\n",
-                            sub_user->channel, bus_msg->topic);
-            }
+            return 0;
+        }
+        value |= (uint32_t)(*data & 0x7Fu) << shift;
+        if (!(*data & 0x80u))
+        {
+            return value;
         }
     }
+    cursor->err = 1;
+
+    return 0;
+}
+
+/* 主题键：用户主题左移2位，第1位表示系统主题（以与MSG_TOPIC_SYSTEM_TOPIC_MAX的差值编码），第0位表示后跟1byte标记 */
+static void wire_put_topic(wire_cursor_t *cursor, uint32_t topic)
+{
+    uint32_t user_topic = GET_USER_TOPIC(topic);
+    uint8_t flags = (uint8_t)(topic >> 24);
+    uint32_t key;
+
+    if (user_topic >= MSG_TOPIC_SYSTEM_TOPIC_MAX)
+    {
+        key = ((user_topic - MSG_TOPIC_SYSTEM_TOPIC_MAX) << 2) | 0x2u;
+    }
     else
     {
-        if (!msgbus_ctx.selfness_flag)
-        { // 不存在的主题，发布错误
-            MBUS_PRINTF("[MBUS] publish error unsubscribe topic, topic: %" PRIu32 "\r\n",
-                        bus_msg->topic);
-            return -1;
-        }
+        key = user_topic << 2;
     }
-    // 分发给外部总线
-    if (!MSG_TOPIC_IS_LOCAL(bus_msg->topic) &&
-        bitmap_cnt(&msgbus_ctx.ext_bus_map))
+    wire_put_varint(cursor, key | (flags ? 0x1u : 0));
+    if (flags)
     {
-        uint32_t sub_bus_id = msgbus_ctx.selfness_flag
-                                  ? bitmap_next(&msgbus_ctx.ext_bus_map, 0)
-                                  : bitmap_next(&topic_node->sub_bus_map, 0);
-
-        while (sub_bus_id)
-        {
-            if (sub_bus_id != sender_bus_id)
-            { // 转发时，排除原始发送者
-                bus_msg->user_id = sub_bus_id;
-                err = msgbus_ctx.channel_write_handler(msgbus_ctx.ext_bus_channel,
-                                                       bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
-                if (err != 0)
-                {
-                    MBUS_PRINTF("[MBUS] Publish Ext bus id:%" PRIu32 " channel:%p,Topic:%" PRIu32 " failed\n",
-                                bus_msg->user_id, msgbus_ctx.ext_bus_channel, bus_msg->topic);
-                }
-            }
-            sub_bus_id = msgbus_ctx.selfness_flag
-                             ? bitmap_next(&msgbus_ctx.ext_bus_map, sub_bus_id)
-                             : bitmap_next(&topic_node->sub_bus_map, sub_bus_id);
-        }
+        wire_put(cursor, &flags, 1);
     }
-
-    return err;
 }
 
-static topic_node_t *msgbus_create_topic_node(uint32_t topic)
+static uint32_t wire_get_topic(wire_cursor_t *cursor)
 {
-    topic_node_t *topic_node;
-
-    topic_node = MBUS_MALLOC(sizeof(topic_node_t));
-    MBUS_ASSERT(topic_node);
-    memset(topic_node, 0, sizeof(topic_node_t));
-    topic_node->topic_key = topic;
-    msg_topic_insert(&msgbus_ctx.topic_tree, topic_node);
-    bitmap_set(&topic_node->sub_bus_map, 0);
-    SINIT_LIST_HEAD(&topic_node->sub_user_list);
-    msgbus_ctx.topic_total++;
+    uint32_t key = wire_get_varint(cursor);
+    uint32_t topic = (key & 0x2u) ? MSG_TOPIC_SYSTEM_TOPIC_MAX + (key >> 2) : (key >> 2);
+    const uint8_t *flags;
 
-    return topic_node;
+    topic = GET_USER_TOPIC(topic);
+    if ((key & 0x1u) && (flags = wire_get(cursor, 1)) != NULL)
+    {
+        topic |= (uint32_t)*flags << 24;
+    }
+    return topic;
 }
 
-static msgbus_msg_t *msgbus_create_topic_sync_data(uint32_t except_bus_id)
+/* 转换一个整数字段，encode：32位整数编码为varint，否则反之 */
+static uint32_t wire_conv_u32(wire_cursor_t *cursor, int encode)
 {
-    topic_sync_data_t *topic_sync_data = NULL;
-    msgbus_msg_t *msg_port = NULL;
+    uint32_t value;
 
-    MBUS_PRINTF("[MBUS] msgbus_create_topic_sync_data except bus id:%" PRIu32 "\r\n", except_bus_id);
-
-    msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_sync_data_t) +
-                           sizeof(msgbus_topic_t) * msgbus_ctx.topic_total);
-    MBUS_ASSERT(msg_port);
-    topic_sync_data = (topic_sync_data_t *)msg_port->msg_data;
-    // 遍历红黑树中的主题节点，创建订阅主题列表
-    topic_node_t *topic_node;
-    struct rb_node *tree_node = rb_first(&msgbus_ctx.topic_tree);
-    uint32_t count = 0;
-    while (tree_node)
+    if (encode)
     {
-        topic_node = container_of(tree_node, topic_node_t, node);
-        // 打包除指定消息总线外的其他主题列表
-        struct slist_head *pos;
-        int sub_user_cnt = 0;
-        slist_for_each(pos, &topic_node->sub_user_list)
-        {
-            sub_user_node_t *sub_user = slist_entry(pos, sub_user_node_t, node);
-            if (!sub_user->user_local_sub)
-            { /* 存在用户的非本地订阅 */
-                topic_sync_data->topic_list[count++] = topic_node->topic_key;
-                sub_user_cnt++;
-                break;
-            }
-        }
-        if (!sub_user_cnt)
-        { /*没有内部用户订阅，检查外部总线订阅 */
-            int sub_bus_cnt = bitmap_cnt(&topic_node->sub_bus_map);
-            if (sub_bus_cnt &&
-                (!except_bus_id || sub_bus_cnt > 1 || !bitmap_is_set(&topic_node->sub_bus_map, except_bus_id)))
-            {
-                topic_sync_data->topic_list[count++] = topic_node->topic_key;
-            }
-        }
-        /* 取下条主题节点 */
-        tree_node = rb_next(tree_node);
-        if (count >= msgbus_ctx.topic_total)
-        {
-            break;
-        }
+        value = wire_get_u32(cursor);
+        wire_put_varint(cursor, value);
     }
-    topic_sync_data->topic_num = count;
-    msg_port->len = sizeof(topic_sync_data_t) + sizeof(msgbus_topic_t) * count;
-    msg_port->topic = TOPIC_BUS_EXT_SYNC;
-
-    return msg_port;
+    else
+    {
+        value = wire_get_varint(cursor);
+        wire_put_u32(cursor, value);
+    }
+    return value;
 }
 
-static void msgbus_ext_bus_map_sync(void)
+/* 转换一个相对base以差值编码的整数字段，差值按32位回绕，返回字段的值 */
+static uint32_t wire_conv_delta(wire_cursor_t *cursor, int encode, uint32_t base)
 {
-    uint32_t bus_total = 0, bus_sync_num = 0;
-    msgbus_msg_t *msg_port = NULL;
+    uint32_t value;
 
-    if (msgbus_ctx.sync_start_flag &&
-        !msgbus_ctx.sync_over_flag)
+    if (encode)
+    {
+        value = wire_get_u32(cursor);
+        wire_put_varint(cursor, value - base);
+    }
+    else
     {
-        bus_total = bitmap_cnt(&msgbus_ctx.ext_bus_map);
-        bus_sync_num = bitmap_cnt(&msgbus_ctx.ext_bus_map_sync);
+        value = base + wire_get_varint(cursor);
+        wire_put_u32(cursor, value);
+    }
+    return value;
+}
 
-        if (!bus_total || bus_total == bus_sync_num)
-        { /* 没有外部总线，或者首次同步时就已经全部收到其他总线的同步（只有一个外部总线的情况下） */
-            uint32_t except_bus_id = bitmap_next(&msgbus_ctx.ext_bus_map, 0);
-            while (except_bus_id)
-            {
-                msg_port = msgbus_create_topic_sync_data(except_bus_id);
-                msg_port->user_id = except_bus_id;
-                msgbus_ctx.channel_write_handler(msgbus_ctx.ext_bus_channel, msg_port,
-                                                 SIZEOF_MSGBUS_MSG(msg_port));
-                MBUS_FREE(msg_port);
-                except_bus_id = bitmap_next(&msgbus_ctx.ext_bus_map, except_bus_id);
-            }
-            msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t));
-            MBUS_ASSERT(msg_port);
-            memset(msg_port, 0, sizeof(msgbus_msg_t));
-            msg_port->user_id = LOCAL_BUS_ID;
-            msg_port->topic = MSG_TOPIC_SET_LOCAL(MSG_TOPIC_SYNC_OVER);
-            msg_port->len = 0;
-            msgbus_proc_event_publish(msg_port);
-            MBUS_FREE(msg_port);
-            msgbus_ctx.sync_over_flag = 1;
-        }
-        else if (bus_total && ((bus_total - 1) == bus_sync_num))
-        { /* 只剩下一个未同步外部总线，向该总线发送当前主题列表 */
-            uint32_t except_bus_id = bitmap_cmp(&msgbus_ctx.ext_bus_map,
-                                                &msgbus_ctx.ext_bus_map_sync);
-            msg_port = msgbus_create_topic_sync_data(except_bus_id);
-            msg_port->user_id = except_bus_id;
-            msgbus_ctx.channel_write_handler(msgbus_ctx.ext_bus_channel, msg_port,
-                                             SIZEOF_MSGBUS_MSG(msg_port));
-            MBUS_FREE(msg_port);
-        }
+/* 检查列表数量不超过剩余输入，避免格式错误的数据导致超长循环 */
+static inline void wire_check_num(wire_cursor_t *cursor, uint32_t num, uint32_t min_size)
+{
+    if ((uint64_t)num * min_size > cursor->in_len - cursor->in_pos)
+    {
+        cursor->err = 1;
     }
 }
 
-static int32_t msgbus_proc_event_sync(void)
+/* 转换一个同步段：主题列表以与前一个主题的差值编码，范围以下限差值和宽度编码 */
+static void wire_conv_sync_block(wire_cursor_t *cursor, int encode)
 {
-    MBUS_PRINTF("[MBUS] proc event topic sync\r\n");
-    msgbus_ctx.sync_start_flag = 1;
+    uint32_t num, prev = 0;
 
-    msgbus_ext_bus_map_sync();
-    return 0;
+    num = wire_conv_u32(cursor, encode);
+    wire_check_num(cursor, num, encode ? sizeof(msgbus_topic_t) : 1);
+    for (uint32_t i = 0; i < num && !cursor->err; i++)
+    {
+        prev = wire_conv_delta(cursor, encode, prev);
+    }
+    num = wire_conv_u32(cursor, encode);
+    wire_check_num(cursor, num, encode ? sizeof(msgbus_topic_range_t) : 2);
+    prev = 0;
+    for (uint32_t i = 0; i < num && !cursor->err; i++)
+    {
+        prev = wire_conv_delta(cursor, encode, prev);
+        wire_conv_delta(cursor, encode, prev);
+    }
 }
 
-static void msgbus_add_ext_sync_topic(msgbus_msg_t *bus_msg)
+/* 转换批量消息中的一条消息，紧凑格式不携带user_id和对齐填充 */
+static void wire_conv_batch_item(wire_cursor_t *cursor, int encode)
 {
-    topic_node_t *topic_node;
-    topic_sync_data_t *topic_sync_data = (topic_sync_data_t *)bus_msg->msg_data;
+    const uint8_t *data;
+    uint32_t topic, len;
 
-    MBUS_PRINTF("[MBUS] add extern topic, topic num: %" PRIu32 "\r\n", topic_sync_data->topic_num);
-    // 将主题列表更新到本地总线主题列表
-    for (size_t i = 0; i < topic_sync_data->topic_num; i++)
+    if (encode)
     {
-        if (topic_sync_data->topic_list[i] == 0)
-        {
-            break;
-        }
-
-        topic_node = msg_topic_search(&msgbus_ctx.topic_tree,
-                                      GET_USER_TOPIC(topic_sync_data->topic_list[i]));
-        if (topic_node == NULL)
-        { // 当前主题不存在，新建
-            topic_node = msgbus_create_topic_node(GET_USER_TOPIC(topic_sync_data->topic_list[i]));
-            MBUS_PRINTF("[MBUS] extern topic not exist, create. topic: %" PRIu32 ", topic total:%d\r\n",
-                        topic_sync_data->topic_list[i],
-                        msgbus_ctx.topic_total);
-        }
-        if (!bitmap_is_set(&topic_node->sub_bus_map, bus_msg->user_id))
+        topic = wire_get_u32(cursor);
+        len = wire_get_u32(cursor);
+        wire_get_u32(cursor);
+        wire_check_num(cursor, len, 1);
+        data = wire_get(cursor, MSGBUS_BATCH_ALIGN(len));
+        wire_put_topic(cursor, topic);
+        wire_put_varint(cursor, len);
+        if (data)
         {
-            bitmap_set(&topic_node->sub_bus_map, bus_msg->user_id);
+            wire_put(cursor, data, len);
         }
+        return;
+    }
+    topic = wire_get_topic(cursor);
+    len = wire_get_varint(cursor);
+    if ((data = wire_get(cursor, len)) == NULL)
+    {
+        return;
     }
+    wire_put_u32(cursor, topic);
+    wire_put_u32(cursor, len);
+    wire_put_u32(cursor, cursor->src_bus_id);
+    wire_put(cursor, data, len);
+    wire_put(cursor, msgbus_batch_pad, MSGBUS_BATCH_ALIGN(len) - len);
 }
 
-static int32_t msgbus_proc_event_ext_sync(msgbus_msg_t *bus_msg)
+/* 按主题转换消息的数据体，不认识的字段原样拷贝 */
+static void wire_conv_body(wire_cursor_t *cursor, uint32_t topic, int encode)
 {
-    MBUS_PRINTF("[MBUS] recv_ext_msg, peer id:%" PRIu32 ",topic :%" PRIu32 ", len:%" PRIu32 "\r\n",
-                bus_msg->user_id, bus_msg->topic, bus_msg->len);
-    if (!bitmap_is_set(&msgbus_ctx.ext_bus_map_sync, bus_msg->user_id))
-    { // 该外部总线没有同步过
-        bitmap_set(&msgbus_ctx.ext_bus_map_sync, bus_msg->user_id);
-        if (!msgbus_ctx.selfness_flag)
+    const uint8_t *data;
+    uint32_t len;
+
+    switch (topic)
+    {
+    case TOPIC_BUS_BATCH:
+        while (!cursor->err && cursor->in_pos < cursor->in_len)
         {
-            msgbus_add_ext_sync_topic(bus_msg);
+            wire_conv_batch_item(cursor, encode);
         }
-        msgbus_ext_bus_map_sync();
+        return;
+
+    case TOPIC_BUS_EXT_SYNC: // 同步段之后的能力标记原样拷贝
+        wire_conv_sync_block(cursor, encode);
+        break;
+
+    case TOPIC_BUS_EXT_DELTA:
+        wire_conv_u32(cursor, encode);
+        wire_conv_u32(cursor, encode);
+        wire_conv_u32(cursor, encode);
+        wire_conv_sync_block(cursor, encode);
+        wire_conv_sync_block(cursor, encode);
+        break;
+
+    case TOPIC_BUS_EXT_ACK:
+        wire_conv_u32(cursor, encode);
+        wire_conv_u32(cursor, encode);
+        break;
+
+    default:
+        break;
+    }
+    len = cursor->in_len - cursor->in_pos;
+    if (!cursor->err && (data = wire_get(cursor, len)) != NULL)
+    {
+        wire_put(cursor, data, len);
+    }
+}
+
+/* 将发往外部总线的消息编码为紧凑格式，out至少为MSGBUS_WIRE_BOUND(bus_msg->len)，返回编码后的长度，0：消息格式错误 */
+static uint32_t msgbus_wire_encode(const msgbus_msg_t *bus_msg, uint8_t *out)
+{
+    wire_cursor_t cursor = {0};
+    uint8_t version = MSGBUS_WIRE_VERSION;
+
+    cursor.in = (const uint8_t *)bus_msg->msg_data;
+    cursor.in_len = bus_msg->len;
+    cursor.out = out;
+    wire_put(&cursor, &version, 1);
+    wire_put_topic(&cursor, bus_msg->topic);
+    wire_conv_body(&cursor, bus_msg->topic, 1);
+
+    return cursor.err ? 0 : cursor.out_pos;
+}
+
+/* 还原紧凑格式的外部总线帧，src_bus_id为来源总线编号，返回申请的消息，NULL：版本不支持或格式错误 */
+static msgbus_msg_t *msgbus_wire_decode(const void *data, uint32_t len, uint32_t src_bus_id)
+{
+    wire_cursor_t cursor = {0};
+    msgbus_msg_t *bus_msg;
+    const uint8_t *version;
+    uint32_t topic, body_pos;
+
+    cursor.in = (const uint8_t *)data;
+    cursor.in_len = len;
+    cursor.src_bus_id = src_bus_id;
+    version = wire_get(&cursor, 1);
+    if (version == NULL || *version != MSGBUS_WIRE_VERSION)
+    {
+        MBUS_LOG_E("[MBUS] unsupported compact frame from bus id:%" PRIu32 ", len:%" PRIu32 "\r\n", src_bus_id, len);
+        return NULL;
+    }
+    topic = wire_get_topic(&cursor);
+    if (GET_USER_TOPIC(topic) >= MSG_TOPIC_SYSTEM_TOPIC_MAX && topic != TOPIC_BUS_BATCH &&
+        topic != TOPIC_BUS_EXT_SYNC && topic != TOPIC_BUS_EXT_DELTA && topic != TOPIC_BUS_EXT_ACK)
+    { // 外部总线只会发来发布消息和外部总线同步消息，其它内部消息带有本地指针，不能接收
+        cursor.err = 1;
+    }
+    body_pos = cursor.in_pos;
+    // 第一遍只计算还原后的长度
+    wire_conv_body(&cursor, topic, 0);
+    if (cursor.err)
+    {
+        MBUS_LOG_E("[MBUS] corrupt compact frame from bus id:%" PRIu32 ", len:%" PRIu32 "\r\n", src_bus_id, len);
+        return NULL;
+    }
+    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + cursor.out_pos);
+    MBUS_ASSERT(bus_msg);
+    if (bus_msg == NULL)
+    {
+        return NULL;
+    }
+    bus_msg->topic = topic;
+    bus_msg->len = cursor.out_pos;
+    bus_msg->user_id = src_bus_id;
+    cursor.in_pos = body_pos;
+    cursor.out = (uint8_t *)bus_msg->msg_data;
+    cursor.out_pos = 0;
+    wire_conv_body(&cursor, topic, 0);
+
+    return bus_msg;
+}
+
+#if MBUS_TOPIC_INDEX == TOPIC_INDEX_RBTREE
+static topic_node_t *msg_topic_search(struct rb_root *root, uint32_t topic)
+{
+    struct rb_node *node = root->rb_node;
+
+    while (node)
+    {
+        topic_node_t *data = rb_entry(node, topic_node_t, node);
+        int32_t result;
+
+        result = topic - data->topic_key;
+
+        if (result < 0)
+            node = node->rb_left;
+        else if (result > 0)
+            node = node->rb_right;
+        else
+            return data;
+    }
+    return NULL;
+}
+#endif
+
+static int32_t msg_topic_insert(struct rb_root *root, topic_node_t *data)
+{
+    struct rb_node **new = &(root->rb_node), *parent = NULL;
+
+    /* Figure out where to put new node */
+    while (*new)
+    {
+        topic_node_t *this = rb_entry(*new, topic_node_t, node);
+        int32_t result = data->topic_key - this->topic_key;
+
+        parent = *new;
+        if (result < 0)
+            new = &((*new)->rb_left);
+        else if (result > 0)
+            new = &((*new)->rb_right);
+        else
+            return -1;
+    }
+
+    /* Add new node and rebalance tree. */
+    rb_link_node(&data->node, parent, new);
+    rb_insert_color(&data->node, root);
+
+    return 0;
+}
+
+/* 在已知的后继节点next之前插入，省去从根节点查找插入位置 */
+static void msg_topic_link_before(struct rb_root *root, topic_node_t *data, struct rb_node *next)
+{
+    struct rb_node *parent, **link;
+
+    if (next->rb_left == NULL)
+    {
+        parent = next;
+        link = &next->rb_left;
+    }
+    else
+    { // 前驱是左子树中最右的节点，没有右孩子
+        parent = rb_prev(next);
+        link = &parent->rb_right;
+    }
+    rb_link_node(&data->node, parent, link);
+    rb_insert_color(&data->node, root);
+}
+
+/* 范围节点的子树最大上限，取自身上限和左右子树的最大值 */
+static inline uint32_t msgbus_range_subtree_hi(topic_node_t *range_node)
+{
+    uint32_t subtree_hi = range_node->topic_hi;
+    topic_node_t *child;
+
+    if (range_node->node.rb_left)
+    {
+        child = rb_entry(range_node->node.rb_left, topic_node_t, node);
+        if (child->subtree_hi > subtree_hi)
+        {
+            subtree_hi = child->subtree_hi;
+        }
+    }
+    if (range_node->node.rb_right)
+    {
+        child = rb_entry(range_node->node.rb_right, topic_node_t, node);
+        if (child->subtree_hi > subtree_hi)
+        {
+            subtree_hi = child->subtree_hi;
+        }
+    }
+    return subtree_hi;
+}
+
+RB_DECLARE_CALLBACKS(static, msgbus_range_augment, topic_node_t, node, uint32_t, subtree_hi, msgbus_range_subtree_hi)
+
+/* 范围按下限排序，下限相同按上限排序 */
+static inline int32_t msg_range_cmp(uint32_t topic_lo, uint32_t topic_hi, const topic_node_t *range_node)
+{
+    if (topic_lo != range_node->topic_key)
+    {
+        return topic_lo < range_node->topic_key ? -1 : 1;
+    }
+    if (topic_hi != range_node->topic_hi)
+    {
+        return topic_hi < range_node->topic_hi ? -1 : 1;
+    }
+    return 0;
+}
+
+static topic_node_t *msg_range_search(struct rb_root *root, uint32_t topic_lo, uint32_t topic_hi)
+{
+    struct rb_node *node = root->rb_node;
+
+    while (node)
+    {
+        topic_node_t *data = rb_entry(node, topic_node_t, node);
+        int32_t result = msg_range_cmp(topic_lo, topic_hi, data);
+
+        if (result < 0)
+            node = node->rb_left;
+        else if (result > 0)
+            node = node->rb_right;
+        else
+            return data;
+    }
+    return NULL;
+}
+
+/* 插入范围节点，调用前已确认不存在，沿查找路径更新子树最大上限，旋转时由回调维护 */
+static void msg_range_insert(struct rb_root *root, topic_node_t *data)
+{
+    struct rb_node **new = &(root->rb_node), *parent = NULL;
+
+    data->subtree_hi = data->topic_hi;
+    while (*new)
+    {
+        topic_node_t *this = rb_entry(*new, topic_node_t, node);
+
+        parent = *new;
+        if (this->subtree_hi < data->topic_hi)
+        {
+            this->subtree_hi = data->topic_hi;
+        }
+        if (msg_range_cmp(data->topic_key, data->topic_hi, this) < 0)
+            new = &((*new)->rb_left);
+        else
+            new = &((*new)->rb_right);
+    }
+    rb_link_node(&data->node, parent, new);
+    rb_insert_augmented(&data->node, root, &msgbus_range_augment);
+}
+
+typedef void (*range_deliver_t)(msgbus_dispatch_t *dispatch, topic_node_t *range_node);
+
+/*
+ * 对包含topic的每个范围节点调用deliver。子树的最大上限小于topic时整棵子树跳过，
+ * 节点下限大于topic时右子树也不会命中，每个命中的范围最多访问O(log n)个节点。
+ */
+static void msgbus_range_visit(struct rb_node *rb, uint32_t topic, range_deliver_t deliver, msgbus_dispatch_t *dispatch)
+{
+    while (rb)
+    {
+        topic_node_t *range_node = rb_entry(rb, topic_node_t, node);
+
+        if (range_node->subtree_hi < topic)
+        {
+            return;
+        }
+        msgbus_range_visit(rb->rb_left, topic, deliver, dispatch);
+        if (range_node->topic_key > topic)
+        {
+            return;
+        }
+        if (range_node->topic_hi >= topic)
+        {
+            deliver(dispatch, range_node);
+        }
+        rb = rb->rb_right;
+    }
+}
+
+/* 查找主题节点，配置了查找索引时使用索引，否则查找红黑树 */
+static inline topic_node_t *msgbus_topic_find(msgbus_context_t *ctx, uint32_t topic)
+{
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+    return topic_index_search(&ctx->topic_index, topic);
+#else
+    return msg_topic_search(&ctx->topic_tree, topic);
+#endif
+}
+
+/* 统计一次向订阅用户通道的写入 */
+static inline void msgbus_stat_deliver(msgbus_context_t *ctx, topic_counter_t *topic_counter, sub_counter_t *sub_counter,
+                                       int32_t err, uint32_t len)
+{
+    if (err == 0)
+    {
+        MBUS_STAT_ADD(&sub_counter->deliver_cnt, 1);
+        MBUS_STAT_ADD(&sub_counter->deliver_bytes, len);
+        MBUS_STAT_ADD(&topic_counter->fanout_cnt, 1);
+    }
+    else
+    {
+        MBUS_STAT_ADD(&sub_counter->write_fail_cnt, 1);
+        MBUS_STAT_ADD(&sub_counter->drop_cnt, 1);
+        MBUS_STAT_ADD(&topic_counter->write_fail_cnt, 1);
+        MBUS_STAT_ADD(&ctx->counter.write_fail_cnt, 1);
+    }
+}
+
+/* 统计一次向外部总线的转发，selfness模式下没有主题节点时topic_counter为NULL */
+static inline void msgbus_stat_forward(msgbus_context_t *ctx, topic_counter_t *topic_counter, uint32_t bus_id,
+                                       int32_t err, uint32_t len)
+{
+    msgbus_ext_bus_stats_t *ext_bus_stats;
+
+    if (bus_id == 0 || bus_id > MSGBUS_EXT_BUS_MAX)
+    {
+        return;
+    }
+    ext_bus_stats = &ctx->ext_bus_stats[bus_id - 1];
+    if (err == 0)
+    {
+        MBUS_STAT_ADD(&ext_bus_stats->forward_cnt, 1);
+        MBUS_STAT_ADD(&ext_bus_stats->forward_bytes, len);
+        if (topic_counter)
+        {
+            MBUS_STAT_ADD(&topic_counter->fanout_cnt, 1);
+        }
+    }
+    else
+    {
+        MBUS_STAT_ADD(&ext_bus_stats->forward_fail_cnt, 1);
+        MBUS_STAT_ADD(&ctx->counter.write_fail_cnt, 1);
+        if (topic_counter)
+        {
+            MBUS_STAT_ADD(&topic_counter->write_fail_cnt, 1);
+        }
+    }
+}
+
+/* 统计一次派发，fanout为0表示没有任何接收者 */
+static inline void msgbus_stat_publish(topic_counter_t *topic_counter, uint32_t len, uint32_t fanout)
+{
+    if (topic_counter)
+    {
+        MBUS_STAT_ADD(&topic_counter->publish_cnt, 1);
+        MBUS_STAT_ADD(&topic_counter->publish_bytes, len);
+        if (!fanout)
+        {
+            MBUS_STAT_ADD(&topic_counter->drop_cnt, 1);
+        }
+    }
+}
+
+/* 将消息编码为MSG_TOPIC_EXT_COMPACT帧，user_id由调用者填写，返回申请的帧，NULL：内存不足或消息格式错误 */
+static msgbus_msg_t *msgbus_wire_pack(const msgbus_msg_t *bus_msg)
+{
+    msgbus_msg_t *wire_msg;
+
+    wire_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + MSGBUS_WIRE_BOUND(bus_msg->len));
+    if (wire_msg == NULL)
+    {
+        return NULL;
+    }
+    wire_msg->len = msgbus_wire_encode(bus_msg, (uint8_t *)wire_msg->msg_data);
+    if (wire_msg->len == 0)
+    {
+        MBUS_FREE(wire_msg);
+        return NULL;
+    }
+    wire_msg->topic = MSG_TOPIC_EXT_COMPACT;
+
+    return wire_msg;
+}
+
+/* 写入外部总线通道，user_id为目的总线；对端已协商紧凑格式时编码后以MSG_TOPIC_EXT_COMPACT帧写入 */
+static int32_t msgbus_ext_write(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, int prio)
+{
+    msgbus_msg_t *wire_msg;
+    int32_t err;
+
+    if (!ctx->compact_flag || !bitmap_is_set(&ctx->ext_bus_map_compact, bus_msg->user_id) ||
+        (wire_msg = msgbus_wire_pack(bus_msg)) == NULL)
+    { // 编码失败时对端同样能接收原格式
+        return ctx->channel_write_handler(ctx->ext_bus_channel, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+    }
+    wire_msg->user_id = bus_msg->user_id;
+    err = ctx->channel_write_handler(ctx->ext_bus_channel, wire_msg, SIZEOF_MSGBUS_MSG(wire_msg), prio);
+    MBUS_FREE(wire_msg);
+
+    return err;
+}
+
+/* 发送外部总线的合并帧，调用者持有合并帧锁；帧中只有一条消息时按原格式单独发送。
+ * 与直接转发一致，写入通道的帧user_id为目的总线，帧内各消息的来源由接收端按帧的user_id确定 */
+static int32_t msgbus_egress_flush_locked(msgbus_context_t *ctx, uint32_t bus_id, egress_frame_t *egress)
+{
+    msgbus_msg_t *send_msg = egress->frame;
+    int32_t err;
+
+    if (!egress->num)
+    {
+        return 0;
+    }
+    if (egress->num == 1)
+    {
+        send_msg = (msgbus_msg_t *)egress->frame->msg_data;
+    }
+    send_msg->user_id = bus_id;
+    err = msgbus_ext_write(ctx, send_msg, egress->prio);
+    if (err != 0)
+    { // 合并时已计入转发，发送失败的消息再逐条计入失败，与未合并时的统计一致
+        MBUS_TRACE(MSGBUS_TRACE_FORWARD_FAIL, send_msg->topic, bus_id, send_msg->len);
+        MBUS_STAT_ADD(&ctx->ext_bus_stats[bus_id - 1].forward_fail_cnt, egress->num);
+        MBUS_STAT_ADD(&ctx->counter.write_fail_cnt, egress->num);
+        MBUS_LOG_W("[MBUS] Flush Ext bus id:%" PRIu32 " channel:%p, msg num:%" PRIu32 " failed\n",
+                    bus_id, ctx->ext_bus_channel, egress->num);
+    }
+    egress->frame->len = 0;
+    MBUS_ATOMIC_STORE_RELEASE(&egress->num, 0);
+    MBUS_ATOMIC_SUB_RELAXED(&ctx->egress_pending, 1);
+
+    return err;
+}
+
+/*
+ * 转发一条消息到外部总线。开启合并（ext_coalesce_bytes）时消息先拷贝到该总线的合并帧，
+ * 帧满、优先级变化或第一条消息等待超过ext_coalesce_us时整帧发送，接收端按批量消息派发；
+ * 合并的消息返回0，发送失败在发送合并帧时按消息条数统计。
+ * 未开启合并、总线不在外部总线表中或消息超过合并帧长度时直接写入外部总线通道。
+ */
+static int32_t msgbus_ext_forward(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, uint32_t bus_id, int prio)
+{
+    uint32_t item_size = sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN(bus_msg->len);
+    egress_frame_t *egress;
+    msgbus_msg_t *frame;
+    msgbus_msg_t *item_msg;
+
+    if (!ctx->coalesce_bytes || !bitmap_is_set(&ctx->ext_bus_map, bus_id) ||
+        sizeof(msgbus_msg_t) + item_size > ctx->coalesce_bytes)
+    {
+        bus_msg->user_id = bus_id;
+        return msgbus_ext_write(ctx, bus_msg, prio);
+    }
+    egress = &ctx->egress[bus_id - 1];
+    MBUS_LOCK(&egress->lock);
+    frame = egress->frame;
+    if (frame == NULL)
+    {
+        frame = MBUS_MALLOC(ctx->coalesce_bytes);
+        if (frame == NULL)
+        {
+            MBUS_UNLOCK(&egress->lock);
+            bus_msg->user_id = bus_id;
+            return msgbus_ext_write(ctx, bus_msg, prio);
+        }
+        frame->topic = TOPIC_BUS_BATCH;
+        frame->len = 0;
+        egress->frame = frame;
+    }
+    if (egress->num && (egress->prio != prio || sizeof(msgbus_msg_t) + frame->len + item_size > ctx->coalesce_bytes))
+    { // 优先级不同或放不下，先发送已合并的消息，保持转发顺序
+        msgbus_egress_flush_locked(ctx, bus_id, egress);
+    }
+    item_msg = (msgbus_msg_t *)(frame->msg_data + frame->len);
+    item_msg->topic = bus_msg->topic;
+    item_msg->user_id = LOCAL_BUS_ID;
+    item_msg->len = bus_msg->len;
+    memcpy(item_msg->msg_data, bus_msg->msg_data, bus_msg->len);
+    memset(item_msg->msg_data + bus_msg->len, 0, MSGBUS_BATCH_ALIGN(bus_msg->len) - bus_msg->len);
+    frame->len += item_size;
+    if (egress->num == 0)
+    {
+        egress->prio = prio;
+        egress->first_us = ctx->coalesce_us ? MBUS_TIME_US() : 0;
+        MBUS_ATOMIC_ADD_RELAXED(&ctx->egress_pending, 1);
+        MBUS_ATOMIC_STORE_RELEASE(&egress->num, 1);
+    }
+    else
+    {
+        MBUS_ATOMIC_STORE_RELEASE(&egress->num, egress->num + 1);
+        if (sizeof(msgbus_msg_t) * 2 + frame->len >= ctx->coalesce_bytes ||
+            (ctx->coalesce_us && MBUS_TIME_US() - egress->first_us >= ctx->coalesce_us))
+        { // 帧已放不下下一条消息，或第一条消息已等待到期
+            msgbus_egress_flush_locked(ctx, bus_id, egress);
+        }
+    }
+    MBUS_UNLOCK(&egress->lock);
+
+    return 0;
+}
+
+/* 发送指定外部总线上正在合并的帧，写入组播帧之前调用，保持各外部总线的转发顺序 */
+static void msgbus_egress_flush_map(msgbus_context_t *ctx, const bitmap_t *bus_map)
+{
+    egress_frame_t *egress;
+
+    for (uint32_t bus_id = bitmap_next(bus_map, 0); bus_id; bus_id = bitmap_next(bus_map, bus_id))
+    {
+        egress = &ctx->egress[bus_id - 1];
+        if (!MBUS_ATOMIC_LOAD_ACQUIRE(&egress->num))
+        {
+            continue;
+        }
+        MBUS_LOCK(&egress->lock);
+        msgbus_egress_flush_locked(ctx, bus_id, egress);
+        MBUS_UNLOCK(&egress->lock);
+    }
+}
+
+/* 向dest_map中的外部总线写入一帧组播帧，原消息为head及其后的data，目的总线表按32位字编码 */
+static int32_t msgbus_multicast_write(msgbus_context_t *ctx, const msgbus_msg_t *head, const void *data,
+                                      const bitmap_t *dest_map, int prio)
+{
+    uint32_t mcast_buf[1 + BITMAP_ARRAY_SIZE] = {0};
+    msgbus_multicast_t *mcast = (msgbus_multicast_t *)mcast_buf;
+    msgbus_msg_t frame = {0};
+    msgbus_iovec_t iov[4];
+    msgbus_msg_t *mcast_msg;
+    uint32_t map_len;
+    uint8_t *pos;
+    int32_t err;
+
+    // 按编号从小到大遍历，最后一个总线决定字数量
+    for (uint32_t bus_id = bitmap_next(dest_map, 0); bus_id; bus_id = bitmap_next(dest_map, bus_id))
+    {
+        mcast->dest_map[(bus_id - 1) >> 5] |= 1u << ((bus_id - 1) & 31);
+        mcast->word_num = ((bus_id - 1) >> 5) + 1;
+    }
+    map_len = sizeof(msgbus_multicast_t) + sizeof(uint32_t) * mcast->word_num;
+    frame.topic = MSG_TOPIC_EXT_MULTICAST;
+    frame.len = map_len + sizeof(msgbus_msg_t) + head->len;
+    if (ctx->channel_writev_handler)
+    { // 帧头、组播头、原消息头和数据分段写入，不需要申请内存拷贝
+        iov[0].base = &frame;
+        iov[0].len = sizeof(msgbus_msg_t);
+        iov[1].base = mcast;
+        iov[1].len = map_len;
+        iov[2].base = head;
+        iov[2].len = sizeof(msgbus_msg_t);
+        iov[3].base = data;
+        iov[3].len = head->len;
+        return ctx->channel_writev_handler(ctx->ext_bus_channel, iov, head->len ? 4 : 3, prio);
+    }
+    mcast_msg = MBUS_MALLOC(SIZEOF_MSGBUS_MSG(&frame));
+    if (mcast_msg == NULL)
+    {
+        return -1;
+    }
+    memcpy(mcast_msg, &frame, sizeof(msgbus_msg_t));
+    pos = (uint8_t *)mcast_msg->msg_data;
+    memcpy(pos, mcast, map_len);
+    memcpy(pos + map_len, head, sizeof(msgbus_msg_t));
+    memcpy(pos + map_len + sizeof(msgbus_msg_t), data, head->len);
+    err = ctx->channel_write_handler(ctx->ext_bus_channel, mcast_msg, SIZEOF_MSGBUS_MSG(mcast_msg), prio);
+    MBUS_FREE(mcast_msg);
+
+    return err;
+}
+
+/*
+ * 组播转发，排除原始发送者后，已协商紧凑格式和未协商的目的总线分为两组，每组多于1个总线时各写入一帧组播帧，
+ * 紧凑组的原消息按紧凑格式编码，由移植层硬件组播、广播或软件扇出。
+ * 返回1：已写入组播帧，mcast_map为组播覆盖的总线，其中写入失败的总线记入fail_map，其余总线由调用者逐个转发；
+ * 0：未开启组播或不需要组播
+ */
+static int msgbus_ext_multicast(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, const bitmap_t *sub_bus_map,
+                                uint32_t sender_bus_id, int prio, bitmap_t *mcast_map, bitmap_t *fail_map)
+{
+    bitmap_t compact_map;
+    msgbus_msg_t head;
+    msgbus_msg_t *wire_msg;
+
+    if (!ctx->multicast_flag)
+    {
+        return 0;
+    }
+    bitmap_init(mcast_map, NULL, 0);
+    bitmap_init(&compact_map, NULL, 0);
+    for (uint32_t bus_id = bitmap_next(sub_bus_map, 0); bus_id; bus_id = bitmap_next(sub_bus_map, bus_id))
+    {
+        if (bus_id == sender_bus_id)
+        {
+            continue;
+        }
+        bitmap_set(ctx->compact_flag && bitmap_is_set(&ctx->ext_bus_map_compact, bus_id) ? &compact_map : mcast_map,
+                   bus_id);
+    }
+    if (bitmap_cnt(mcast_map) < 2)
+    {
+        bitmap_init(mcast_map, NULL, 0);
+    }
+    if (bitmap_cnt(&compact_map) < 2)
+    {
+        bitmap_init(&compact_map, NULL, 0);
+    }
+    if (bitmap_is_empty(mcast_map) && bitmap_is_empty(&compact_map))
+    {
+        return 0;
+    }
+    bitmap_init(fail_map, NULL, 0);
+    head.topic = bus_msg->topic;
+    head.len = bus_msg->len;
+    head.user_id = LOCAL_BUS_ID;
+    if (!bitmap_is_empty(mcast_map))
+    {
+        if (ctx->coalesce_bytes && MBUS_ATOMIC_LOAD_RELAXED(&ctx->egress_pending))
+        {
+            msgbus_egress_flush_map(ctx, mcast_map);
+        }
+        if (msgbus_multicast_write(ctx, &head, bus_msg->msg_data, mcast_map, prio) != 0)
+        {
+            bitmap_copy(fail_map, mcast_map);
+        }
+    }
+    if (!bitmap_is_empty(&compact_map))
+    {
+        if (ctx->coalesce_bytes && MBUS_ATOMIC_LOAD_RELAXED(&ctx->egress_pending))
+        {
+            msgbus_egress_flush_map(ctx, &compact_map);
+        }
+        wire_msg = msgbus_wire_pack(bus_msg);
+        if (wire_msg)
+        {
+            wire_msg->user_id = LOCAL_BUS_ID;
+        }
+        // 编码失败时按原格式组播，对端同样能接收
+        if (msgbus_multicast_write(ctx, wire_msg ? wire_msg : &head, wire_msg ? wire_msg->msg_data : bus_msg->msg_data,
+                                   &compact_map, prio) != 0)
+        {
+            bitmap_or(fail_map, &compact_map);
+        }
+        if (wire_msg)
+        {
+            MBUS_FREE(wire_msg);
+        }
+        bitmap_or(mcast_map, &compact_map);
+    }
+
+    return 1;
+}
+
+/* 发送到期的合并帧，flush_all时发送全部合并帧；返回距下一个合并帧到期的微秒数，-1：没有等待到期的合并帧 */
+static int64_t msgbus_egress_poll(msgbus_context_t *ctx, int flush_all, int32_t *err)
+{
+    int64_t next_us = -1;
+    int64_t wait_us;
+    uint64_t now_us;
+    egress_frame_t *egress;
+
+    if (!MBUS_ATOMIC_LOAD_RELAXED(&ctx->egress_pending))
+    {
+        return -1;
+    }
+    now_us = ctx->coalesce_us ? MBUS_TIME_US() : 0;
+    for (uint32_t bus_id = bitmap_next(&ctx->ext_bus_map, 0); bus_id;
+         bus_id = bitmap_next(&ctx->ext_bus_map, bus_id))
+    {
+        egress = &ctx->egress[bus_id - 1];
+        if (!MBUS_ATOMIC_LOAD_ACQUIRE(&egress->num))
+        {
+            continue;
+        }
+        MBUS_LOCK(&egress->lock);
+        if (egress->num)
+        {
+            // 读取时间后其它线程可能刚开始合并新帧，等待时间按0计算
+            wait_us = (int64_t)(now_us - egress->first_us);
+            wait_us = wait_us < 0 ? 0 : wait_us;
+            if (flush_all || (ctx->coalesce_us && wait_us >= (int64_t)ctx->coalesce_us))
+            {
+                if (msgbus_egress_flush_locked(ctx, bus_id, egress) != 0 && err)
+                {
+                    *err = -1;
+                }
+            }
+            else if (ctx->coalesce_us && (next_us < 0 || (int64_t)ctx->coalesce_us - wait_us < next_us))
+            {
+                next_us = (int64_t)ctx->coalesce_us - wait_us;
+            }
+        }
+        MBUS_UNLOCK(&egress->lock);
+    }
+
+    return next_us;
+}
+
+/* 订阅参数的哈希值，主题（范围）、用户、通道和回调都相同才是同一个订阅，精确主题的上下限相同 */
+static inline uint32_t msgbus_sub_hash(uint32_t topic_lo, uint32_t topic_hi, const topic_sub_data_t *sub_data)
+{
+    uint32_t hash = topic_lo * 0x9E3779B1u;
+
+    hash = (hash ^ topic_hi) * 0x9E3779B1u;
+    hash = (hash ^ sub_data->user_id) * 0x9E3779B1u;
+    hash = (hash ^ (uint32_t)(uintptr_t)sub_data->channel) * 0x9E3779B1u;
+    hash = (hash ^ (uint32_t)(uintptr_t)sub_data->sub_cb) * 0x9E3779B1u;
+    hash = (hash ^ (uint32_t)(uintptr_t)sub_data->cb_ctx) * 0x9E3779B1u;
+
+    return hash ^ (hash >> 16);
+}
+
+static sub_user_node_t *msgbus_sub_find(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi,
+                                        const topic_sub_data_t *sub_data)
+{
+    uint32_t hash = msgbus_sub_hash(topic_lo, topic_hi, sub_data);
+    sub_user_node_t *sub_user;
+
+    if (ctx->sub_hash == NULL)
+    {
+        return NULL;
+    }
+    for (sub_user = ctx->sub_hash[hash >> ctx->sub_hash_shift]; sub_user; sub_user = sub_user->hash_next)
+    {
+        if (sub_user->hash == hash &&
+            sub_user->topic_node->topic_key == topic_lo &&
+            sub_user->topic_node->topic_hi == topic_hi &&
+            sub_user->user_id == sub_data->user_id &&
+            sub_user->channel == sub_data->channel &&
+            sub_user->sub_cb == sub_data->sub_cb &&
+            sub_user->cb_ctx == sub_data->cb_ctx)
+        {
+            return sub_user;
+        }
+    }
+    return NULL;
+}
+
+/* 按新表长重建订阅哈希表，节点中保存了哈希值，不需要重新计算 */
+static int32_t msgbus_sub_hash_resize(msgbus_context_t *ctx, uint32_t shift)
+{
+    uint32_t size = 1u << (32 - shift);
+    sub_user_node_t **table, *sub_user, *next;
+
+    table = MBUS_MALLOC(sizeof(sub_user_node_t *) * size);
+    if (table == NULL)
+    {
+        return -1;
+    }
+    memset(table, 0, sizeof(sub_user_node_t *) * size);
+    if (ctx->sub_hash)
+    {
+        for (uint32_t i = 0; i < (1u << (32 - ctx->sub_hash_shift)); i++)
+        {
+            for (sub_user = ctx->sub_hash[i]; sub_user; sub_user = next)
+            {
+                next = sub_user->hash_next;
+                sub_user->hash_next = table[sub_user->hash >> shift];
+                table[sub_user->hash >> shift] = sub_user;
+            }
+        }
+        MBUS_FREE(ctx->sub_hash);
+    }
+    ctx->sub_hash = table;
+    ctx->sub_hash_shift = shift;
+
+    return 0;
+}
+
+/* 加入订阅哈希表，调用前哈希表已经创建 */
+static void msgbus_sub_hash_add(msgbus_context_t *ctx, sub_user_node_t *sub_user)
+{
+    uint32_t slot;
+
+    if (ctx->sub_num >= (1u << (32 - ctx->sub_hash_shift)) && ctx->sub_hash_shift > 8)
+    { // 平均每个桶超过一个节点时扩容，扩容失败时冲突链变长，不影响正确性
+        msgbus_sub_hash_resize(ctx, ctx->sub_hash_shift - 1);
+    }
+    slot = sub_user->hash >> ctx->sub_hash_shift;
+    sub_user->hash_next = ctx->sub_hash[slot];
+    ctx->sub_hash[slot] = sub_user;
+    ctx->sub_num++;
+}
+
+static void msgbus_sub_hash_del(msgbus_context_t *ctx, sub_user_node_t *sub_user)
+{
+    sub_user_node_t **link = &ctx->sub_hash[sub_user->hash >> ctx->sub_hash_shift];
+
+    while (*link)
+    {
+        if (*link == sub_user)
+        {
+            *link = sub_user->hash_next;
+            ctx->sub_num--;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+static msgbus_shared_buf_t *msgbus_shared_buf_alloc(uint32_t data_len)
+{
+    msgbus_shared_buf_t *shared_buf;
+
+    shared_buf = MBUS_MALLOC(sizeof(msgbus_shared_buf_t) + data_len);
+    MBUS_ASSERT(shared_buf);
+    if (shared_buf)
+    {
+        shared_buf->refcnt = 1;
+        shared_buf->msg.len = data_len;
+    }
+
+    return shared_buf;
+}
+
+static void msgbus_shared_buf_put(msgbus_shared_buf_t *shared_buf)
+{
+    if (MBUS_ATOMIC_SUB(&shared_buf->refcnt, 1) == 0)
+    {
+        MBUS_FREE(shared_buf);
+    }
+}
+
+static msgbus_shared_buf_t *msgbus_shared_buf_get(msgbus_msg_t *bus_msg, msgbus_shared_buf_t *shared_buf)
+{
+    if (shared_buf == NULL)
+    { // 非借用消息，整条消息只拷贝一次
+        shared_buf = msgbus_shared_buf_alloc(bus_msg->len);
+        if (shared_buf)
+        {
+            memcpy(&shared_buf->msg, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
+        }
+    }
+    else
+    {
+        MBUS_ATOMIC_ADD(&shared_buf->refcnt, 1);
+    }
+
+    return shared_buf;
+}
+
+static void msgbus_conflate_slot_put(conflate_slot_t *slot)
+{
+    if (MBUS_ATOMIC_SUB(&slot->refcnt, 1) == 0)
+    {
+        if (slot->latest)
+        {
+            MBUS_FREE(slot->latest);
+        }
+        MBUS_FREE(slot);
+    }
+}
+
+/* 通道中的合并通知不会再被读取，丢弃槽位中的消息并释放通知的引用，之后发布的消息重新投递通知 */
+static void msgbus_conflate_cancel(conflate_slot_t *slot)
+{
+    msgbus_msg_t *latest = MBUS_ATOMIC_XCHG(&slot->latest, NULL);
+
+    if (latest)
+    {
+        MBUS_FREE(latest);
+    }
+    msgbus_conflate_slot_put(slot);
+}
+
+/* 查找通道的背压状态，链表只在头部插入且不删除节点，任意线程可以无锁遍历 */
+static sub_channel_t *msgbus_sub_channel_find(msgbus_context_t *ctx, msgbus_channel_t channel)
+{
+    sub_channel_t *sub_chan;
+
+    for (sub_chan = MBUS_ATOMIC_LOAD_ACQUIRE(&ctx->sub_chan_list); sub_chan; sub_chan = sub_chan->next)
+    {
+        if (sub_chan->channel == channel)
+        {
+            return sub_chan;
+        }
+    }
+    return NULL;
+}
+
+/* 丢弃溢出环中最旧的消息，共享消息描述符和合并通知同时释放引用，调用者持有锁 */
+static void msgbus_backlog_drop_oldest(msgbus_context_t *ctx, sub_channel_t *sub_chan)
+{
+    backlog_msg_t *backlog_msg = sub_chan->ring[sub_chan->ring_head];
+
+    if (MSG_TOPIC_IS_SHARED(backlog_msg->msg.topic))
+    {
+        msgbus_shared_buf_put(container_of(((topic_shared_desc_t *)backlog_msg->msg.msg_data)->shared_msg,
+                                           msgbus_shared_buf_t, msg));
+    }
+    else if (MSG_TOPIC_IS_CONFLATED(backlog_msg->msg.topic))
+    {
+        msgbus_conflate_cancel(((topic_conflate_desc_t *)backlog_msg->msg.msg_data)->slot);
+    }
+    MBUS_FREE(backlog_msg);
+    sub_chan->ring_head = (sub_chan->ring_head + 1) % sub_chan->ring_size;
+    MBUS_ATOMIC_SUB(&sub_chan->backlog, 1);
+    MBUS_ATOMIC_SUB(&ctx->backlog_total, 1);
+    MBUS_STAT_ADD(&sub_chan->stats.drop_oldest_cnt, 1);
+}
+
+/* 按顺序补写溢出环中的消息，直到通道再次写满，调用者持有锁 */
+static void msgbus_backlog_flush(msgbus_context_t *ctx, sub_channel_t *sub_chan)
+{
+    backlog_msg_t *backlog_msg;
+
+    while (sub_chan->backlog)
+    {
+        backlog_msg = sub_chan->ring[sub_chan->ring_head];
+        if (ctx->channel_write_handler(sub_chan->channel, &backlog_msg->msg, SIZEOF_MSGBUS_MSG(&backlog_msg->msg),
+                                       backlog_msg->prio) != 0)
+        {
+            break;
+        }
+        MBUS_FREE(backlog_msg);
+        sub_chan->ring_head = (sub_chan->ring_head + 1) % sub_chan->ring_size;
+        MBUS_ATOMIC_SUB(&sub_chan->backlog, 1);
+        MBUS_ATOMIC_SUB(&ctx->backlog_total, 1);
+    }
+}
+
+/* 消息追加到溢出环，环满时丢弃最旧的消息，调用者持有锁 */
+static int32_t msgbus_backlog_push(msgbus_context_t *ctx, sub_channel_t *sub_chan, const msgbus_msg_t *msg, int prio)
+{
+    backlog_msg_t *backlog_msg;
+
+    backlog_msg = MBUS_MALLOC(sizeof(backlog_msg_t) + msg->len);
+    MBUS_ASSERT(backlog_msg);
+    if (backlog_msg == NULL)
+    {
+        return -1;
+    }
+    backlog_msg->prio = prio;
+    memcpy(&backlog_msg->msg, msg, SIZEOF_MSGBUS_MSG(msg));
+    if (sub_chan->backlog == sub_chan->ring_size)
+    {
+        msgbus_backlog_drop_oldest(ctx, sub_chan);
+    }
+    sub_chan->ring[(sub_chan->ring_head + sub_chan->backlog) % sub_chan->ring_size] = backlog_msg;
+    MBUS_ATOMIC_ADD(&sub_chan->backlog, 1);
+    MBUS_ATOMIC_ADD(&ctx->backlog_total, 1);
+    MBUS_STAT_ADD(&sub_chan->stats.queue_cnt, 1);
+
+    return 0;
+}
+
+/* 补写所有通道溢出环中积压的消息，由派发线程在处理消息前调用 */
+static void msgbus_backlog_flush_all(msgbus_context_t *ctx)
+{
+    sub_channel_t *sub_chan;
+
+    for (sub_chan = MBUS_ATOMIC_LOAD_ACQUIRE(&ctx->sub_chan_list); sub_chan; sub_chan = sub_chan->next)
+    {
+        if (MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->backlog))
+        {
+            MBUS_LOCK(&sub_chan->lock);
+            msgbus_backlog_flush(ctx, sub_chan);
+            MBUS_UNLOCK(&sub_chan->lock);
+        }
+    }
+}
+
+/*
+ * 按订阅通道的背压策略写入消息，=0：已写入通道或已由溢出环接管，其他：消息被丢弃。
+ * 没有积压时先直接写入，只有写入失败才按策略处理，未设置策略的通道与直接写入相同。
+ */
+static int32_t msgbus_channel_write(msgbus_context_t *ctx, sub_channel_t *sub_chan, msgbus_channel_t channel,
+                                    const msgbus_msg_t *msg, int prio)
+{
+    int32_t err = -1;
+    uint64_t deadline;
+
+    if (sub_chan == NULL || MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->backlog) == 0)
+    {
+        err = ctx->channel_write_handler(channel, msg, SIZEOF_MSGBUS_MSG(msg), prio);
+        if (err == 0 || sub_chan == NULL)
+        {
+            return err;
+        }
+    }
+    switch (MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->policy))
+    {
+    case MSGBUS_BP_DROP_OLDEST:
+        // 溢出环中有积压时新消息排在积压之后，保持投递顺序
+        MBUS_LOCK(&sub_chan->lock);
+        msgbus_backlog_flush(ctx, sub_chan);
+        if (sub_chan->backlog == 0)
+        {
+            err = ctx->channel_write_handler(channel, msg, SIZEOF_MSGBUS_MSG(msg), prio);
+        }
+        if (err != 0 && sub_chan->ring_size)
+        {
+            err = msgbus_backlog_push(ctx, sub_chan, msg, prio);
+        }
+        MBUS_UNLOCK(&sub_chan->lock);
+        break;
+
+    case MSGBUS_BP_BLOCK:
+        MBUS_STAT_ADD(&sub_chan->stats.block_cnt, 1);
+        deadline = MBUS_TIME_US() + (uint64_t)MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->timeout_ms) * 1000u;
+        do
+        {
+            MBUS_YIELD();
+            err = ctx->channel_write_handler(channel, msg, SIZEOF_MSGBUS_MSG(msg), prio);
+        } while (err != 0 && MBUS_TIME_US() < deadline);
+        break;
+
+    case MSGBUS_BP_SPILL:
+        err = ctx->channel_write_handler(MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->spill_channel), msg,
+                                         SIZEOF_MSGBUS_MSG(msg), prio);
+        if (err == 0)
+        {
+            MBUS_STAT_ADD(&sub_chan->stats.spill_cnt, 1);
+        }
+        break;
+
+    default:
+        break;
+    }
+    if (err != 0)
+    {
+        MBUS_STAT_ADD(&sub_chan->stats.drop_newest_cnt, 1);
+    }
+
+    return err;
+}
+
+/*
+ * 合并投递：消息拷贝到订阅节点的最新值槽位，覆盖尚未读取的旧消息，通道中的消息数量和内存与发布速率无关。
+ * 只有槽位由空变为非空时才向通道写入合并通知，通知写入失败时收回槽位中的消息。
+ */
+static int32_t msgbus_conflate_write(msgbus_context_t *ctx, conflate_slot_t *slot, sub_channel_t *sub_chan,
+                                     msgbus_channel_t channel, const msgbus_msg_t *bus_msg, int prio,
+                                     sub_counter_t *sub_counter)
+{
+    int32_t err;
+    msgbus_msg_t *latest;
+    char buff[sizeof(msgbus_msg_t) + sizeof(topic_conflate_desc_t)];
+    msgbus_msg_t *desc_msg = (msgbus_msg_t *)buff;
+    topic_conflate_desc_t *conflate_desc = (topic_conflate_desc_t *)desc_msg->msg_data;
+
+    latest = MBUS_MALLOC(SIZEOF_MSGBUS_MSG(bus_msg));
+    MBUS_ASSERT(latest);
+    if (latest == NULL)
+    {
+        return -1;
+    }
+    memcpy(latest, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
+    latest = MBUS_ATOMIC_XCHG(&slot->latest, latest);
+    if (latest)
+    { // 通道中已有未读取的通知，原地覆盖旧消息
+        MBUS_FREE(latest);
+        MBUS_STAT_ADD(&sub_counter->conflate_cnt, 1);
+        return 0;
+    }
+    desc_msg->topic = MSG_TOPIC_SET_CONFLATED(bus_msg->topic);
+    desc_msg->len = sizeof(topic_conflate_desc_t);
+    desc_msg->user_id = bus_msg->user_id;
+    conflate_desc->slot = slot;
+    MBUS_ATOMIC_ADD(&slot->refcnt, 1);
+    err = msgbus_channel_write(ctx, sub_chan, channel, desc_msg, prio);
+    if (err != 0)
+    {
+        msgbus_conflate_cancel(slot);
+    }
+
+    return err;
+}
+
+static int32_t msgbus_write_shared_desc(msgbus_context_t *ctx, msgbus_shared_buf_t *shared_buf, msgbus_channel_t channel,
+                                        sub_channel_t *sub_chan, msgbus_user_t user_id, int prio,
+                                        topic_counter_t *topic_counter, sub_counter_t *sub_counter)
+{
+    int32_t err;
+    char buff[sizeof(msgbus_msg_t) + sizeof(topic_shared_desc_t)];
+    msgbus_msg_t *desc_msg = (msgbus_msg_t *)buff;
+    topic_shared_desc_t *shared_desc = (topic_shared_desc_t *)desc_msg->msg_data;
+
+    // 描述符投递后，共享消息对订阅者只读，此后不能再修改
+    desc_msg->topic = MSG_TOPIC_SET_SHARED(shared_buf->msg.topic);
+    desc_msg->len = sizeof(topic_shared_desc_t);
+    desc_msg->user_id = user_id;
+    shared_desc->shared_msg = &shared_buf->msg;
+    MBUS_ATOMIC_ADD(&shared_buf->refcnt, 1);
+    err = msgbus_channel_write(ctx, sub_chan, channel, desc_msg, prio);
+    MBUS_TRACE(err ? MSGBUS_TRACE_DELIVER_FAIL : MSGBUS_TRACE_DELIVER, desc_msg->topic, user_id, shared_buf->msg.len);
+    msgbus_stat_deliver(ctx, topic_counter, sub_counter, err, shared_buf->msg.len);
+    if (err != 0)
+    {
+        msgbus_shared_buf_put(shared_buf);
+        MBUS_LOG_W("[MBUS] Publish shared channel:%p,Topic:%" PRIu32 " failed\n",
+                    channel, shared_buf->msg.topic);
+    }
+
+    return err;
+}
+
+/* 记录一次投递或转发的结果，保留第一次失败的结果，之后的成功和失败都不覆盖 */
+static inline void msgbus_dispatch_result(msgbus_dispatch_t *dispatch, int32_t err)
+{
+    if (err != 0)
+    {
+        if (!dispatch->fail_num++)
+        {
+            dispatch->err = err;
+        }
+    }
+    else if (!dispatch->fail_num)
+    {
+        dispatch->err = 0;
+    }
+}
+
+/* 投递给节点的非共享订阅用户，共享订阅用户只计数，最后统一投递描述符 */
+static void msgbus_deliver_node(msgbus_dispatch_t *dispatch, topic_node_t *topic_node)
+{
+    msgbus_context_t *ctx = dispatch->ctx;
+    msgbus_msg_t *bus_msg = dispatch->bus_msg;
+    sub_user_node_t *sub_user;
+    int32_t err;
+
+    dispatch->match_num++;
+    bitmap_or(&dispatch->sub_bus_map, &topic_node->sub_bus_map);
+    list_for_each_entry(sub_user, &topic_node->sub_user_list, node)
+    {
+        // 遍历订阅用户列表，依次发送消息
+        if (sub_user->user_shared_sub)
+        { // 共享订阅用户在最后统一投递描述符
+            dispatch->shared_sub_cnt++;
+            continue;
+        }
+        bus_msg->user_id = sub_user->user_id;
+        bus_msg->topic = dispatch->user_topic;
+        if (sub_user->sub_cb)
+        { // 回调订阅在派发线程中直接调用，不经过通道
+            sub_user->sub_cb(bus_msg, sub_user->cb_ctx);
+            err = 0;
+        }
+        else if (sub_user->conflate_slot)
+        {
+            err = msgbus_conflate_write(ctx, sub_user->conflate_slot, sub_user->sub_chan, sub_user->channel, bus_msg,
+                                        dispatch->prio, &sub_user->counter);
+        }
+        else
+        {
+            err = msgbus_channel_write(ctx, sub_user->sub_chan, sub_user->channel, bus_msg, dispatch->prio);
+        }
+        MBUS_TRACE(err ? MSGBUS_TRACE_DELIVER_FAIL : MSGBUS_TRACE_DELIVER, dispatch->user_topic, sub_user->user_id, bus_msg->len);
+        msgbus_stat_deliver(ctx, &topic_node->counter, &sub_user->counter, err, bus_msg->len);
+        dispatch->fanout++;
+        msgbus_dispatch_result(dispatch, err);
+        // MBUS_ASSERT(err == 0);
+        if (err != 0)
+        {
+            MBUS_LOG_W("[MBUS] Publish channel:%p,Topic:%" PRIu32 " failed\n",
+                        sub_user->channel, bus_msg->topic);
+        }
+    }
+}
+
+/* 命中的范围节点只统计派发次数，没有接收者的丢弃计入精确主题 */
+static void msgbus_deliver_range(msgbus_dispatch_t *dispatch, topic_node_t *range_node)
+{
+    MBUS_STAT_ADD(&range_node->counter.publish_cnt, 1);
+    MBUS_STAT_ADD(&range_node->counter.publish_bytes, dispatch->bus_msg->len);
+    msgbus_deliver_node(dispatch, range_node);
+}
+
+static void msgbus_deliver_node_shared(msgbus_dispatch_t *dispatch, topic_node_t *topic_node)
+{
+    sub_user_node_t *sub_user;
+
+    list_for_each_entry(sub_user, &topic_node->sub_user_list, node)
+    {
+        if (sub_user->user_shared_sub)
+        {
+            msgbus_dispatch_result(dispatch, msgbus_write_shared_desc(dispatch->ctx, dispatch->shared_buf,
+                                                                      sub_user->channel, sub_user->sub_chan,
+                                                                      sub_user->user_id, dispatch->prio,
+                                                                      &topic_node->counter, &sub_user->counter));
+        }
+    }
+}
+
+static int32_t msgbus_proc_event_publish(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, msgbus_shared_buf_t *shared_buf)
+{
+    msgbus_dispatch_t dispatch = {0};
+    topic_node_t *topic_node;
+    uint32_t user_topic;
+    uint32_t sender_bus_id = bus_msg->user_id;
+    bitmap_t *sub_bus_map;
+    bitmap_t mcast_map;
+    bitmap_t fail_map;
+    int multicast;
+    int local;
+    int32_t err;
+
+    user_topic = GET_USER_TOPIC(bus_msg->topic);
+    // 投递给本地用户时主题被改写为用户主题，先取出只在本地派发的属性
+    local = MSG_TOPIC_IS_LOCAL(bus_msg->topic);
+    MBUS_TRACE(MSGBUS_TRACE_DISPATCH, bus_msg->topic, bus_msg->user_id, bus_msg->len);
+    MBUS_STAT_ADD(&ctx->counter.dispatch_cnt, 1);
+    if (sender_bus_id != LOCAL_BUS_ID && sender_bus_id && sender_bus_id <= MSGBUS_EXT_BUS_MAX)
+    {
+        MBUS_STAT_ADD(&ctx->ext_bus_stats[sender_bus_id - 1].recv_cnt, 1);
+    }
+    MBUS_LOG_D("[MBUS] proc event pub, topic: %" PRIu32 " bus id:%" PRIu32 "\r\n",
+                bus_msg->topic, bus_msg->user_id);
+    dispatch.ctx = ctx;
+    dispatch.bus_msg = bus_msg;
+    dispatch.user_topic = user_topic;
+    dispatch.err = -1;
+    dispatch.prio = MSG_TOPIC_GET_PRIO(bus_msg->topic);
+    // 分发给本地订阅该主题的用户，以及订阅了包含该主题的范围的用户
+    topic_node = msgbus_topic_find(ctx, user_topic);
+    if (topic_node)
+    {
+        msgbus_deliver_node(&dispatch, topic_node);
+    }
+    msgbus_range_visit(ctx->range_tree.rb_node, user_topic, msgbus_deliver_range, &dispatch);
+    if (!dispatch.match_num && !ctx->selfness_flag)
+    { // 不存在的主题，发布错误
+        MBUS_TRACE(MSGBUS_TRACE_NO_TOPIC, bus_msg->topic, bus_msg->user_id, bus_msg->len);
+        MBUS_STAT_ADD(&ctx->counter.no_topic_cnt, 1);
+        MBUS_LOG_W("[MBUS] publish error unsubscribe topic, topic: %" PRIu32 "\r\n",
+                    bus_msg->topic);
+        return -1;
+    }
+    // 分发给外部总线
+    if (!local && !bitmap_is_empty(&ctx->ext_bus_map))
+    {
+        sub_bus_map = ctx->selfness_flag ? &ctx->ext_bus_map : &dispatch.sub_bus_map;
+        // 投递给本地用户时主题已改写为用户主题，恢复优先级，外部总线按原优先级转发和派发
+        bus_msg->topic = MSG_TOPIC_SET_PRIO(user_topic, dispatch.prio);
+        multicast = msgbus_ext_multicast(ctx, bus_msg, sub_bus_map, sender_bus_id, dispatch.prio, &mcast_map, &fail_map);
+        for (uint32_t sub_bus_id = bitmap_next(sub_bus_map, 0); sub_bus_id;
+             sub_bus_id = bitmap_next(sub_bus_map, sub_bus_id))
+        {
+            if (sub_bus_id != sender_bus_id)
+            { // 转发时，排除原始发送者；组播帧已覆盖的总线只统计
+                if (multicast && bitmap_is_set(&mcast_map, sub_bus_id))
+                {
+                    err = bitmap_is_set(&fail_map, sub_bus_id) ? -1 : 0;
+                }
+                else
+                {
+                    err = msgbus_ext_forward(ctx, bus_msg, sub_bus_id, dispatch.prio);
+                }
+                MBUS_TRACE(err ? MSGBUS_TRACE_FORWARD_FAIL : MSGBUS_TRACE_FORWARD, bus_msg->topic, sub_bus_id, bus_msg->len);
+                msgbus_stat_forward(ctx, topic_node ? &topic_node->counter : NULL, sub_bus_id, err, bus_msg->len);
+                dispatch.fanout++;
+                msgbus_dispatch_result(&dispatch, err);
+                if (err != 0)
+                {
+                    MBUS_LOG_W("[MBUS] Publish Ext bus id:%" PRIu32 " channel:%p,Topic:%" PRIu32 " failed\n",
+                                sub_bus_id, ctx->ext_bus_channel, bus_msg->topic);
+                }
+            }
+        }
+    }
+    // 分发给共享订阅用户，数据只保存一份，各用户只收到描述符
+    if (dispatch.shared_sub_cnt)
+    {
+        bus_msg->topic = user_topic;
+        bus_msg->user_id = sender_bus_id;
+        dispatch.shared_buf = msgbus_shared_buf_get(bus_msg, shared_buf);
+        if (dispatch.shared_buf == NULL)
+        {
+            return -1;
+        }
+        if (topic_node)
+        {
+            msgbus_deliver_node_shared(&dispatch, topic_node);
+        }
+        msgbus_range_visit(ctx->range_tree.rb_node, user_topic, msgbus_deliver_node_shared, &dispatch);
+        msgbus_shared_buf_put(dispatch.shared_buf);
+        dispatch.fanout += dispatch.shared_sub_cnt;
+    }
+    msgbus_stat_publish(topic_node ? &topic_node->counter : NULL, bus_msg->len, dispatch.fanout);
+
+    return dispatch.err;
+}
+
+static topic_snapshot_t *msgbus_snapshot_enter(msgbus_context_t *ctx, uint32_t *epoch)
+{
+    uint32_t cur_epoch;
+
+    // 在当前纪元登记为读者，登记期间纪元已切换则重试，保证读到的快照不会被回收
+    while (1)
+    {
+        cur_epoch = MBUS_ATOMIC_LOAD(&ctx->snapshot_epoch);
+        MBUS_ATOMIC_ADD(&ctx->snapshot_readers[cur_epoch], 1);
+        if (MBUS_ATOMIC_LOAD(&ctx->snapshot_epoch) == cur_epoch)
+        {
+            break;
+        }
+        MBUS_ATOMIC_SUB(&ctx->snapshot_readers[cur_epoch], 1);
+    }
+    *epoch = cur_epoch;
+
+    return MBUS_ATOMIC_LOAD(&ctx->snapshot);
+}
+
+static void msgbus_snapshot_exit(msgbus_context_t *ctx, uint32_t epoch)
+{
+    MBUS_ATOMIC_SUB(&ctx->snapshot_readers[epoch], 1);
+}
+
+static snapshot_topic_t *msgbus_snapshot_search(topic_snapshot_t *snapshot, uint32_t topic)
+{
+    uint32_t low = 0, high = snapshot->topic_num;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (snapshot->topic_list[mid].topic_key < topic)
+            low = mid + 1;
+        else if (snapshot->topic_list[mid].topic_key > topic)
+            high = mid;
+        else
+            return &snapshot->topic_list[mid];
+    }
+    return NULL;
+}
+
+/* 复制节点及其订阅用户到快照，返回下一个订阅用户的位置 */
+static snapshot_sub_t *msgbus_snapshot_fill(snapshot_topic_t *snap_topic, topic_node_t *topic_node, snapshot_sub_t *snap_sub)
+{
+    sub_user_node_t *sub_user;
+
+    snap_topic->topic_key = topic_node->topic_key;
+    snap_topic->topic_hi = topic_node->topic_hi;
+    snap_topic->sub_num = 0;
+    snap_topic->sub_list = snap_sub;
+    snap_topic->counter = &topic_node->counter;
+    bitmap_copy(&snap_topic->sub_bus_map, &topic_node->sub_bus_map);
+    list_for_each_entry(sub_user, &topic_node->sub_user_list, node)
+    {
+        snap_sub->user_id = sub_user->user_id;
+        snap_sub->channel = sub_user->channel;
+        snap_sub->user_shared_sub = sub_user->user_shared_sub;
+        snap_sub->sub_cb = sub_user->sub_cb;
+        snap_sub->cb_ctx = sub_user->cb_ctx;
+        snap_sub->sub_chan = sub_user->sub_chan;
+        snap_sub->conflate_slot = sub_user->conflate_slot;
+        snap_sub->counter = &sub_user->counter;
+        snap_sub++;
+        snap_topic->sub_num++;
+    }
+
+    return snap_sub;
+}
+
+/* 计算隐式区间树[low, high)中各中点的子树最大上限，返回整个区间的最大上限 */
+static uint32_t msgbus_snapshot_range_build(snapshot_topic_t *range_list, uint32_t low, uint32_t high)
+{
+    uint32_t mid, subtree_hi, child_hi;
+
+    if (low >= high)
+    {
+        return 0;
+    }
+    mid = low + (high - low) / 2;
+    subtree_hi = range_list[mid].topic_hi;
+    child_hi = msgbus_snapshot_range_build(range_list, low, mid);
+    if (child_hi > subtree_hi)
+    {
+        subtree_hi = child_hi;
+    }
+    child_hi = msgbus_snapshot_range_build(range_list, mid + 1, high);
+    if (child_hi > subtree_hi)
+    {
+        subtree_hi = child_hi;
+    }
+    range_list[mid].subtree_hi = subtree_hi;
+
+    return subtree_hi;
+}
+
+/* 由系统线程在主题表变化后调用，生成新快照并替换，等待旧纪元的读者全部退出后回收旧快照 */
+static void msgbus_snapshot_update(msgbus_context_t *ctx)
+{
+    topic_snapshot_t *snapshot, *old_snapshot;
+    snapshot_sub_t *snap_sub;
+    struct rb_node *tree_node;
+    struct list_head *pos;
+    uint32_t topic_num = 0, range_num = 0, sub_num = 0, old_epoch;
+
+    if (!ctx->direct_flag || !ctx->sync_over_flag)
+    {
+        return;
+    }
+    for (tree_node = rb_first(&ctx->topic_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        topic_node_t *topic_node = container_of(tree_node, topic_node_t, node);
+
+        topic_num++;
+        list_for_each(pos, &topic_node->sub_user_list)
+        {
+            sub_num++;
+        }
+    }
+    for (tree_node = rb_first(&ctx->range_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        topic_node_t *range_node = container_of(tree_node, topic_node_t, node);
+
+        range_num++;
+        list_for_each(pos, &range_node->sub_user_list)
+        {
+            sub_num++;
+        }
+    }
+    snapshot = MBUS_MALLOC(sizeof(topic_snapshot_t) + sizeof(snapshot_topic_t) * (topic_num + range_num) +
+                           sizeof(snapshot_sub_t) * sub_num);
+    MBUS_ASSERT(snapshot);
+    if (snapshot == NULL)
+    {
+        return;
+    }
+    snapshot->topic_num = topic_num;
+    snapshot->range_num = range_num;
+    snapshot->range_list = &snapshot->topic_list[topic_num];
+    snap_sub = (snapshot_sub_t *)&snapshot->range_list[range_num];
+    topic_num = 0;
+    for (tree_node = rb_first(&ctx->topic_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        snap_sub = msgbus_snapshot_fill(&snapshot->topic_list[topic_num++],
+                                        container_of(tree_node, topic_node_t, node), snap_sub);
+    }
+    range_num = 0;
+    for (tree_node = rb_first(&ctx->range_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        snap_sub = msgbus_snapshot_fill(&snapshot->range_list[range_num++],
+                                        container_of(tree_node, topic_node_t, node), snap_sub);
+    }
+    msgbus_snapshot_range_build(snapshot->range_list, 0, range_num);
+
+    old_snapshot = MBUS_ATOMIC_XCHG(&ctx->snapshot, snapshot);
+    old_epoch = MBUS_ATOMIC_LOAD(&ctx->snapshot_epoch);
+    MBUS_ATOMIC_STORE(&ctx->snapshot_epoch, !old_epoch);
+    // 读者只在一次发布期间登记，纪元切换后新读者进入新纪元，等待时间不超过一次发布写入订阅通道的时间
+    while (MBUS_ATOMIC_LOAD(&ctx->snapshot_readers[old_epoch]))
+    {
+        MBUS_YIELD();
+    }
+    if (old_snapshot)
+    {
+        MBUS_FREE(old_snapshot);
+    }
+}
+
+typedef void (*snapshot_deliver_t)(msgbus_dispatch_t *dispatch, snapshot_topic_t *snap_topic);
+
+/* 在隐式区间树[low, high)中查找包含topic的范围，与msgbus_range_visit()相同 */
+static void msgbus_snapshot_range_visit(snapshot_topic_t *range_list, uint32_t low, uint32_t high, uint32_t topic,
+                                        snapshot_deliver_t deliver, msgbus_dispatch_t *dispatch)
+{
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        snapshot_topic_t *snap_range = &range_list[mid];
+
+        if (snap_range->subtree_hi < topic)
+        {
+            return;
+        }
+        msgbus_snapshot_range_visit(range_list, low, mid, topic, deliver, dispatch);
+        if (snap_range->topic_key > topic)
+        {
+            return;
+        }
+        if (snap_range->topic_hi >= topic)
+        {
+            deliver(dispatch, snap_range);
+        }
+        low = mid + 1;
+    }
+}
+
+static void msgbus_snapshot_deliver(msgbus_dispatch_t *dispatch, snapshot_topic_t *snap_topic)
+{
+    msgbus_context_t *ctx = dispatch->ctx;
+    msgbus_msg_t *bus_msg = dispatch->bus_msg;
+    int32_t err;
+
+    dispatch->match_num++;
+    bitmap_or(&dispatch->sub_bus_map, &snap_topic->sub_bus_map);
+    for (uint32_t i = 0; i < snap_topic->sub_num; i++)
+    {
+        snapshot_sub_t *snap_sub = &snap_topic->sub_list[i];
+
+        if (snap_sub->user_shared_sub)
+        {
+            dispatch->shared_sub_cnt++;
+            continue;
+        }
+        bus_msg->user_id = snap_sub->user_id;
+        bus_msg->topic = dispatch->user_topic;
+        if (snap_sub->sub_cb)
+        { // 直接派发时回调在发布线程中调用
+            snap_sub->sub_cb(bus_msg, snap_sub->cb_ctx);
+            err = 0;
+        }
+        else if (snap_sub->conflate_slot)
+        {
+            err = msgbus_conflate_write(ctx, snap_sub->conflate_slot, snap_sub->sub_chan, snap_sub->channel, bus_msg,
+                                        dispatch->prio, snap_sub->counter);
+        }
+        else
+        {
+            err = msgbus_channel_write(ctx, snap_sub->sub_chan, snap_sub->channel, bus_msg, dispatch->prio);
+        }
+        MBUS_TRACE(err ? MSGBUS_TRACE_DELIVER_FAIL : MSGBUS_TRACE_DELIVER, dispatch->user_topic, snap_sub->user_id, bus_msg->len);
+        msgbus_stat_deliver(ctx, snap_topic->counter, snap_sub->counter, err, bus_msg->len);
+        dispatch->fanout++;
+        msgbus_dispatch_result(dispatch, err);
+        if (err != 0)
+        {
+            MBUS_LOG_W("[MBUS] Publish channel:%p,Topic:%" PRIu32 " failed\n",
+                        snap_sub->channel, bus_msg->topic);
+        }
+    }
+}
+
+static void msgbus_snapshot_deliver_range(msgbus_dispatch_t *dispatch, snapshot_topic_t *snap_range)
+{
+    MBUS_STAT_ADD(&snap_range->counter->publish_cnt, 1);
+    MBUS_STAT_ADD(&snap_range->counter->publish_bytes, dispatch->bus_msg->len);
+    msgbus_snapshot_deliver(dispatch, snap_range);
+}
+
+static void msgbus_snapshot_deliver_shared(msgbus_dispatch_t *dispatch, snapshot_topic_t *snap_topic)
+{
+    for (uint32_t i = 0; i < snap_topic->sub_num; i++)
+    {
+        if (snap_topic->sub_list[i].user_shared_sub)
+        {
+            msgbus_dispatch_result(dispatch, msgbus_write_shared_desc(dispatch->ctx, dispatch->shared_buf,
+                                                                      snap_topic->sub_list[i].channel,
+                                                                      snap_topic->sub_list[i].sub_chan,
+                                                                      snap_topic->sub_list[i].user_id, dispatch->prio,
+                                                                      snap_topic->counter,
+                                                                      snap_topic->sub_list[i].counter));
+        }
+    }
+}
+
+/* 直接派发，在发布线程中按快照分发给订阅用户和外部总线 */
+static int32_t msgbus_snapshot_publish(msgbus_context_t *ctx, topic_snapshot_t *snapshot, msgbus_msg_t *bus_msg,
+                                       msgbus_shared_buf_t *shared_buf)
+{
+    msgbus_dispatch_t dispatch = {0};
+    snapshot_topic_t *snap_topic;
+    uint32_t user_topic = GET_USER_TOPIC(bus_msg->topic);
+    int local = MSG_TOPIC_IS_LOCAL(bus_msg->topic); // 投递时主题被改写，先取出只在本地派发的属性
+    const bitmap_t *sub_bus_map;
+    bitmap_t mcast_map;
+    bitmap_t fail_map;
+    int multicast;
+    int32_t err;
+
+    MBUS_STAT_ADD(&ctx->counter.dispatch_cnt, 1);
+
+    dispatch.ctx = ctx;
+    dispatch.bus_msg = bus_msg;
+    dispatch.user_topic = user_topic;
+    dispatch.err = -1;
+    dispatch.prio = MSG_TOPIC_GET_PRIO(bus_msg->topic);
+    snap_topic = msgbus_snapshot_search(snapshot, user_topic);
+    if (snap_topic)
+    {
+        msgbus_snapshot_deliver(&dispatch, snap_topic);
+    }
+    msgbus_snapshot_range_visit(snapshot->range_list, 0, snapshot->range_num, user_topic,
+                                msgbus_snapshot_deliver_range, &dispatch);
+    if (!dispatch.match_num && !ctx->selfness_flag)
+    { // 不存在的主题，发布错误
+        MBUS_TRACE(MSGBUS_TRACE_NO_TOPIC, bus_msg->topic, bus_msg->user_id, bus_msg->len);
+        MBUS_STAT_ADD(&ctx->counter.no_topic_cnt, 1);
+        MBUS_LOG_W("[MBUS] publish error unsubscribe topic, topic: %" PRIu32 "\r\n",
+                    bus_msg->topic);
+        return -1;
+    }
+    // 分发给外部总线，直接发布的消息来自本地总线，不需要排除发送者
+    if (!local && !bitmap_is_empty(&ctx->ext_bus_map))
+    {
+        sub_bus_map = ctx->selfness_flag ? &ctx->ext_bus_map : &dispatch.sub_bus_map;
+        bus_msg->topic = MSG_TOPIC_SET_PRIO(user_topic, dispatch.prio);
+        multicast = msgbus_ext_multicast(ctx, bus_msg, sub_bus_map, 0, dispatch.prio, &mcast_map, &fail_map);
+        for (uint32_t sub_bus_id = bitmap_next(sub_bus_map, 0); sub_bus_id;
+             sub_bus_id = bitmap_next(sub_bus_map, sub_bus_id))
+        {
+            if (multicast && bitmap_is_set(&mcast_map, sub_bus_id))
+            {
+                err = bitmap_is_set(&fail_map, sub_bus_id) ? -1 : 0;
+            }
+            else
+            {
+                err = msgbus_ext_forward(ctx, bus_msg, sub_bus_id, dispatch.prio);
+            }
+            MBUS_TRACE(err ? MSGBUS_TRACE_FORWARD_FAIL : MSGBUS_TRACE_FORWARD, bus_msg->topic, sub_bus_id, bus_msg->len);
+            msgbus_stat_forward(ctx, snap_topic ? snap_topic->counter : NULL, sub_bus_id, err, bus_msg->len);
+            dispatch.fanout++;
+            msgbus_dispatch_result(&dispatch, err);
+            if (err != 0)
+            {
+                MBUS_LOG_W("[MBUS] Publish Ext bus id:%" PRIu32 " channel:%p,Topic:%" PRIu32 " failed\n",
+                            sub_bus_id, ctx->ext_bus_channel, bus_msg->topic);
+            }
+        }
+    }
+    if (dispatch.shared_sub_cnt)
+    {
+        bus_msg->topic = user_topic;
+        bus_msg->user_id = LOCAL_BUS_ID;
+        dispatch.shared_buf = msgbus_shared_buf_get(bus_msg, shared_buf);
+        if (dispatch.shared_buf == NULL)
+        {
+            return -1;
+        }
+        if (snap_topic)
+        {
+            msgbus_snapshot_deliver_shared(&dispatch, snap_topic);
+        }
+        msgbus_snapshot_range_visit(snapshot->range_list, 0, snapshot->range_num, user_topic,
+                                    msgbus_snapshot_deliver_shared, &dispatch);
+        msgbus_shared_buf_put(dispatch.shared_buf);
+        dispatch.fanout += dispatch.shared_sub_cnt;
+    }
+    msgbus_stat_publish(snap_topic ? snap_topic->counter : NULL, bus_msg->len, dispatch.fanout);
+
+    return dispatch.err;
+}
+
+/* 新建主题节点，next不为NULL时链接到红黑树中该节点之前，否则从根节点查找插入位置 */
+static topic_node_t *msgbus_create_topic_node_before(msgbus_context_t *ctx, uint32_t topic, struct rb_node *next)
+{
+    topic_node_t *topic_node;
+
+    topic_node = MBUS_MALLOC(sizeof(topic_node_t));
+    MBUS_ASSERT(topic_node);
+    if (topic_node == NULL)
+    {
+        return NULL;
+    }
+    memset(topic_node, 0, sizeof(topic_node_t));
+    topic_node->topic_key = topic;
+    topic_node->topic_hi = topic;
+    if (next)
+    {
+        msg_topic_link_before(&ctx->topic_tree, topic_node, next);
+    }
+    else if (msg_topic_insert(&ctx->topic_tree, topic_node) != 0)
+    { // 主题已存在，节点没有链接到红黑树中
+        MBUS_LOG_E("[MBUS] topic node exists, topic: %" PRIu32 "\r\n", topic);
+        MBUS_FREE(topic_node);
+        return NULL;
+    }
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+    if (topic_index_insert(&ctx->topic_index, topic, topic_node) != 0)
+    { // 索引中查不到的主题节点无法派发，撤销本次新建
+        MBUS_LOG_E("[MBUS] topic index insert failed, topic: %" PRIu32 "\r\n", topic);
+        rb_erase(&topic_node->node, &ctx->topic_tree);
+        MBUS_FREE(topic_node);
+        return NULL;
+    }
+#endif
+    bitmap_set(&topic_node->sub_bus_map, 0);
+    INIT_LIST_HEAD(&topic_node->sub_user_list);
+    MBUS_ATOMIC_ADD_RELAXED(&ctx->topic_total, 1);
+
+    return topic_node;
+}
+
+static topic_node_t *msgbus_create_topic_node(msgbus_context_t *ctx, uint32_t topic)
+{
+    return msgbus_create_topic_node_before(ctx, topic, NULL);
+}
+
+static topic_node_t *msgbus_create_range_node(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi)
+{
+    topic_node_t *range_node;
+
+    range_node = MBUS_MALLOC(sizeof(topic_node_t));
+    MBUS_ASSERT(range_node);
+    if (range_node == NULL)
+    {
+        return NULL;
+    }
+    memset(range_node, 0, sizeof(topic_node_t));
+    range_node->topic_key = topic_lo;
+    range_node->topic_hi = topic_hi;
+    msg_range_insert(&ctx->range_tree, range_node);
+    bitmap_set(&range_node->sub_bus_map, 0);
+    INIT_LIST_HEAD(&range_node->sub_user_list);
+    MBUS_ATOMIC_ADD_RELAXED(&ctx->range_total, 1);
+
+    return range_node;
+}
+
+/* 获取主题或主题范围的节点，不存在时新建，上下限相同的范围按精确主题处理 */
+static topic_node_t *msgbus_topic_node_get(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi)
+{
+    topic_node_t *topic_node;
+
+    if (topic_lo == topic_hi)
+    {
+        topic_node = msgbus_topic_find(ctx, topic_lo);
+        return topic_node ? topic_node : msgbus_create_topic_node(ctx, topic_lo);
+    }
+    topic_node = msg_range_search(&ctx->range_tree, topic_lo, topic_hi);
+    return topic_node ? topic_node : msgbus_create_range_node(ctx, topic_lo, topic_hi);
+}
+
+/* 查找主题或主题范围的节点 */
+static topic_node_t *msgbus_topic_node_find(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi)
+{
+    if (topic_lo == topic_hi)
+    {
+        return msgbus_topic_find(ctx, topic_lo);
+    }
+    return msg_range_search(&ctx->range_tree, topic_lo, topic_hi);
+}
+
+/* 主题是否需要同步给指定外部总线：存在用户的非本地订阅，或者除该总线外还有其他外部总线订阅 */
+static int msgbus_topic_is_exported(topic_node_t *topic_node, uint32_t bus_id)
+{
+    sub_user_node_t *sub_user;
+    uint32_t sub_bus_cnt;
+
+    list_for_each_entry(sub_user, &topic_node->sub_user_list, node)
+    {
+        if (!sub_user->user_local_sub)
+        {
+            return 1;
+        }
+    }
+    // 没有内部用户订阅，检查外部总线订阅
+    sub_bus_cnt = bitmap_cnt(&topic_node->sub_bus_map);
+
+    return sub_bus_cnt &&
+           (!bus_id || sub_bus_cnt > 1 || !bitmap_is_set(&topic_node->sub_bus_map, bus_id));
+}
+
+/* 是否需要记录主题表的变化：已经向外部总线发送过全量同步，之后的变化只能以增量通知 */
+static inline int msgbus_delta_enabled(msgbus_context_t *ctx)
+{
+    return ctx->sync_start_flag && !bitmap_is_empty(&ctx->ext_bus_map_sent);
+}
+
+/* 获取主题当前同步给各外部总线的状态，只关心已经发送过全量同步的总线 */
+static void msgbus_topic_export_map(msgbus_context_t *ctx, topic_node_t *topic_node, bitmap_t *export_map)
+{
+    memset(export_map, 0, sizeof(bitmap_t));
+    for (uint32_t bus_id = bitmap_next(&ctx->ext_bus_map_sent, 0); bus_id;
+         bus_id = bitmap_next(&ctx->ext_bus_map_sent, bus_id))
+    {
+        if (msgbus_topic_is_exported(topic_node, bus_id))
+        {
+            bitmap_set(export_map, bus_id);
+        }
+    }
+}
+
+/* 主题订阅变化后，与变化前的同步状态对比，记录需要新增或撤销该主题的外部总线 */
+static void msgbus_topic_delta_record(msgbus_context_t *ctx, topic_node_t *topic_node, bitmap_t *old_export_map,
+                                      topic_delta_t *delta_list, uint32_t *delta_num)
+{
+    topic_delta_t *delta;
+    bitmap_t export_map;
+
+    if (delta_list == NULL)
+    { // 还没有发送过全量同步，外部总线同步时直接获取当前的主题表
+        return;
+    }
+    delta = &delta_list[*delta_num];
+    msgbus_topic_export_map(ctx, topic_node, &export_map);
+    memset(&delta->add_map, 0, sizeof(bitmap_t));
+    memset(&delta->del_map, 0, sizeof(bitmap_t));
+    for (uint32_t bus_id = bitmap_next(&ctx->ext_bus_map_sent, 0); bus_id;
+         bus_id = bitmap_next(&ctx->ext_bus_map_sent, bus_id))
+    {
+        if (bitmap_is_set(&export_map, bus_id) && !bitmap_is_set(old_export_map, bus_id))
+        {
+            bitmap_set(&delta->add_map, bus_id);
+        }
+        else if (!bitmap_is_set(&export_map, bus_id) && bitmap_is_set(old_export_map, bus_id))
+        {
+            bitmap_set(&delta->del_map, bus_id);
+        }
+    }
+    if (!bitmap_is_empty(&delta->add_map) || !bitmap_is_empty(&delta->del_map))
+    {
+        delta->topic = topic_node->topic_key;
+        delta->topic_hi = topic_node->topic_hi;
+        (*delta_num)++;
+    }
+}
+
+/* 同步数据中范围数量的位置，紧跟在主题列表之后 */
+static inline uint32_t *msgbus_sync_range_num(topic_sync_data_t *topic_sync_data)
+{
+    return (uint32_t *)&topic_sync_data->topic_list[topic_sync_data->topic_num];
+}
+
+/* 同步数据的长度，range_num为范围数量的位置，范围列表紧随其后 */
+static inline uint32_t msgbus_sync_data_len(topic_sync_data_t *topic_sync_data, uint32_t *range_num)
+{
+    return sizeof(topic_sync_data_t) + sizeof(msgbus_topic_t) * topic_sync_data->topic_num +
+           sizeof(uint32_t) + sizeof(msgbus_topic_range_t) * (*range_num);
+}
+
+/* 解析一段完整的同步数据，返回该段的长度，0：数据不完整 */
+static uint32_t msgbus_sync_block_parse(topic_sync_data_t *topic_sync_data, uint32_t len,
+                                        msgbus_topic_range_t **range_list, uint32_t *range_num)
+{
+    uint64_t offset;
+
+    if (len < sizeof(topic_sync_data_t))
+    {
+        return 0;
+    }
+    offset = sizeof(topic_sync_data_t) + sizeof(msgbus_topic_t) * (uint64_t)topic_sync_data->topic_num;
+    if (len < offset + sizeof(uint32_t))
+    {
+        return 0;
+    }
+    *range_num = *msgbus_sync_range_num(topic_sync_data);
+    offset += sizeof(uint32_t) + sizeof(msgbus_topic_range_t) * (uint64_t)(*range_num);
+    if (len < offset)
+    {
+        return 0;
+    }
+    *range_list = (msgbus_topic_range_t *)(msgbus_sync_range_num(topic_sync_data) + 1);
+
+    return (uint32_t)offset;
+}
+
+/* 解析全量同步数据，旧版本的同步数据恰好只有主题列表，没有范围部分；返回0：成功，-1：主题或范围数量超出数据长度 */
+static int msgbus_sync_data_parse(msgbus_msg_t *bus_msg, msgbus_topic_range_t **range_list, uint32_t *range_num)
+{
+    topic_sync_data_t *topic_sync_data = (topic_sync_data_t *)bus_msg->msg_data;
+
+    if (msgbus_sync_block_parse(topic_sync_data, bus_msg->len, range_list, range_num) != 0)
+    {
+        return 0;
+    }
+    if (bus_msg->len >= sizeof(topic_sync_data_t) &&
+        bus_msg->len == sizeof(topic_sync_data_t) + sizeof(msgbus_topic_t) * (uint64_t)topic_sync_data->topic_num)
+    {
+        *range_list = NULL;
+        *range_num = 0;
+        return 0;
+    }
+    return -1;
+}
+
+/* 取出全量同步数据之后的能力标记，旧版本的同步数据没有该字段时返回0 */
+static uint32_t msgbus_sync_data_caps(msgbus_msg_t *bus_msg)
+{
+    msgbus_topic_range_t *range_list;
+    uint32_t range_num, len;
+
+    len = msgbus_sync_block_parse((topic_sync_data_t *)bus_msg->msg_data, bus_msg->len, &range_list, &range_num);
+    if (len == 0 || bus_msg->len < len + sizeof(uint32_t))
+    {
+        return 0;
+    }
+    return *(uint32_t *)&bus_msg->msg_data[len];
+}
+
+/* 将需要通知指定外部总线的新增或撤销写入一段同步数据，返回该段的长度 */
+static uint32_t msgbus_sync_block_fill(topic_sync_data_t *topic_sync_data, const topic_delta_t *delta_list,
+                                       uint32_t delta_num, uint32_t bus_id, int add)
+{
+    msgbus_topic_range_t *range_list;
+    const bitmap_t *bus_map;
+    uint32_t *range_num;
+
+    topic_sync_data->topic_num = 0;
+    for (uint32_t i = 0; i < delta_num; i++)
+    {
+        bus_map = add ? &delta_list[i].add_map : &delta_list[i].del_map;
+        if (bitmap_is_set(bus_map, bus_id) && delta_list[i].topic == delta_list[i].topic_hi)
+        {
+            topic_sync_data->topic_list[topic_sync_data->topic_num++] = delta_list[i].topic;
+        }
+    }
+    range_num = msgbus_sync_range_num(topic_sync_data);
+    range_list = (msgbus_topic_range_t *)(range_num + 1);
+    *range_num = 0;
+    for (uint32_t i = 0; i < delta_num; i++)
+    {
+        bus_map = add ? &delta_list[i].add_map : &delta_list[i].del_map;
+        if (bitmap_is_set(bus_map, bus_id) && delta_list[i].topic != delta_list[i].topic_hi)
+        {
+            range_list[*range_num].topic_lo = delta_list[i].topic;
+            range_list[*range_num].topic_hi = delta_list[i].topic_hi;
+            (*range_num)++;
+        }
+    }
+    return msgbus_sync_data_len(topic_sync_data, range_num);
+}
+
+/* 完整主题表的同步数据的最大长度 */
+static inline uint32_t msgbus_sync_table_size(msgbus_context_t *ctx)
+{
+    return sizeof(topic_sync_data_t) + sizeof(msgbus_topic_t) * ctx->topic_total +
+           sizeof(uint32_t) + sizeof(msgbus_topic_range_t) * ctx->range_total;
+}
+
+/* 将需要同步给指定外部总线的全部主题和主题范围写入一段同步数据，按主题键排序，返回该段的长度 */
+static uint32_t msgbus_sync_table_fill(msgbus_context_t *ctx, topic_sync_data_t *topic_sync_data,
+                                       uint32_t except_bus_id)
+{
+    msgbus_topic_range_t *range_list;
+    uint32_t *range_num;
+    // 遍历红黑树中的主题节点，创建订阅主题列表
+    topic_node_t *topic_node;
+    struct rb_node *tree_node = rb_first(&ctx->topic_tree);
+    uint32_t count = 0;
+    // 缓冲区按msgbus_sync_table_size()申请，写入数量不超过主题和主题范围的总数量
+    while (tree_node && count < ctx->topic_total)
+    {
+        topic_node = container_of(tree_node, topic_node_t, node);
+        // 打包除指定消息总线外的其他主题列表
+        if (msgbus_topic_is_exported(topic_node, except_bus_id))
+        {
+            topic_sync_data->topic_list[count++] = topic_node->topic_key;
+        }
+        /* 取下条主题节点 */
+        tree_node = rb_next(tree_node);
+    }
+    topic_sync_data->topic_num = count;
+    // 主题范围以范围的形式同步，不展开为单个主题
+    range_num = msgbus_sync_range_num(topic_sync_data);
+    range_list = (msgbus_topic_range_t *)(range_num + 1);
+    *range_num = 0;
+    for (tree_node = rb_first(&ctx->range_tree); tree_node && *range_num < ctx->range_total;
+         tree_node = rb_next(tree_node))
+    {
+        topic_node = container_of(tree_node, topic_node_t, node);
+        if (msgbus_topic_is_exported(topic_node, except_bus_id))
+        {
+            range_list[*range_num].topic_lo = topic_node->topic_key;
+            range_list[*range_num].topic_hi = topic_node->topic_hi;
+            (*range_num)++;
+        }
+    }
+    return msgbus_sync_data_len(topic_sync_data, range_num);
+}
+
+static msgbus_msg_t *msgbus_create_topic_sync_data(msgbus_context_t *ctx, uint32_t except_bus_id)
+{
+    msgbus_msg_t *msg_port = NULL;
+    uint32_t len;
+
+    MBUS_LOG_I("[MBUS] msgbus_create_topic_sync_data except bus id:%" PRIu32 "\r\n", except_bus_id);
+
+    msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t) + msgbus_sync_table_size(ctx) + sizeof(uint32_t));
+    MBUS_ASSERT(msg_port);
+    if (msg_port == NULL)
+    {
+        return NULL;
+    }
+    len = msgbus_sync_table_fill(ctx, (topic_sync_data_t *)msg_port->msg_data, except_bus_id);
+    // 主题表之后为能力标记，旧版本的总线忽略
+    *(uint32_t *)&msg_port->msg_data[len] = TOPIC_SYNC_CAP_DELTA | (ctx->compact_flag ? TOPIC_SYNC_CAP_COMPACT : 0);
+    msg_port->len = len + sizeof(uint32_t);
+    msg_port->topic = TOPIC_BUS_EXT_SYNC;
+
+    return msg_port;
+}
+
+/* 向外部总线发送完整的主题表 */
+static void msgbus_ext_bus_table_send(msgbus_context_t *ctx, uint32_t bus_id)
+{
+    msgbus_msg_t *msg_port;
+
+    msg_port = msgbus_create_topic_sync_data(ctx, bus_id);
+    if (msg_port == NULL)
+    {
+        return;
+    }
+    msg_port->user_id = bus_id;
+    msgbus_ext_write(ctx, msg_port, MSGBUS_PRIO_CONTROL);
+    MBUS_FREE(msg_port);
+}
+
+/* 释放日志中代数不大于gen的增量帧，这些帧对端已经应用 */
+static void msgbus_delta_log_clear(ext_peer_t *peer, uint32_t gen)
+{
+    delta_log_t *delta_log, *n;
+
+    list_for_each_entry_safe(delta_log, n, &peer->log, node)
+    {
+        if (((topic_delta_data_t *)delta_log->msg.msg_data)->gen > gen)
+        {
+            break;
+        }
+        list_del(&delta_log->node);
+        MBUS_FREE(delta_log);
+        peer->log_num--;
+    }
+}
+
+/* 发送一帧增量同步并记入日志，日志超出上限时丢弃最旧的帧，对端再需要这些帧时改为发送完整的主题表 */
+static void msgbus_delta_send(msgbus_context_t *ctx, uint32_t bus_id, msgbus_msg_t *msg_port)
+{
+    ext_peer_t *peer = &ctx->ext_peer[bus_id - 1];
+    delta_log_t *delta_log;
+
+    msg_port->topic = TOPIC_BUS_EXT_DELTA;
+    msg_port->user_id = bus_id;
+    peer->tx_gen = ((topic_delta_data_t *)msg_port->msg_data)->gen;
+    delta_log = MBUS_MALLOC(sizeof(delta_log_t) + msg_port->len);
+    MBUS_ASSERT(delta_log);
+    if (delta_log)
+    { // 日志记录失败时对端在缺口处请求重发，由完整的主题表恢复
+        memcpy(&delta_log->msg, msg_port, SIZEOF_MSGBUS_MSG(msg_port));
+        list_add_tail(&delta_log->node, &peer->log);
+        if (++peer->log_num > MBUS_SYNC_DELTA_MAX)
+        {
+            delta_log = list_entry(peer->log.next, delta_log_t, node);
+            list_del(&delta_log->node);
+            MBUS_FREE(delta_log);
+            peer->log_num--;
+        }
+    }
+    msgbus_ext_write(ctx, msg_port, MSGBUS_PRIO_CONTROL);
+}
+
+/* 向已发送过全量同步的外部总线发送本次主题表的变化，各总线只收到与自己有关的部分，共用一个新的代数 */
+static void msgbus_ext_bus_delta(msgbus_context_t *ctx, const topic_delta_t *delta_list, uint32_t delta_num)
+{
+    const uint32_t empty_len = sizeof(topic_sync_data_t) + sizeof(uint32_t);
+    topic_delta_data_t *delta_data;
+    topic_sync_data_t *topic_sync_data;
+    uint32_t gen = ctx->topic_gen + 1;
+    uint32_t del_len, add_len;
+    msgbus_msg_t *msg_port;
+
+    if (!delta_num)
+    {
+        return;
+    }
+    msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_delta_data_t) + empty_len * 2 +
+                           (sizeof(msgbus_topic_t) + sizeof(msgbus_topic_range_t)) * delta_num);
+    MBUS_ASSERT(msg_port);
+    if (msg_port == NULL)
+    {
+        return;
+    }
+    delta_data = (topic_delta_data_t *)msg_port->msg_data;
+    for (uint32_t bus_id = bitmap_next(&ctx->ext_bus_map_sent, 0); bus_id;
+         bus_id = bitmap_next(&ctx->ext_bus_map_sent, bus_id))
+    {
+        topic_sync_data = (topic_sync_data_t *)delta_data->data;
+        del_len = msgbus_sync_block_fill(topic_sync_data, delta_list, delta_num, bus_id, 0);
+        topic_sync_data = (topic_sync_data_t *)&delta_data->data[del_len];
+        add_len = msgbus_sync_block_fill(topic_sync_data, delta_list, delta_num, bus_id, 1);
+        if (del_len == empty_len && add_len == empty_len)
+        {
+            continue;
+        }
+        if (!bitmap_is_set(&ctx->ext_bus_map_delta, bus_id))
+        {
+            if (bitmap_is_set(&ctx->ext_bus_map_sync, bus_id))
+            { // 对端不认识增量和撤销，改发完整的主题表
+                msgbus_ext_bus_table_send(ctx, bus_id);
+            }
+            else
+            { // 还没有收到对端的全量同步，能力未知，收到后再补发
+                bitmap_set(&ctx->ext_bus_map_stale, bus_id);
+            }
+            continue;
+        }
+        delta_data->gen = gen;
+        delta_data->base_gen = ctx->ext_peer[bus_id - 1].tx_gen;
+        delta_data->flags = 0;
+        msg_port->len = sizeof(topic_delta_data_t) + del_len + add_len;
+        MBUS_LOG_I("[MBUS] delta gen %" PRIu32 " base %" PRIu32 " to ext bus id:%" PRIu32 "\r\n",
+                    gen, delta_data->base_gen, bus_id);
+        msgbus_delta_send(ctx, bus_id, msg_port);
+        ctx->topic_gen = gen;
+    }
+    MBUS_FREE(msg_port);
+}
+
+/* 对端需要的增量已不在日志中，发送完整的主题表替换对端记录的本总线主题，之后的增量以此为基准 */
+static void msgbus_delta_reset(msgbus_context_t *ctx, uint32_t bus_id)
+{
+    const uint32_t empty_len = sizeof(topic_sync_data_t) + sizeof(uint32_t);
+    ext_peer_t *peer = &ctx->ext_peer[bus_id - 1];
+    topic_delta_data_t *delta_data;
+    uint32_t del_len, add_len;
+    msgbus_msg_t *msg_port;
+
+    msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_delta_data_t) + empty_len +
+                           msgbus_sync_table_size(ctx));
+    MBUS_ASSERT(msg_port);
+    if (msg_port == NULL)
+    {
+        return;
+    }
+    delta_data = (topic_delta_data_t *)msg_port->msg_data;
+    del_len = msgbus_sync_block_fill((topic_sync_data_t *)delta_data->data, NULL, 0, bus_id, 0);
+    add_len = msgbus_sync_table_fill(ctx, (topic_sync_data_t *)&delta_data->data[del_len], bus_id);
+    delta_data->gen = ctx->topic_gen;
+    delta_data->base_gen = 0;
+    delta_data->flags = TOPIC_DELTA_RESET;
+    msg_port->topic = TOPIC_BUS_EXT_DELTA;
+    msg_port->len = sizeof(topic_delta_data_t) + del_len + add_len;
+    msg_port->user_id = bus_id;
+    MBUS_LOG_W("[MBUS] delta reset gen %" PRIu32 " to ext bus id:%" PRIu32 "\r\n", delta_data->gen, bus_id);
+    // 完整的主题表不记入日志，丢失后对端在下一个缺口处再次请求
+    msgbus_delta_log_clear(peer, UINT32_MAX);
+    peer->tx_gen = delta_data->gen;
+    msgbus_ext_write(ctx, msg_port, MSGBUS_PRIO_CONTROL);
+    MBUS_FREE(msg_port);
+}
+
+/* 应答外部总线的增量同步，nack为1时请求重发gen之后的增量 */
+static void msgbus_delta_ack(msgbus_context_t *ctx, uint32_t bus_id, uint32_t gen, uint32_t nack)
+{
+    topic_delta_ack_t *ack;
+    msgbus_msg_t *msg_port;
+
+    msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_delta_ack_t));
+    MBUS_ASSERT(msg_port);
+    if (msg_port == NULL)
+    {
+        return;
+    }
+    ack = (topic_delta_ack_t *)msg_port->msg_data;
+    ack->gen = gen;
+    ack->nack = nack;
+    msg_port->topic = TOPIC_BUS_EXT_ACK;
+    msg_port->len = sizeof(topic_delta_ack_t);
+    msg_port->user_id = bus_id;
+    msgbus_ext_write(ctx, msg_port, MSGBUS_PRIO_CONTROL);
+    MBUS_FREE(msg_port);
+}
+
+/* 主题没有订阅用户也没有外部总线订阅时，从主题表中移除，挂到释放列表，快照更新后再释放 */
+static void msgbus_topic_reclaim(msgbus_context_t *ctx, topic_node_t *topic_node, struct list_head *free_list)
+{
+    if (!list_empty(&topic_node->sub_user_list) || !bitmap_is_empty(&topic_node->sub_bus_map))
+    {
+        return;
+    }
+    MBUS_LOG_D("[MBUS] reclaim topic: %" PRIu32 "-%" PRIu32 "\r\n", topic_node->topic_key, topic_node->topic_hi);
+    if (topic_node->topic_key != topic_node->topic_hi)
+    {
+        rb_erase_augmented(&topic_node->node, &ctx->range_tree, &msgbus_range_augment);
+        MBUS_ATOMIC_SUB_RELAXED(&ctx->range_total, 1);
+    }
+    else
+    {
+        rb_erase(&topic_node->node, &ctx->topic_tree);
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+        topic_index_erase(&ctx->topic_index, topic_node->topic_key);
+#endif
+        MBUS_ATOMIC_SUB_RELAXED(&ctx->topic_total, 1);
+    }
+    // 订阅列表已经为空，借用列表头挂到释放列表
+    list_add_tail(&topic_node->sub_user_list, free_list);
+}
+
+/* 释放订阅节点，合并订阅的槽位在通道中的通知被读取后才回收 */
+static void msgbus_sub_user_free(sub_user_node_t *sub_user)
+{
+    if (sub_user->conflate_slot)
+    {
+        msgbus_conflate_slot_put(sub_user->conflate_slot);
+    }
+    MBUS_FREE(sub_user);
+}
+
+/* 释放已从主题表中移除的订阅用户和主题，调用前快照已经更新，发布线程不会再访问这些节点 */
+static void msgbus_free_reclaimed(struct list_head *free_sub_list, struct list_head *free_topic_list)
+{
+    sub_user_node_t *sub_user, *n;
+    topic_node_t *topic_node, *next_topic;
+
+    list_for_each_entry_safe(sub_user, n, free_sub_list, node)
+    {
+        msgbus_sub_user_free(sub_user);
+    }
+    list_for_each_entry_safe(topic_node, next_topic, free_topic_list, sub_user_list)
+    {
+        MBUS_FREE(topic_node);
+    }
+}
+
+/* 开始修改主题表，已经向外部总线发送过全量同步时，为node_num个节点的变化申请记录空间 */
+static int32_t msgbus_reclaim_begin(msgbus_context_t *ctx, topic_reclaim_t *reclaim, uint32_t node_num)
+{
+    reclaim->delta_list = NULL;
+    reclaim->delta_num = 0;
+    INIT_LIST_HEAD(&reclaim->free_sub_list);
+    INIT_LIST_HEAD(&reclaim->free_topic_list);
+    if (!msgbus_delta_enabled(ctx))
+    {
+        return 0;
+    }
+    reclaim->delta_list = MBUS_MALLOC(sizeof(topic_delta_t) * (node_num ? node_num : 1));
+    MBUS_ASSERT(reclaim->delta_list);
+
+    return reclaim->delta_list ? 0 : -1;
+}
+
+static void msgbus_reclaim_end(msgbus_context_t *ctx, topic_reclaim_t *reclaim)
+{
+    // 快照更新后发布线程不再访问被移除的节点，此时才能释放
+    msgbus_snapshot_update(ctx);
+    msgbus_free_reclaimed(&reclaim->free_sub_list, &reclaim->free_topic_list);
+    if (reclaim->delta_list)
+    {
+        msgbus_ext_bus_delta(ctx, reclaim->delta_list, reclaim->delta_num);
+        MBUS_FREE(reclaim->delta_list);
+    }
+}
+
+/* 外部总线订阅该主题或主题范围，可能需要通知其他外部总线向本总线转发 */
+static void msgbus_ext_bus_attach(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi, uint32_t bus_id,
+                                  topic_reclaim_t *reclaim)
+{
+    topic_node_t *topic_node = msgbus_topic_node_get(ctx, topic_lo, topic_hi);
+    bitmap_t export_map;
+
+    if (topic_node == NULL || bitmap_is_set(&topic_node->sub_bus_map, bus_id))
+    {
+        return;
+    }
+    if (reclaim->delta_list)
+    {
+        msgbus_topic_export_map(ctx, topic_node, &export_map);
+    }
+    bitmap_set(&topic_node->sub_bus_map, bus_id);
+    msgbus_topic_delta_record(ctx, topic_node, &export_map, reclaim->delta_list, &reclaim->delta_num);
+}
+
+/* 外部总线不再订阅该节点，可能导致本总线也不再需要从其他总线接收该主题 */
+static void msgbus_ext_bus_detach(msgbus_context_t *ctx, topic_node_t *topic_node, uint32_t bus_id,
+                                  topic_reclaim_t *reclaim)
+{
+    bitmap_t export_map;
+
+    if (topic_node == NULL || !bitmap_is_set(&topic_node->sub_bus_map, bus_id))
+    {
+        return;
+    }
+    if (reclaim->delta_list)
+    {
+        msgbus_topic_export_map(ctx, topic_node, &export_map);
+    }
+    bitmap_unset(&topic_node->sub_bus_map, bus_id);
+    msgbus_topic_delta_record(ctx, topic_node, &export_map, reclaim->delta_list, &reclaim->delta_num);
+    msgbus_topic_reclaim(ctx, topic_node, &reclaim->free_topic_list);
+}
+
+/* 向外部总线发送全量同步，之后与该总线有关的主题变化以增量发送 */
+static void msgbus_ext_bus_full_sync(msgbus_context_t *ctx, uint32_t bus_id)
+{
+    ext_peer_t *peer = &ctx->ext_peer[bus_id - 1];
+
+    if (bitmap_is_set(&ctx->ext_bus_map_sent, bus_id))
+    { // 对端只处理第一次全量同步，之后的变化已经以增量发送
+        return;
+    }
+    msgbus_ext_bus_table_send(ctx, bus_id);
+    bitmap_set(&ctx->ext_bus_map_sent, bus_id);
+    msgbus_delta_log_clear(peer, UINT32_MAX);
+    peer->tx_gen = 0;
+}
+
+static void msgbus_ext_bus_map_sync(msgbus_context_t *ctx)
+{
+    uint32_t bus_total = 0, bus_sync_num = 0;
+    msgbus_msg_t *msg_port = NULL;
+
+    if (ctx->sync_start_flag &&
+        !ctx->sync_over_flag)
+    {
+        bus_total = bitmap_cnt(&ctx->ext_bus_map);
+        bus_sync_num = bitmap_cnt(&ctx->ext_bus_map_sync);
+
+        if (!bus_total || bus_total == bus_sync_num)
+        { /* 没有外部总线，或者首次同步时就已经全部收到其他总线的同步（只有一个外部总线的情况下） */
+            uint32_t except_bus_id = bitmap_next(&ctx->ext_bus_map, 0);
+            while (except_bus_id)
+            {
+                msgbus_ext_bus_full_sync(ctx, except_bus_id);
+                except_bus_id = bitmap_next(&ctx->ext_bus_map, except_bus_id);
+            }
+            msg_port = MBUS_MALLOC(sizeof(msgbus_msg_t));
+            MBUS_ASSERT(msg_port);
+            memset(msg_port, 0, sizeof(msgbus_msg_t));
+            msg_port->user_id = LOCAL_BUS_ID;
+            msg_port->topic = MSG_TOPIC_SET_LOCAL(MSG_TOPIC_SYNC_OVER);
+            msg_port->len = 0;
+            msgbus_proc_event_publish(ctx, msg_port, NULL);
+            MBUS_FREE(msg_port);
+            ctx->sync_over_flag = 1;
+            msgbus_snapshot_update(ctx);
+        }
+        else if (bus_total && ((bus_total - 1) == bus_sync_num))
+        { /* 只剩下一个未同步外部总线，向该总线发送当前主题列表 */
+            uint32_t except_bus_id = bitmap_cmp(&ctx->ext_bus_map,
+                                                &ctx->ext_bus_map_sync);
+            msgbus_ext_bus_full_sync(ctx, except_bus_id);
+        }
+    }
+}
+
+static int32_t msgbus_proc_event_sync(msgbus_context_t *ctx)
+{
+    MBUS_LOG_I("[MBUS] proc event topic sync\r\n");
+    MBUS_TRACE(MSGBUS_TRACE_SYNC, TOPIC_BUS_SYNC, LOCAL_BUS_ID, 0);
+    ctx->sync_start_flag = 1;
+
+    msgbus_ext_bus_map_sync(ctx);
+    return 0;
+}
+
+/* 在已排序的同步主题列表中查找主题 */
+static int msgbus_sync_topic_search(const msgbus_topic_t *topic_list, uint32_t topic_num, uint32_t topic)
+{
+    uint32_t low = 0, high = topic_num;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t mid_topic = GET_USER_TOPIC(topic_list[mid]);
+
+        if (mid_topic == topic)
+        {
+            return 1;
+        }
+        if (mid_topic < topic)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+/* 在按下限、上限排序的同步范围列表中查找主题范围 */
+static int msgbus_sync_range_search(const msgbus_topic_range_t *range_list, uint32_t range_num, uint32_t topic_lo,
+                                    uint32_t topic_hi)
+{
+    uint32_t low = 0, high = range_num;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t mid_lo = GET_USER_TOPIC(range_list[mid].topic_lo);
+        uint32_t mid_hi = GET_USER_TOPIC(range_list[mid].topic_hi);
+
+        if (mid_lo == topic_lo && mid_hi == topic_hi)
+        {
+            return 1;
+        }
+        if (mid_lo < topic_lo || (mid_lo == topic_lo && mid_hi < topic_hi))
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+/* 撤销外部总线记录中不在新主题表内的主题和主题范围，新主题表中的主题列表和范围列表均已排序 */
+static void msgbus_ext_bus_replace(msgbus_context_t *ctx, uint32_t bus_id, topic_sync_data_t *topic_sync_data,
+                                   msgbus_topic_range_t *range_list, uint32_t range_num, topic_reclaim_t *reclaim)
+{
+    struct rb_node *tree_node, *next_node;
+    topic_node_t *topic_node;
+
+    // 先取得后继再撤销，被回收的节点只从树中移除，不影响后继节点
+    for (tree_node = rb_first(&ctx->topic_tree); tree_node; tree_node = next_node)
+    {
+        topic_node = container_of(tree_node, topic_node_t, node);
+        next_node = rb_next(tree_node);
+        if (bitmap_is_set(&topic_node->sub_bus_map, bus_id) &&
+            !msgbus_sync_topic_search(topic_sync_data->topic_list, topic_sync_data->topic_num, topic_node->topic_key))
+        {
+            msgbus_ext_bus_detach(ctx, topic_node, bus_id, reclaim);
+        }
+    }
+    for (tree_node = rb_first(&ctx->range_tree); tree_node; tree_node = next_node)
+    {
+        topic_node = container_of(tree_node, topic_node_t, node);
+        next_node = rb_next(tree_node);
+        if (bitmap_is_set(&topic_node->sub_bus_map, bus_id) &&
+            !msgbus_sync_range_search(range_list, range_num, topic_node->topic_key, topic_node->topic_hi))
+        {
+            msgbus_ext_bus_detach(ctx, topic_node, bus_id, reclaim);
+        }
+    }
+}
+
+/* 将同步数据中的主题和主题范围加入外部总线的订阅 */
+static void msgbus_ext_bus_attach_list(msgbus_context_t *ctx, uint32_t bus_id, topic_sync_data_t *topic_sync_data,
+                                       msgbus_topic_range_t *range_list, uint32_t range_num, topic_reclaim_t *reclaim)
+{
+    for (size_t i = 0; i < topic_sync_data->topic_num; i++)
+    {
+        if (topic_sync_data->topic_list[i] == 0)
+        {
+            break;
+        }
+        msgbus_ext_bus_attach(ctx, GET_USER_TOPIC(topic_sync_data->topic_list[i]),
+                              GET_USER_TOPIC(topic_sync_data->topic_list[i]), bus_id, reclaim);
+    }
+    for (uint32_t i = 0; i < range_num; i++)
+    {
+        uint32_t topic_lo = GET_USER_TOPIC(range_list[i].topic_lo);
+        uint32_t topic_hi = GET_USER_TOPIC(range_list[i].topic_hi);
+
+        if (topic_lo == 0 || topic_lo > topic_hi)
+        {
+            continue;
+        }
+        msgbus_ext_bus_attach(ctx, topic_lo, topic_hi, bus_id, reclaim);
+    }
+}
+
+/* 记录外部总线同步的主题表，同步数据已经解析，replace为1时先撤销该总线不在表中的主题 */
+static void msgbus_add_ext_sync_topic(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, msgbus_topic_range_t *range_list,
+                                      uint32_t range_num, int replace)
+{
+    topic_sync_data_t *topic_sync_data = (topic_sync_data_t *)bus_msg->msg_data;
+    uint32_t node_num;
+    topic_reclaim_t reclaim;
+
+    MBUS_LOG_I("[MBUS] add extern topic, topic num: %" PRIu32 "\r\n", topic_sync_data->topic_num);
+    node_num = topic_sync_data->topic_num + range_num;
+    if (replace)
+    {
+        node_num += ctx->topic_total + ctx->range_total;
+    }
+    // 已经向其他外部总线发送过全量同步时，新增和撤销的主题以增量通知它们
+    msgbus_reclaim_begin(ctx, &reclaim, node_num);
+    if (replace)
+    {
+        msgbus_ext_bus_replace(ctx, bus_msg->user_id, topic_sync_data, range_list, range_num, &reclaim);
+    }
+    msgbus_ext_bus_attach_list(ctx, bus_msg->user_id, topic_sync_data, range_list, range_num, &reclaim);
+    msgbus_reclaim_end(ctx, &reclaim);
+}
+
+static int32_t msgbus_proc_event_ext_sync(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    msgbus_topic_range_t *range_list;
+    uint32_t range_num;
+
+    MBUS_TRACE(MSGBUS_TRACE_EXT_SYNC, bus_msg->topic, bus_msg->user_id, bus_msg->len);
+    MBUS_LOG_I("[MBUS] recv_ext_msg, peer id:%" PRIu32 ",topic :%" PRIu32 ", len:%" PRIu32 "\r\n",
+                bus_msg->user_id, bus_msg->topic, bus_msg->len);
+    if (bus_msg->user_id == 0 || bus_msg->user_id > MSGBUS_EXT_BUS_MAX)
+    {
+        return -1;
+    }
+    if (msgbus_sync_data_parse(bus_msg, &range_list, &range_num) != 0)
+    { // 主题数量与长度不符的帧整帧丢弃，不记录同步状态
+        MBUS_LOG_E("[MBUS] ext sync msg malformed, peer id:%" PRIu32 ", len:%" PRIu32 "\r\n",
+                    bus_msg->user_id, bus_msg->len);
+        return -1;
+    }
+    if (!bitmap_is_set(&ctx->ext_bus_map_sync, bus_msg->user_id))
+    { // 该外部总线没有同步过
+        bitmap_set(&ctx->ext_bus_map_sync, bus_msg->user_id);
+        ctx->ext_peer[bus_msg->user_id - 1].rx_gen = 0;
+        if (ctx->compact_flag && (msgbus_sync_data_caps(bus_msg) & TOPIC_SYNC_CAP_COMPACT))
+        { // 双方都支持紧凑格式，之后发给该总线的帧都以紧凑格式编码
+            bitmap_set(&ctx->ext_bus_map_compact, bus_msg->user_id);
+        }
+        if (msgbus_sync_data_caps(bus_msg) & TOPIC_SYNC_CAP_DELTA)
+        { // 对端声明支持增量同步，之后的变化以增量发送
+            bitmap_set(&ctx->ext_bus_map_delta, bus_msg->user_id);
+        }
+        if (bitmap_is_set(&ctx->ext_bus_map_stale, bus_msg->user_id))
+        { // 全量同步之后的变化因能力未知没有发送，支持增量时以完整主题表替换，否则重发主题表
+            bitmap_unset(&ctx->ext_bus_map_stale, bus_msg->user_id);
+            if (bitmap_is_set(&ctx->ext_bus_map_delta, bus_msg->user_id))
+            {
+                msgbus_delta_reset(ctx, bus_msg->user_id);
+            }
+            else
+            {
+                msgbus_ext_bus_table_send(ctx, bus_msg->user_id);
+            }
+        }
+        if (!ctx->selfness_flag)
+        {
+            msgbus_add_ext_sync_topic(ctx, bus_msg, range_list, range_num, 0);
+        }
+        msgbus_ext_bus_map_sync(ctx);
+    }
+    else if (!ctx->selfness_flag)
+    { // 不支持增量的总线以完整的主题表通知变化，替换记录的该总线全部主题
+        msgbus_add_ext_sync_topic(ctx, bus_msg, range_list, range_num, 1);
+    }
+
+    return 0;
+}
+
+/* 按代数应用外部总线的增量同步，重复的帧直接应答，出现缺口时请求重发 */
+static int32_t msgbus_proc_event_ext_delta(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_delta_data_t *delta_data = (topic_delta_data_t *)bus_msg->msg_data;
+    topic_sync_data_t *del_data, *add_data;
+    msgbus_topic_range_t *del_range_list, *add_range_list;
+    uint32_t del_range_num, add_range_num, del_len, add_len;
+    uint32_t bus_id = bus_msg->user_id;
+    topic_reclaim_t reclaim;
+    ext_peer_t *peer;
+
+    MBUS_TRACE(MSGBUS_TRACE_EXT_DELTA, bus_msg->topic, bus_id, bus_msg->len);
+    if (bus_id == 0 || bus_id > MSGBUS_EXT_BUS_MAX || bus_msg->len < sizeof(topic_delta_data_t))
+    {
+        return -1;
+    }
+    if (!bitmap_is_set(&ctx->ext_bus_map_sync, bus_id))
+    { // 增量以全量同步为基准，对端一定先发送全量同步
+        return 0;
+    }
+    peer = &ctx->ext_peer[bus_id - 1];
+    if ((delta_data->flags & TOPIC_DELTA_RESET) ? delta_data->gen < peer->rx_gen : delta_data->gen <= peer->rx_gen)
+    { // 重发的帧已经应用过
+        msgbus_delta_ack(ctx, bus_id, peer->rx_gen, 0);
+        return 0;
+    }
+    if (!(delta_data->flags & TOPIC_DELTA_RESET) && delta_data->base_gen != peer->rx_gen)
+    {
+        MBUS_LOG_W("[MBUS] delta gap from ext bus id:%" PRIu32 ", base %" PRIu32 ", applied %" PRIu32 "\r\n",
+                    bus_id, delta_data->base_gen, peer->rx_gen);
+        msgbus_delta_ack(ctx, bus_id, peer->rx_gen, 1);
+        return 0;
+    }
+    del_data = (topic_sync_data_t *)delta_data->data;
+    del_len = msgbus_sync_block_parse(del_data, bus_msg->len - sizeof(topic_delta_data_t), &del_range_list,
+                                      &del_range_num);
+    if (del_len == 0)
+    {
+        return -1;
+    }
+    add_data = (topic_sync_data_t *)&delta_data->data[del_len];
+    add_len = msgbus_sync_block_parse(add_data, bus_msg->len - sizeof(topic_delta_data_t) - del_len,
+                                      &add_range_list, &add_range_num);
+    if (add_len == 0)
+    {
+        return -1;
+    }
+    MBUS_LOG_I("[MBUS] recv ext delta, peer id:%" PRIu32 ", gen %" PRIu32 ", add %" PRIu32 "/%" PRIu32
+               ", del %" PRIu32 "/%" PRIu32 "\r\n",
+                bus_id, delta_data->gen, add_data->topic_num, add_range_num, del_data->topic_num, del_range_num);
+    if (!ctx->selfness_flag)
+    { // 自私模式不记录外部总线的主题，只推进代数
+        uint32_t node_num = del_data->topic_num + del_range_num + add_data->topic_num + add_range_num;
+
+        if (delta_data->flags & TOPIC_DELTA_RESET)
+        {
+            node_num += ctx->topic_total + ctx->range_total;
+        }
+        if (msgbus_reclaim_begin(ctx, &reclaim, node_num) != 0)
+        {
+            return -1;
+        }
+        // 同一帧中先撤销后新增，与发送端记录变化的顺序一致
+        if (delta_data->flags & TOPIC_DELTA_RESET)
+        {
+            msgbus_ext_bus_replace(ctx, bus_id, add_data, add_range_list, add_range_num, &reclaim);
+        }
+        for (size_t i = 0; i < del_data->topic_num; i++)
+        {
+            msgbus_ext_bus_detach(ctx, msgbus_topic_find(ctx, GET_USER_TOPIC(del_data->topic_list[i])), bus_id,
+                                  &reclaim);
+        }
+        for (uint32_t i = 0; i < del_range_num; i++)
+        {
+            msgbus_ext_bus_detach(ctx, msgbus_topic_node_find(ctx, GET_USER_TOPIC(del_range_list[i].topic_lo),
+                                                              GET_USER_TOPIC(del_range_list[i].topic_hi)),
+                                  bus_id, &reclaim);
+        }
+        msgbus_ext_bus_attach_list(ctx, bus_id, add_data, add_range_list, add_range_num, &reclaim);
+        msgbus_reclaim_end(ctx, &reclaim);
+    }
+    peer->rx_gen = delta_data->gen;
+    msgbus_delta_ack(ctx, bus_id, peer->rx_gen, 0);
+
+    return 0;
+}
+
+/* 处理增量同步应答，释放对端已应用的帧；对端出现缺口时重发日志中的帧，日志不完整时发送完整的主题表 */
+static int32_t msgbus_proc_event_ext_ack(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_delta_ack_t *ack = (topic_delta_ack_t *)bus_msg->msg_data;
+    uint32_t bus_id = bus_msg->user_id;
+    delta_log_t *delta_log;
+    ext_peer_t *peer;
+
+    if (bus_id == 0 || bus_id > MSGBUS_EXT_BUS_MAX || bus_msg->len < sizeof(topic_delta_ack_t) ||
+        !bitmap_is_set(&ctx->ext_bus_map_sent, bus_id))
+    {
+        return -1;
+    }
+    peer = &ctx->ext_peer[bus_id - 1];
+    msgbus_delta_log_clear(peer, ack->gen);
+    if (!ack->nack || ack->gen == peer->tx_gen)
+    {
+        return 0;
+    }
+    if (!list_empty(&peer->log) &&
+        ((topic_delta_data_t *)list_entry(peer->log.next, delta_log_t, node)->msg.msg_data)->base_gen == ack->gen)
+    {
+        MBUS_LOG_W("[MBUS] delta resend %" PRIu32 " frames to ext bus id:%" PRIu32 "\r\n", peer->log_num, bus_id);
+        list_for_each_entry(delta_log, &peer->log, node)
+        {
+            msgbus_ext_write(ctx, &delta_log->msg, MSGBUS_PRIO_CONTROL);
+        }
+    }
+    else
+    {
+        msgbus_delta_reset(ctx, bus_id);
+    }
+
+    return 0;
+}
+
+/* 订阅的主题列表是否已按用户主题排序，相邻的重复主题（包括只有属性不同的）视为有序，合并时复用同一节点 */
+static int msgbus_topic_list_sorted(const msgbus_topic_t *topic_list, uint32_t topic_num)
+{
+    for (uint32_t i = 1; i < topic_num && topic_list[i]; i++)
+    {
+        if (GET_USER_TOPIC(topic_list[i]) < GET_USER_TOPIC(topic_list[i - 1]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* 将订阅用户加入节点，重复订阅只更新属性，topic_attr为订阅时带属性的主题或范围下限 */
+static void msgbus_sub_attach(msgbus_context_t *ctx, topic_node_t *topic_node, const topic_sub_data_t *topic_sub_data,
+                              msgbus_topic_t topic_attr)
+{
+    sub_user_node_t *sub_user_node;
+
+    // 通过订阅哈希表判断是否为重复订阅
+    sub_user_node = msgbus_sub_find(ctx, topic_node->topic_key, topic_node->topic_hi, topic_sub_data);
+    if (sub_user_node == NULL)
+    { // 当前用户没有订阅当前主题，创建一个订阅节点
+        sub_user_node = MBUS_MALLOC(sizeof(sub_user_node_t));
+        MBUS_ASSERT(sub_user_node);
+        memset(sub_user_node, 0, sizeof(sub_user_node_t));
+        sub_user_node->topic_node = topic_node;
+        sub_user_node->hash = msgbus_sub_hash(topic_node->topic_key, topic_node->topic_hi, topic_sub_data);
+        sub_user_node->user_id = topic_sub_data->user_id;
+        sub_user_node->channel = topic_sub_data->channel;
+        sub_user_node->sub_cb = topic_sub_data->sub_cb;
+        sub_user_node->cb_ctx = topic_sub_data->cb_ctx;
+        if (sub_user_node->sub_cb == NULL)
+        {
+            sub_user_node->sub_chan = msgbus_sub_channel_find(ctx, topic_sub_data->channel);
+        }
+        msgbus_sub_hash_add(ctx, sub_user_node);
+        if (list_empty(&topic_node->sub_user_list) && topic_node->topic_key == topic_node->topic_hi)
+        { // 主题的第一个订阅用户，外部总线同步创建的主题也在此时计入本地主题
+            MBUS_ATOMIC_ADD_RELAXED(&ctx->topic_local_num, 1);
+        }
+        list_add_tail(&sub_user_node->node, &topic_node->sub_user_list);
+    }
+    if (MSG_TOPIC_IS_LOCAL(topic_attr))
+    {
+        sub_user_node->user_local_sub = 1;
+    }
+    if (MSG_TOPIC_IS_CONFLATED(topic_attr) && sub_user_node->sub_cb == NULL && sub_user_node->conflate_slot == NULL &&
+        topic_node->topic_key == topic_node->topic_hi)
+    { // 槽位按订阅节点保存，范围订阅命中多个主题，回调订阅不排队，都忽略合并属性
+        conflate_slot_t *slot = MBUS_MALLOC(sizeof(conflate_slot_t));
+
+        MBUS_ASSERT(slot);
+        if (slot)
+        {
+            slot->refcnt = 1;
+            slot->latest = NULL;
+            sub_user_node->conflate_slot = slot;
+            sub_user_node->user_shared_sub = 0;
+        }
+    }
+    if (MSG_TOPIC_IS_SHARED(topic_attr) && sub_user_node->sub_cb == NULL && sub_user_node->conflate_slot == NULL)
+    { // 回调订阅直接引用总线中的消息，本身不需要拷贝，忽略共享属性；合并订阅只保留最新值，优先于共享
+        sub_user_node->user_shared_sub = 1;
+    }
+}
+
+static int32_t msgbus_proc_event_subscribe(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_node_t *topic_node;
+    uint32_t user_topic = 0;
+    topic_sub_data_t *topic_sub_data = (topic_sub_data_t *)bus_msg->msg_data;
+    msgbus_topic_range_t *range_list;
+    struct rb_node *next = NULL;
+    topic_reclaim_t reclaim;
+    bitmap_t export_map;
+    int32_t res = 0;
+    int merge;
+
+    MBUS_TRACE(MSGBUS_TRACE_SUBSCRIBE, TOPIC_BUS_SUB, topic_sub_data->user_id, topic_sub_data->topic_num);
+    MBUS_LOG_I("[MBUS] proc event sub, user: %" PRIu32 " topic num: %" PRIu32 " range num: %" PRIu32 ",\r\n",
+                (uint32_t)topic_sub_data->user_id,
+                topic_sub_data->topic_num, topic_sub_data->range_num);
+    if (ctx->sub_hash == NULL && msgbus_sub_hash_resize(ctx, SUB_HASH_SHIFT_INIT) != 0)
+    {
+        MBUS_LOG_E("[MBUS] subscribe hash table no memory\r\n");
+        return -1;
+    }
+    // 同步开始后订阅的主题以增量通知外部总线，记录空间不足时只影响通知，不影响本地订阅
+    msgbus_reclaim_begin(ctx, &reclaim, topic_sub_data->topic_num + topic_sub_data->range_num);
+    // 主题较多且已排序时，与红黑树按顺序合并一遍，不再逐个从根节点查找
+    merge = topic_sub_data->topic_num > 1 && topic_sub_data->topic_num * 16 >= ctx->topic_total &&
+            msgbus_topic_list_sorted(topic_sub_data->topic_list, topic_sub_data->topic_num);
+    if (merge)
+    {
+        next = rb_first(&ctx->topic_tree);
+    }
+    for (size_t i = 0; i < topic_sub_data->topic_num; i++)
+    {
+        if (topic_sub_data->topic_list[i] == 0)
+        {
+            break;
+        }
+        user_topic = GET_USER_TOPIC(topic_sub_data->topic_list[i]);
+        MBUS_LOG_D("[MBUS] subscribe, topic key: %" PRIu32 "\r\n", user_topic);
+        if (merge)
+        { // next为第一个不小于当前主题的节点，不存在的主题直接链接在它之前
+            while (next && rb_entry(next, topic_node_t, node)->topic_key < user_topic)
+            {
+                next = rb_next(next);
+            }
+            if (next && rb_entry(next, topic_node_t, node)->topic_key == user_topic)
+            {
+                topic_node = rb_entry(next, topic_node_t, node);
+            }
+            else
+            {
+                topic_node = msgbus_create_topic_node_before(ctx, user_topic, next);
+                if (topic_node)
+                { // 新节点成为第一个不小于当前主题的节点，列表中重复的主题命中该节点
+                    next = &topic_node->node;
+                }
+            }
+        }
+        else
+        {
+            topic_node = msgbus_topic_find(ctx, user_topic);
+            if (topic_node == NULL)
+            { // 当前主题不存在，新建
+                topic_node = msgbus_create_topic_node(ctx, user_topic);
+            }
+        }
+        if (topic_node == NULL)
+        { // 新建失败时不订阅该主题，主题表中没有留下节点
+            res = -1;
+            continue;
+        }
+
+        if (reclaim.delta_list)
+        {
+            msgbus_topic_export_map(ctx, topic_node, &export_map);
+        }
+        msgbus_sub_attach(ctx, topic_node, topic_sub_data, topic_sub_data->topic_list[i]);
+        msgbus_topic_delta_record(ctx, topic_node, &export_map, reclaim.delta_list, &reclaim.delta_num);
+    }
+    // 主题范围较少，逐个在区间树中查找
+    range_list = (msgbus_topic_range_t *)&topic_sub_data->topic_list[topic_sub_data->topic_num];
+    for (uint32_t i = 0; i < topic_sub_data->range_num; i++)
+    {
+        topic_node = msgbus_topic_node_get(ctx, GET_USER_TOPIC(range_list[i].topic_lo),
+                                           GET_USER_TOPIC(range_list[i].topic_hi));
+        if (topic_node == NULL)
+        {
+            res = -1;
+            continue;
+        }
+        if (reclaim.delta_list)
+        {
+            msgbus_topic_export_map(ctx, topic_node, &export_map);
+        }
+        msgbus_sub_attach(ctx, topic_node, topic_sub_data, range_list[i].topic_lo);
+        msgbus_topic_delta_record(ctx, topic_node, &export_map, reclaim.delta_list, &reclaim.delta_num);
+    }
+    // 同步完成后的订阅，更新直接派发使用的快照
+    msgbus_reclaim_end(ctx, &reclaim);
+
+    return res;
+}
+
+/* 取消一个订阅，记录需要撤销的外部总线，主题不再被需要时回收 */
+static void msgbus_sub_detach(msgbus_context_t *ctx, uint32_t topic_lo, uint32_t topic_hi,
+                              const topic_sub_data_t *topic_sub_data, topic_reclaim_t *reclaim)
+{
+    topic_node_t *topic_node;
+    sub_user_node_t *sub_user;
+    bitmap_t export_map;
+
+    sub_user = msgbus_sub_find(ctx, topic_lo, topic_hi, topic_sub_data);
+    if (sub_user == NULL)
+    {
+        return;
+    }
+    topic_node = sub_user->topic_node;
+    if (reclaim->delta_list)
+    {
+        msgbus_topic_export_map(ctx, topic_node, &export_map);
+    }
+    msgbus_sub_hash_del(ctx, sub_user);
+    list_move_tail(&sub_user->node, &reclaim->free_sub_list);
+    if (list_empty(&topic_node->sub_user_list) && topic_node->topic_key == topic_node->topic_hi)
+    {
+        MBUS_ATOMIC_SUB_RELAXED(&ctx->topic_local_num, 1);
+    }
+    msgbus_topic_delta_record(ctx, topic_node, &export_map, reclaim->delta_list, &reclaim->delta_num);
+    msgbus_topic_reclaim(ctx, topic_node, &reclaim->free_topic_list);
+}
+
+static int32_t msgbus_proc_event_unsubscribe(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_sub_data_t *topic_sub_data = (topic_sub_data_t *)bus_msg->msg_data;
+    msgbus_topic_range_t *range_list;
+    topic_reclaim_t reclaim;
+
+    MBUS_TRACE(MSGBUS_TRACE_UNSUBSCRIBE, TOPIC_BUS_UNSUB, topic_sub_data->user_id, topic_sub_data->topic_num);
+    MBUS_LOG_I("[MBUS] proc event unsub, user: %" PRIu32 " topic num: %" PRIu32 " range num: %" PRIu32 ",\r\n",
+                (uint32_t)topic_sub_data->user_id,
+                topic_sub_data->topic_num, topic_sub_data->range_num);
+    if (msgbus_reclaim_begin(ctx, &reclaim, topic_sub_data->topic_num + topic_sub_data->range_num) != 0)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < topic_sub_data->topic_num; i++)
+    {
+        if (topic_sub_data->topic_list[i] == 0)
+        {
+            break;
+        }
+        msgbus_sub_detach(ctx, GET_USER_TOPIC(topic_sub_data->topic_list[i]),
+                          GET_USER_TOPIC(topic_sub_data->topic_list[i]), topic_sub_data, &reclaim);
+    }
+    range_list = (msgbus_topic_range_t *)&topic_sub_data->topic_list[topic_sub_data->topic_num];
+    for (uint32_t i = 0; i < topic_sub_data->range_num; i++)
+    {
+        msgbus_sub_detach(ctx, GET_USER_TOPIC(range_list[i].topic_lo), GET_USER_TOPIC(range_list[i].topic_hi),
+                          topic_sub_data, &reclaim);
+    }
+    msgbus_reclaim_end(ctx, &reclaim);
+
+    return 0;
+}
+
+static int32_t msgbus_proc_event_batch(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    uint32_t offset = 0;
+    msgbus_msg_t *item_msg;
+
+    // 批量消息由多条对齐的消息依次拼接而成，逐条派发
+    while (offset + sizeof(msgbus_msg_t) <= bus_msg->len)
+    {
+        item_msg = msgbus_batch_item(bus_msg, offset);
+        if (item_msg == NULL)
+        {
+            MBUS_LOG_E("[MBUS] batch msg truncated, len:%" PRIu32 "\r\n", bus_msg->len);
+            return -1;
+        }
+        offset += sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN(item_msg->len);
+        // 来源以整帧的user_id为准，与单条转发和紧凑格式还原一致
+        item_msg->user_id = bus_msg->user_id;
+        msgbus_proc_event_publish(ctx, item_msg, NULL);
+    }
+
+    return 0;
+}
+
+/* 组播帧中的原消息，帧长度不足以容纳目的总线表、原消息头或原消息数据时返回NULL */
+static msgbus_msg_t *msgbus_multicast_inner(const msgbus_msg_t *bus_msg)
+{
+    const msgbus_multicast_t *mcast = (const msgbus_multicast_t *)bus_msg->msg_data;
+    msgbus_msg_t *inner_msg;
+    uint32_t head_len;
+
+    if (bus_msg->len < sizeof(msgbus_multicast_t))
+    {
+        return NULL;
+    }
+    head_len = sizeof(msgbus_multicast_t) + sizeof(uint32_t) * mcast->word_num + sizeof(msgbus_msg_t);
+    if (bus_msg->len < head_len)
+    {
+        return NULL;
+    }
+    inner_msg = MSGBUS_MULTICAST_MSG(mcast);
+    if (bus_msg->len - head_len < inner_msg->len)
+    {
+        return NULL;
+    }
+
+    return inner_msg;
+}
+
+/* 外部总线的组播帧，本地总线在目的总线表中时按原消息派发，广播介质上发给其它总线的帧直接丢弃。
+ * 紧凑格式的原消息已在系统通道入口还原，这里只接受原格式的用户主题 */
+static int32_t msgbus_proc_event_multicast(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    msgbus_multicast_t *mcast = (msgbus_multicast_t *)bus_msg->msg_data;
+    msgbus_msg_t *inner_msg = msgbus_multicast_inner(bus_msg);
+
+    if (inner_msg == NULL)
+    {
+        MBUS_LOG_E("[MBUS] multicast msg truncated, len:%" PRIu32 "\r\n", bus_msg->len);
+        return -1;
+    }
+    if (!MSGBUS_MULTICAST_HAS(mcast, LOCAL_BUS_ID))
+    {
+        return 0;
+    }
+    if (GET_USER_TOPIC(inner_msg->topic) >= MSG_TOPIC_SYSTEM_TOPIC_MAX)
+    {
+        MBUS_LOG_W("[MBUS] multicast msg topic error, topic:%" PRIu32 "\r\n", inner_msg->topic);
+        return -1;
+    }
+
+    return msgbus_proc_event_publish(ctx, inner_msg, NULL);
+}
+
+/* 统计一个主题或主题范围节点并回调，订阅用户统计缓冲区在遍历中复用，不足时扩大 */
+static void msgbus_stats_walk_node(topic_node_t *topic_node, topic_stats_data_t *topic_stats_data,
+                                   msgbus_sub_stats_t **sub_list, uint32_t *sub_max)
+{
+    msgbus_topic_stats_t topic_stats;
+    sub_user_node_t *sub_user;
+    struct list_head *pos;
+    uint32_t sub_num = 0;
+
+    list_for_each(pos, &topic_node->sub_user_list)
+    {
+        sub_num++;
+    }
+    if (sub_num > *sub_max)
+    {
+        if (*sub_list)
+        {
+            MBUS_FREE(*sub_list);
+        }
+        *sub_list = MBUS_MALLOC(sizeof(msgbus_sub_stats_t) * sub_num);
+        MBUS_ASSERT(*sub_list);
+        *sub_max = *sub_list ? sub_num : 0;
+    }
+    memset(&topic_stats, 0, sizeof(topic_stats));
+    topic_stats.topic = topic_node->topic_key;
+    topic_stats.topic_hi = topic_node->topic_hi;
+    bitmap_copy(&topic_stats.sub_bus_map, &topic_node->sub_bus_map);
+    topic_stats.publish_cnt = MBUS_ATOMIC_LOAD_RELAXED(&topic_node->counter.publish_cnt);
+    topic_stats.publish_bytes = MBUS_ATOMIC_LOAD_RELAXED(&topic_node->counter.publish_bytes);
+    topic_stats.fanout_cnt = MBUS_ATOMIC_LOAD_RELAXED(&topic_node->counter.fanout_cnt);
+    topic_stats.write_fail_cnt = MBUS_ATOMIC_LOAD_RELAXED(&topic_node->counter.write_fail_cnt);
+    topic_stats.drop_cnt = MBUS_ATOMIC_LOAD_RELAXED(&topic_node->counter.drop_cnt);
+    topic_stats.sub_list = *sub_list;
+    list_for_each_entry(sub_user, &topic_node->sub_user_list, node)
+    {
+        msgbus_sub_stats_t *sub_stats;
+
+        if (topic_stats.sub_num >= *sub_max)
+        {
+            break;
+        }
+        sub_stats = &(*sub_list)[topic_stats.sub_num++];
+        sub_stats->user_id = sub_user->user_id;
+        sub_stats->channel = sub_user->channel;
+        sub_stats->deliver_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_user->counter.deliver_cnt);
+        sub_stats->deliver_bytes = MBUS_ATOMIC_LOAD_RELAXED(&sub_user->counter.deliver_bytes);
+        sub_stats->write_fail_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_user->counter.write_fail_cnt);
+        sub_stats->drop_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_user->counter.drop_cnt);
+        sub_stats->conflate_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_user->counter.conflate_cnt);
+    }
+    topic_stats_data->walk_cb(&topic_stats, topic_stats_data->arg);
+}
+
+static int32_t msgbus_proc_event_stats(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_stats_data_t *topic_stats_data = (topic_stats_data_t *)bus_msg->msg_data;
+    msgbus_sub_stats_t *sub_list = NULL;
+    uint32_t sub_max = 0;
+
+    // 先按顺序遍历主题，再遍历主题范围
+    for (struct rb_node *tree_node = rb_first(&ctx->topic_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        msgbus_stats_walk_node(container_of(tree_node, topic_node_t, node), topic_stats_data, &sub_list, &sub_max);
+    }
+    for (struct rb_node *tree_node = rb_first(&ctx->range_tree); tree_node; tree_node = rb_next(tree_node))
+    {
+        msgbus_stats_walk_node(container_of(tree_node, topic_node_t, node), topic_stats_data, &sub_list, &sub_max);
+    }
+    topic_stats_data->walk_cb(NULL, topic_stats_data->arg);
+    if (sub_list)
+    {
+        MBUS_FREE(sub_list);
+    }
+
+    return 0;
+}
+
+static int32_t msgbus_proc_event_backpressure(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_bp_data_t *bp_data = (topic_bp_data_t *)bus_msg->msg_data;
+    uint32_t ring_size = bp_data->bp.policy == MSGBUS_BP_DROP_OLDEST ? bp_data->bp.queue_len : 0;
+    backlog_msg_t **ring = NULL;
+    sub_channel_t *sub_chan;
+    sub_user_node_t *sub_user;
+
+    MBUS_LOG_I("[MBUS] proc event backpressure, channel:%p policy:%" PRIu32 "\r\n",
+               bp_data->channel, (uint32_t)bp_data->bp.policy);
+    if (ring_size)
+    {
+        ring = MBUS_MALLOC(sizeof(backlog_msg_t *) * ring_size);
+        MBUS_ASSERT(ring);
+        if (ring == NULL)
+        {
+            return -1;
+        }
+    }
+    sub_chan = msgbus_sub_channel_find(ctx, bp_data->channel);
+    if (sub_chan == NULL)
+    {
+        sub_chan = MBUS_MALLOC(sizeof(sub_channel_t));
+        MBUS_ASSERT(sub_chan);
+        if (sub_chan == NULL)
+        {
+            MBUS_FREE(ring);
+            return -1;
+        }
+        memset(sub_chan, 0, sizeof(sub_channel_t));
+        sub_chan->channel = bp_data->channel;
+        sub_chan->next = ctx->sub_chan_list;
+        MBUS_ATOMIC_STORE_RELEASE(&ctx->sub_chan_list, sub_chan);
+        // 该通道上已有的订阅也使用新的背压状态
+        for (uint32_t i = 0; ctx->sub_hash && i < (1u << (32 - ctx->sub_hash_shift)); i++)
+        {
+            for (sub_user = ctx->sub_hash[i]; sub_user; sub_user = sub_user->hash_next)
+            {
+                if (sub_user->channel == bp_data->channel && sub_user->sub_cb == NULL)
+                {
+                    sub_user->sub_chan = sub_chan;
+                }
+            }
+        }
+    }
+    // 积压的消息先尽量补写，新的溢出环容纳不下的按最旧丢弃，剩余的按顺序移入新的溢出环
+    MBUS_LOCK(&sub_chan->lock);
+    msgbus_backlog_flush(ctx, sub_chan);
+    while (sub_chan->backlog > ring_size)
+    {
+        msgbus_backlog_drop_oldest(ctx, sub_chan);
+    }
+    for (uint32_t i = 0; i < sub_chan->backlog; i++)
+    {
+        ring[i] = sub_chan->ring[(sub_chan->ring_head + i) % sub_chan->ring_size];
+    }
+    if (sub_chan->ring)
+    {
+        MBUS_FREE(sub_chan->ring);
+    }
+    sub_chan->ring = ring;
+    sub_chan->ring_size = ring_size;
+    sub_chan->ring_head = 0;
+    MBUS_ATOMIC_STORE(&sub_chan->policy, bp_data->bp.policy);
+    MBUS_ATOMIC_STORE(&sub_chan->timeout_ms, bp_data->bp.timeout_ms);
+    MBUS_ATOMIC_STORE(&sub_chan->spill_channel, bp_data->bp.spill_channel);
+    MBUS_UNLOCK(&sub_chan->lock);
+    msgbus_snapshot_update(ctx);
+
+    return 0;
+}
+
+static int32_t msgbus_proc_event_loaned(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    topic_loan_data_t *topic_loan_data = (topic_loan_data_t *)bus_msg->msg_data;
+    msgbus_shared_buf_t *shared_buf = container_of(topic_loan_data->loan_msg, msgbus_shared_buf_t, msg);
+    int32_t res;
+
+    // 借出的缓冲区本身就是共享消息，共享订阅用户直接引用，不再拷贝
+    res = msgbus_proc_event_publish(ctx, &shared_buf->msg, shared_buf);
+    msgbus_shared_buf_put(shared_buf);
+
+    return res;
+}
+
+/* 消息所属的分片，同一主题固定在一个分片 */
+static inline uint32_t msgbus_shard_of(msgbus_context_t *ctx, uint32_t topic)
+{
+    return ((GET_USER_TOPIC(topic) * 0x9E3779B1u) >> 8) % ctx->shard_num;
+}
+
+/* 发布消息进入的通道，不分片时为系统通道 */
+static inline msgbus_channel_t msgbus_ingress_channel(msgbus_context_t *ctx, uint32_t topic)
+{
+    return ctx->shard_num ? ctx->shard_channel[msgbus_shard_of(ctx, topic)] : ctx->sys_channel;
+}
+
+/* 控制消息放入所有分片的控制通道，加锁保证各分片的控制消息顺序一致。
+ * 控制消息不写入分片通道，通道满时也不会有分片收不到，否则其他分片会在汇合处一直等待 */
+static int32_t msgbus_shard_broadcast(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    shard_lane_msg_t *lane_msg;
+    shard_lane_t *lane;
+    msgbus_msg_t wakeup_msg = {0};
+    uint32_t pending;
+
+    lane_msg = MBUS_MALLOC(sizeof(shard_lane_msg_t) + bus_msg->len);
+    MBUS_ASSERT(lane_msg);
+    if (lane_msg == NULL)
+    { // 还没有分片收到，直接返回失败
+        return -1;
+    }
+    memcpy(&lane_msg->msg, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
+    lane_msg->ref = ctx->shard_num;
+    wakeup_msg.topic = TOPIC_BUS_LANE;
+    MBUS_LOCK(&ctx->shard_lock);
+    for (uint32_t i = 0; i < ctx->shard_num; i++)
+    {
+        lane = &ctx->shard_lane[i];
+        MBUS_LOCK(&lane->lock);
+        list_add_tail(&lane_msg->node[i], &lane->list);
+        pending = MBUS_ATOMIC_ADD(&lane->pending, 1);
+        MBUS_UNLOCK(&lane->lock);
+        if (pending == 1)
+        {
+            wakeup_msg.user_id = i;
+            if (ctx->channel_write_handler(ctx->shard_channel[i], &wakeup_msg, sizeof(msgbus_msg_t),
+                                           MSGBUS_PRIO_CONTROL) != 0)
+            { // 分片通道已满时分片仍有消息要处理，处理下一条消息前会先处理控制通道
+                MBUS_LOG_W("[MBUS] wakeup shard %" PRIu32 " for control topic %" PRIu32 " failed\r\n", i,
+                           bus_msg->topic);
+            }
+        }
+    }
+    MBUS_UNLOCK(&ctx->shard_lock);
+
+    return 0;
+}
+
+/* 本地发布线程写入通道的消息，直接派发模式下需要统计仍在排队的数量 */
+static inline int msgbus_is_local_publish(msgbus_context_t *ctx, const msgbus_msg_t *bus_msg)
+{
+    return bus_msg->user_id == LOCAL_BUS_ID &&
+           (bus_msg->topic == TOPIC_BUS_BATCH || bus_msg->topic == TOPIC_BUS_LOANED ||
+            GET_USER_TOPIC(bus_msg->topic) < MSG_TOPIC_USER_MAX);
+}
+
+/* 直接派发模式下发布线程能否直接派发：快照就绪前或本地发布的消息还在通道中排队时仍写入通道，
+ * 否则后发布的消息会先于通道中的消息送达，打乱同一发布线程的顺序 */
+static inline int msgbus_direct_ready(msgbus_context_t *ctx)
+{
+    return ctx->direct_flag && MBUS_ATOMIC_LOAD(&ctx->direct_queued) == 0;
+}
+
+/* 批量消息按分片拆分后分别写入，各分片内保持原有顺序 */
+static int32_t msgbus_shard_write_batch(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    msgbus_msg_t *shard_msg, *item_msg;
+    int counted = ctx->direct_flag && msgbus_is_local_publish(ctx, bus_msg);
+    int32_t res = 0;
+
+    shard_msg = MBUS_MALLOC(SIZEOF_MSGBUS_MSG(bus_msg));
+    MBUS_ASSERT(shard_msg);
+    if (shard_msg == NULL)
+    {
+        return -1;
+    }
+    for (uint32_t shard = 0; shard < ctx->shard_num; shard++)
+    {
+        shard_msg->topic = TOPIC_BUS_BATCH;
+        shard_msg->len = 0;
+        shard_msg->user_id = bus_msg->user_id;
+        for (uint32_t offset = 0; offset + sizeof(msgbus_msg_t) <= bus_msg->len;)
+        {
+            uint32_t item_size;
+
+            item_msg = msgbus_batch_item(bus_msg, offset);
+            if (item_msg == NULL)
+            {
+                break;
+            }
+            item_size = sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN(item_msg->len);
+            if (msgbus_shard_of(ctx, item_msg->topic) == shard)
+            {
+                memcpy(shard_msg->msg_data + shard_msg->len, item_msg, item_size);
+                shard_msg->len += item_size;
+            }
+            offset += item_size;
+        }
+        if (shard_msg->len == 0)
+        {
+            continue;
+        }
+        if (counted)
+        { // 拆分后每个分片各派发一次
+            MBUS_ATOMIC_ADD(&ctx->direct_queued, 1);
+        }
+        if (ctx->channel_write_handler(ctx->shard_channel[shard], shard_msg, SIZEOF_MSGBUS_MSG(shard_msg),
+                                       MSGBUS_PRIO_DEFAULT) != 0)
+        {
+            if (counted)
+            {
+                MBUS_ATOMIC_SUB(&ctx->direct_queued, 1);
+            }
+            res = -1;
+        }
+    }
+    MBUS_FREE(shard_msg);
+
+    return res;
+}
+
+/* 写入入口通道时的优先级，控制消息最高，借用发布取借出消息的优先级 */
+/* 组播帧中原消息的主题，用于选择优先级和分片，帧长度不足时返回组播帧主题，由派发时丢弃 */
+static inline uint32_t msgbus_multicast_topic(const msgbus_msg_t *bus_msg)
+{
+    const msgbus_msg_t *inner_msg = msgbus_multicast_inner(bus_msg);
+
+    return inner_msg ? inner_msg->topic : bus_msg->topic;
+}
+
+static int msgbus_ingress_prio(msgbus_msg_t *bus_msg)
+{
+    if (msgbus_is_control_msg(bus_msg->topic))
+    {
+        return MSGBUS_PRIO_CONTROL;
+    }
+    switch (bus_msg->topic)
+    {
+    case TOPIC_BUS_LOANED:
+        return MSG_TOPIC_GET_PRIO(((topic_loan_data_t *)bus_msg->msg_data)->loan_msg->topic);
+
+    case MSG_TOPIC_EXT_MULTICAST:
+        return MSG_TOPIC_GET_PRIO(msgbus_multicast_topic(bus_msg));
+
+    case TOPIC_BUS_BATCH:
+    case TOPIC_BUS_STATS:
+        return MSGBUS_PRIO_DEFAULT;
+
+    default:
+        return MSG_TOPIC_GET_PRIO(bus_msg->topic);
+    }
+}
+
+/* 控制消息放入控制通道，通道由空变为非空时向系统通道写入一条唤醒消息 */
+static int32_t msgbus_lane_push(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    lane_msg_t *lane_msg;
+    msgbus_msg_t wakeup_msg = {0};
+    uint32_t pending;
+
+    lane_msg = MBUS_MALLOC(sizeof(lane_msg_t) + bus_msg->len);
+    MBUS_ASSERT(lane_msg);
+    if (lane_msg == NULL)
+    {
+        return -1;
+    }
+    memcpy(&lane_msg->msg, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
+    MBUS_LOCK(&ctx->lane_lock);
+    list_add_tail(&lane_msg->node, &ctx->ctrl_lane);
+    pending = MBUS_ATOMIC_ADD(&ctx->lane_pending, 1);
+    MBUS_UNLOCK(&ctx->lane_lock);
+    if (pending == 1)
+    {
+        wakeup_msg.topic = TOPIC_BUS_LANE;
+        wakeup_msg.user_id = LOCAL_BUS_ID;
+        if (ctx->channel_write_handler(ctx->sys_channel, &wakeup_msg, sizeof(msgbus_msg_t), MSGBUS_PRIO_CONTROL) != 0)
+        { // 系统通道已满时系统线程仍有消息要处理，处理下一条消息前会先处理控制通道
+            MBUS_LOG_W("[MBUS] wakeup system channel for control topic %" PRIu32 " failed\r\n", bus_msg->topic);
+        }
+    }
+
+    return 0;
+}
+
+/* 按消息类型选择入口通道，不分片时控制消息进入控制通道，分片时按消息类型广播、拆分或按主题选择分片 */
+static int32_t msgbus_ingress_route(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    int prio = msgbus_ingress_prio(bus_msg);
+
+    if (ctx->shard_num == 0)
+    {
+        if (prio == MSGBUS_PRIO_CONTROL)
+        {
+            return msgbus_lane_push(ctx, bus_msg);
+        }
+        return ctx->channel_write_handler(ctx->sys_channel, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+    }
+    if (msgbus_is_control_msg(bus_msg->topic))
+    {
+        return msgbus_shard_broadcast(ctx, bus_msg);
+    }
+    switch (bus_msg->topic)
+    {
+    case TOPIC_BUS_BATCH:
+        return msgbus_shard_write_batch(ctx, bus_msg);
+
+    case TOPIC_BUS_LOANED:
+        return ctx->channel_write_handler(
+            msgbus_ingress_channel(ctx, ((topic_loan_data_t *)bus_msg->msg_data)->loan_msg->topic),
+            bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+
+    case MSG_TOPIC_EXT_MULTICAST: // 按原消息的主题选择分片，与同一主题的单播消息保持顺序
+        return ctx->channel_write_handler(msgbus_ingress_channel(ctx, msgbus_multicast_topic(bus_msg)),
+                                          bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+
+    case TOPIC_BUS_STATS: // 主题表只在所有分片同步时修改，由任一分片遍历即可
+        return ctx->channel_write_handler(ctx->shard_channel[0], bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+
+    default:
+        return ctx->channel_write_handler(msgbus_ingress_channel(ctx, bus_msg->topic),
+                                          bus_msg, SIZEOF_MSGBUS_MSG(bus_msg), prio);
+    }
+}
+
+/* 写入总线的入口通道，直接派发模式下统计排队中的本地发布消息，派发后由系统线程或分片减去 */
+static int32_t msgbus_ingress_write(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    int32_t res;
+
+    if (!ctx->direct_flag || !msgbus_is_local_publish(ctx, bus_msg) ||
+        (ctx->shard_num && bus_msg->topic == TOPIC_BUS_BATCH))
+    { // 分片时批量消息在拆分时按分片统计
+        return msgbus_ingress_route(ctx, bus_msg);
+    }
+    MBUS_ATOMIC_ADD(&ctx->direct_queued, 1);
+    res = msgbus_ingress_route(ctx, bus_msg);
+    if (res != 0)
+    {
+        MBUS_ATOMIC_SUB(&ctx->direct_queued, 1);
+    }
+
+    return res;
+}
+
+static void msgbus_dispatch(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    switch (bus_msg->topic)
+    {
+    case TOPIC_BUS_SUB:
+        msgbus_proc_event_subscribe(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_UNSUB:
+        msgbus_proc_event_unsubscribe(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_SYNC:
+        msgbus_proc_event_sync(ctx);
+        break;
+
+    case TOPIC_BUS_EXT_SYNC:
+        msgbus_proc_event_ext_sync(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_EXT_DELTA:
+        msgbus_proc_event_ext_delta(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_EXT_ACK:
+        msgbus_proc_event_ext_ack(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_LOANED:
+        msgbus_proc_event_loaned(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_BATCH:
+        msgbus_proc_event_batch(ctx, bus_msg);
+        break;
+
+    case MSG_TOPIC_EXT_MULTICAST:
+        msgbus_proc_event_multicast(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_STATS:
+        msgbus_proc_event_stats(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_BACKPRESSURE:
+        msgbus_proc_event_backpressure(ctx, bus_msg);
+        break;
+
+    case TOPIC_BUS_LANE: // 唤醒消息，控制通道已在派发前处理
+        break;
+
+    default:
+        msgbus_proc_event_publish(ctx, bus_msg, NULL);
+        break;
+    }
+}
+
+/* 取出控制通道中的全部消息，按写入顺序处理 */
+static void msgbus_lane_drain(msgbus_context_t *ctx)
+{
+    LIST_HEAD(lane_list);
+    lane_msg_t *lane_msg, *n;
+
+    MBUS_LOCK(&ctx->lane_lock);
+    list_splice_init(&ctx->ctrl_lane, &lane_list);
+    MBUS_ATOMIC_STORE(&ctx->lane_pending, 0);
+    MBUS_UNLOCK(&ctx->lane_lock);
+    list_for_each_entry_safe(lane_msg, n, &lane_list, node)
+    {
+        msgbus_dispatch(ctx, &lane_msg->msg);
+        MBUS_FREE(lane_msg);
+    }
+}
+
+void msgbus_system_msg_handler_ex(msgbus_t *bus, msgbus_msg_t *bus_msg)
+{
+    msgbus_context_t *ctx = bus;
+    msgbus_msg_t *wire_msg;
+    msgbus_msg_t *inner_msg;
+    int counted;
+
+    if (bus_msg->topic == MSG_TOPIC_EXT_COMPACT)
+    { // 移植层原样转入的紧凑格式帧，user_id为来源总线，还原后按原消息处理
+        wire_msg = msgbus_wire_decode(bus_msg->msg_data, bus_msg->len, bus_msg->user_id);
+        if (wire_msg)
+        {
+            msgbus_system_msg_handler_ex(bus, wire_msg);
+            MBUS_FREE(wire_msg);
+        }
+        return;
+    }
+    if (bus_msg->topic == MSG_TOPIC_EXT_MULTICAST && (inner_msg = msgbus_multicast_inner(bus_msg)) != NULL &&
+        inner_msg->topic == MSG_TOPIC_EXT_COMPACT)
+    { // 原消息为紧凑格式的组播帧，本地总线在目的总线表中时还原，只接受用户主题
+        if (!MSGBUS_MULTICAST_HAS((msgbus_multicast_t *)bus_msg->msg_data, LOCAL_BUS_ID))
+        {
+            return;
+        }
+        wire_msg = msgbus_wire_decode(inner_msg->msg_data, inner_msg->len, inner_msg->user_id);
+        if (wire_msg)
+        {
+            if (GET_USER_TOPIC(wire_msg->topic) < MSG_TOPIC_SYSTEM_TOPIC_MAX)
+            {
+                msgbus_system_msg_handler_ex(bus, wire_msg);
+            }
+            MBUS_FREE(wire_msg);
+        }
+        return;
+    }
+    if (ctx->shard_num)
+    { // 分片模式下系统通道只做转发
+        msgbus_ingress_write(ctx, bus_msg);
+        return;
+    }
+    // 控制通道优先，系统通道中积压再多发布消息，控制消息也最多等待当前这一条
+    if (MBUS_ATOMIC_LOAD_RELAXED(&ctx->lane_pending))
+    {
+        msgbus_lane_drain(ctx);
+    }
+    if (MBUS_ATOMIC_LOAD_RELAXED(&ctx->backlog_total))
+    { // 订阅通道可能已被读出空间，补写溢出环中积压的消息
+        msgbus_backlog_flush_all(ctx);
+    }
+    counted = ctx->direct_flag && msgbus_is_local_publish(ctx, bus_msg);
+    msgbus_dispatch(ctx, bus_msg);
+    if (counted)
+    { // 派发改写了消息头，需在派发前判断；派发完成后发布线程才能直接派发
+        MBUS_ATOMIC_SUB(&ctx->direct_queued, 1);
+    }
+    if (ctx->coalesce_us && MBUS_ATOMIC_LOAD_RELAXED(&ctx->egress_pending))
+    { // 发送已到期的合并帧，总线空闲时由msgbus_flush_poll发送
+        msgbus_egress_poll(ctx, 0, NULL);
+    }
+}
+
+/* 分片通道中的消息所在的分片，与写入时选择分片的规则一致 */
+static uint32_t msgbus_shard_of_msg(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    switch (bus_msg->topic)
+    {
+    case TOPIC_BUS_LANE:
+        return bus_msg->user_id % ctx->shard_num;
+
+    case TOPIC_BUS_STATS:
+        return 0;
+
+    case TOPIC_BUS_BATCH: // 拆分后的批量消息只含本分片的条目
+        if (bus_msg->len < sizeof(msgbus_msg_t))
+        {
+            return 0;
+        }
+        return msgbus_shard_of(ctx, ((msgbus_msg_t *)bus_msg->msg_data)->topic);
+
+    case TOPIC_BUS_LOANED:
+        return msgbus_shard_of(ctx, ((topic_loan_data_t *)bus_msg->msg_data)->loan_msg->topic);
+
+    case MSG_TOPIC_EXT_MULTICAST:
+        return msgbus_shard_of(ctx, msgbus_multicast_topic(bus_msg));
+
+    default:
+        return msgbus_shard_of(ctx, bus_msg->topic);
+    }
+}
+
+/* 控制消息会修改主题表，最后到达的分片执行，其他分片等待执行完成，执行期间没有分片在读主题表。
+ * 控制消息在广播时已放入所有分片的控制通道，各分片都会到达 */
+static void msgbus_shard_barrier(msgbus_context_t *ctx, msgbus_msg_t *bus_msg)
+{
+    uint32_t gen;
+
+    gen = MBUS_ATOMIC_LOAD(&ctx->shard_gen);
+    if (MBUS_ATOMIC_ADD(&ctx->shard_arrive, 1) == ctx->shard_num)
+    {
+        msgbus_dispatch(ctx, bus_msg);
+        MBUS_ATOMIC_STORE(&ctx->shard_arrive, 0);
+        MBUS_ATOMIC_STORE(&ctx->shard_gen, gen + 1);
+        return;
+    }
+    while (MBUS_ATOMIC_LOAD(&ctx->shard_gen) == gen)
+    {
+        MBUS_YIELD();
+    }
+}
+
+/* 处理分片控制通道中的消息，最后处理完的分片释放消息 */
+static void msgbus_shard_lane_drain(msgbus_context_t *ctx, uint32_t shard)
+{
+    shard_lane_t *lane = &ctx->shard_lane[shard];
+    LIST_HEAD(lane_list);
+    struct list_head *pos, *n;
+    shard_lane_msg_t *lane_msg;
+
+    MBUS_LOCK(&lane->lock);
+    list_splice_init(&lane->list, &lane_list);
+    MBUS_ATOMIC_STORE(&lane->pending, 0);
+    MBUS_UNLOCK(&lane->lock);
+    list_for_each_safe(pos, n, &lane_list)
+    {
+        lane_msg = list_entry(pos - shard, shard_lane_msg_t, node[0]);
+        msgbus_shard_barrier(ctx, &lane_msg->msg);
+        if (MBUS_ATOMIC_SUB(&lane_msg->ref, 1) == 0)
+        {
+            MBUS_FREE(lane_msg);
+        }
+    }
+}
+
+void msgbus_shard_msg_handler_ex(msgbus_t *bus, msgbus_msg_t *bus_msg)
+{
+    msgbus_context_t *ctx = bus;
+    uint32_t shard = msgbus_shard_of_msg(ctx, bus_msg);
+    int counted;
+
+    // 控制通道优先，与不分片时系统线程的处理顺序一致
+    if (MBUS_ATOMIC_LOAD_RELAXED(&ctx->shard_lane[shard].pending))
+    {
+        msgbus_shard_lane_drain(ctx, shard);
+    }
+    if (bus_msg->topic == TOPIC_BUS_LANE)
+    {
+        return;
+    }
+    if (MBUS_ATOMIC_LOAD_RELAXED(&ctx->backlog_total))
+    {
+        msgbus_backlog_flush_all(ctx);
+    }
+    counted = ctx->direct_flag && msgbus_is_local_publish(ctx, bus_msg);
+    msgbus_dispatch(ctx, bus_msg);
+    if (counted)
+    {
+        MBUS_ATOMIC_SUB(&ctx->direct_queued, 1);
+    }
+    if (ctx->coalesce_us && MBUS_ATOMIC_LOAD_RELAXED(&ctx->egress_pending))
+    {
+        msgbus_egress_poll(ctx, 0, NULL);
+    }
+}
+
+static int32_t msgbus_context_init(msgbus_context_t *ctx, msgbus_config_t *config)
+{
+    memset(ctx, 0, sizeof(msgbus_context_t));
+    INIT_LIST_HEAD(&ctx->ctrl_lane);
+    for (uint32_t i = 0; i < MBUS_SHARD_MAX; i++)
+    {
+        INIT_LIST_HEAD(&ctx->shard_lane[i].list);
+    }
+    for (uint32_t i = 0; i < MSGBUS_EXT_BUS_MAX; i++)
+    {
+        INIT_LIST_HEAD(&ctx->ext_peer[i].log);
+    }
+
+    ctx->sys_channel = config->system_channel;
+    ctx->ext_bus_channel = config->port_channel;
+    ctx->channel_write_handler = config->channel_msg_write_handler;
+    ctx->channel_writev_handler = config->channel_msg_writev_handler;
+    ctx->channel_wait_handler = config->channel_wait_handler;
+    ctx->channel_fd_handler = config->channel_fd_handler;
+    ctx->selfness_flag = config->is_selfness;
+    ctx->bus_id = config->local_bus_id;
+    ctx->direct_flag = config->is_direct_dispatch;
+    ctx->multicast_flag = config->is_ext_multicast;
+    ctx->compact_flag = config->is_ext_compact;
+    bitmap_copy(&ctx->ext_bus_map, &config->ext_bus_map);
+    if (config->shard_num > MBUS_SHARD_MAX || (config->shard_num && config->shard_channel_list == NULL))
+    {
+        MBUS_LOG_E("[MBUS] invalid shard num %" PRIu32 "\r\n", (uint32_t)config->shard_num);
+        return -1;
+    }
+    ctx->shard_num = config->shard_num;
+    for (uint32_t i = 0; i < ctx->shard_num; i++)
+    {
+        ctx->shard_channel[i] = config->shard_channel_list[i];
+    }
+    // 合并帧至少能放下两条空消息，否则合并没有意义
+    if (config->ext_coalesce_bytes && config->ext_coalesce_bytes < sizeof(msgbus_msg_t) * 3)
+    {
+        MBUS_LOG_E("[MBUS] invalid ext coalesce bytes %" PRIu32 "\r\n", config->ext_coalesce_bytes);
+        return -1;
+    }
+    ctx->coalesce_bytes = MSGBUS_BATCH_ALIGN(config->ext_coalesce_bytes);
+    ctx->coalesce_us = config->ext_coalesce_us;
+
+    ctx->topic_tree = RB_ROOT;
+    ctx->range_tree = RB_ROOT;
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+    if (topic_index_init(&ctx->topic_index, topic_index_ops_get(MBUS_TOPIC_INDEX)) != 0)
+    {
+        MBUS_LOG_E("[MBUS] topic index init failed\r\n");
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+/* 释放树中的节点及其订阅用户 */
+static void msgbus_topic_tree_free(struct rb_root *root)
+{
+    struct rb_node *tree_node, *next_node;
+    sub_user_node_t *sub_user, *n;
+
+    // 后序遍历，释放节点前已经取得后继，不会访问已释放的节点
+    for (tree_node = rb_first_postorder(root); tree_node; tree_node = next_node)
+    {
+        topic_node_t *topic_node = container_of(tree_node, topic_node_t, node);
+
+        next_node = rb_next_postorder(tree_node);
+        list_for_each_entry_safe(sub_user, n, &topic_node->sub_user_list, node)
+        {
+            msgbus_sub_user_free(sub_user);
+        }
+        MBUS_FREE(topic_node);
+    }
+    *root = RB_ROOT;
+}
+
+/* 释放主题表、订阅用户和快照，调用前系统线程和发布线程都已停止 */
+static void msgbus_context_deinit(msgbus_context_t *ctx)
+{
+    lane_msg_t *lane_msg, *n;
+    shard_lane_msg_t *shard_lane_msg;
+    struct list_head *pos, *n_pos;
+    sub_channel_t *sub_chan;
+
+    // 系统线程已停止，控制通道中未处理的消息直接丢弃
+    list_for_each_entry_safe(lane_msg, n, &ctx->ctrl_lane, node)
+    {
+        list_del(&lane_msg->node);
+        MBUS_FREE(lane_msg);
+    }
+    ctx->lane_pending = 0;
+    for (uint32_t i = 0; i < ctx->shard_num; i++)
+    {
+        list_for_each_safe(pos, n_pos, &ctx->shard_lane[i].list)
+        {
+            shard_lane_msg = list_entry(pos - i, shard_lane_msg_t, node[0]);
+            list_del(pos);
+            if (--shard_lane_msg->ref == 0)
+            {
+                MBUS_FREE(shard_lane_msg);
+            }
+        }
+        ctx->shard_lane[i].pending = 0;
+    }
+    while ((sub_chan = ctx->sub_chan_list) != NULL)
+    {
+        ctx->sub_chan_list = sub_chan->next;
+        while (sub_chan->backlog)
+        {
+            msgbus_backlog_drop_oldest(ctx, sub_chan);
+        }
+        if (sub_chan->ring)
+        {
+            MBUS_FREE(sub_chan->ring);
+        }
+        MBUS_FREE(sub_chan);
+    }
+    for (uint32_t i = 0; i < MSGBUS_EXT_BUS_MAX; i++)
+    {
+        msgbus_delta_log_clear(&ctx->ext_peer[i], UINT32_MAX);
+        // 未发送的合并帧直接丢弃，需要发送的应在停止前调用msgbus_flush
+        if (ctx->egress[i].frame)
+        {
+            MBUS_FREE(ctx->egress[i].frame);
+            ctx->egress[i].frame = NULL;
+            ctx->egress[i].num = 0;
+        }
+    }
+    ctx->egress_pending = 0;
+    msgbus_topic_tree_free(&ctx->topic_tree);
+    msgbus_topic_tree_free(&ctx->range_tree);
+    if (ctx->sub_hash)
+    {
+        MBUS_FREE(ctx->sub_hash);
+        ctx->sub_hash = NULL;
+        ctx->sub_num = 0;
+    }
+#if MBUS_TOPIC_INDEX != TOPIC_INDEX_RBTREE
+    topic_index_deinit(&ctx->topic_index);
+#endif
+    if (ctx->snapshot)
+    {
+        MBUS_FREE(ctx->snapshot);
+        ctx->snapshot = NULL;
+    }
+}
+
+msgbus_t *msgbus_create(msgbus_config_t *config)
+{
+    msgbus_context_t *ctx;
+    void *mem;
+
+    // 实例按缓存行对齐，多个实例之间不共享缓存行
+    mem = MBUS_SYS_MALLOC(sizeof(msgbus_context_t) + MBUS_CACHELINE_SIZE);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+    ctx = (msgbus_context_t *)(((uintptr_t)mem + MBUS_CACHELINE_SIZE - 1) & ~(uintptr_t)(MBUS_CACHELINE_SIZE - 1));
+    if (msgbus_context_init(ctx, config) != 0)
+    {
+        MBUS_SYS_FREE(mem);
+        return NULL;
+    }
+    ctx->mem = mem;
+
+    return ctx;
+}
+
+void msgbus_destroy(msgbus_t *bus)
+{
+    msgbus_context_t *ctx = bus;
+
+    if (ctx == NULL)
+    {
+        return;
+    }
+    msgbus_context_deinit(ctx);
+    if (ctx->mem)
+    {
+        MBUS_SYS_FREE(ctx->mem);
+    }
+}
+
+msgbus_t *msgbus_default(void)
+{
+    return &msgbus_default_ctx;
+}
+
+static void msgbus_topic_sift_down(msgbus_topic_t *topic_list, uint32_t root, uint32_t topic_num)
+{
+    msgbus_topic_t topic = topic_list[root];
+    uint32_t child;
+
+    while ((child = root * 2 + 1) < topic_num)
+    {
+        if (child + 1 < topic_num && GET_USER_TOPIC(topic_list[child + 1]) > GET_USER_TOPIC(topic_list[child]))
+        {
+            child++;
+        }
+        if (GET_USER_TOPIC(topic_list[child]) <= GET_USER_TOPIC(topic))
+        {
+            break;
+        }
+        topic_list[root] = topic_list[child];
+        root = child;
+    }
+    topic_list[root] = topic;
+}
+
+/* 按用户主题对主题列表堆排序，不依赖C库，系统线程收到后可以与主题表按顺序合并 */
+static void msgbus_topic_sort(msgbus_topic_t *topic_list, uint32_t topic_num)
+{
+    msgbus_topic_t topic;
+
+    for (uint32_t i = topic_num / 2; i-- > 0;)
+    {
+        msgbus_topic_sift_down(topic_list, i, topic_num);
+    }
+    for (uint32_t end = topic_num; end-- > 1;)
+    {
+        topic = topic_list[0];
+        topic_list[0] = topic_list[end];
+        topic_list[end] = topic;
+        msgbus_topic_sift_down(topic_list, 0, end);
+    }
+}
+
+/* 主题范围列表是否有效：下限不为0且不大于上限，上限在用户主题内 */
+static int msgbus_range_list_valid(const msgbus_topic_range_t *range_list, int range_num)
+{
+    if (range_list == NULL || range_num <= 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < range_num; i++)
+    {
+        uint32_t topic_lo = GET_USER_TOPIC(range_list[i].topic_lo);
+        uint32_t topic_hi = GET_USER_TOPIC(range_list[i].topic_hi);
+
+        if (topic_lo == MSG_TOPIC_NULL || topic_lo > topic_hi || topic_hi >= MSG_TOPIC_USER_MAX)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int32_t msgbus_subscribe_common(msgbus_context_t *ctx, uint32_t bus_topic, msgbus_channel_t channel,
+                                       msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num,
+                                       const msgbus_topic_range_t *range_list, int range_num,
+                                       msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    msgbus_msg_t *bus_msg;
+    uint32_t sort_num;
+    int32_t res = 0;
+
+    MBUS_LOG_D("[MBUS] msgbus_subscribe ,user:%" PRIu32 ",topic num:%" PRIu32 ",range num:%" PRIu32 "\r\n",
+               user_id, topic_num, range_num);
+    MBUS_ASSERT(topic_num || range_num);
+
+    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_sub_data_t) + sizeof(msgbus_topic_t) * topic_num +
+                          sizeof(msgbus_topic_range_t) * range_num);
+    MBUS_ASSERT(bus_msg);
+    bus_msg->topic = bus_topic;
+    bus_msg->len = sizeof(topic_sub_data_t) + sizeof(msgbus_topic_t) * topic_num +
+                   sizeof(msgbus_topic_range_t) * range_num;
+    topic_sub_data_t *topic_sub_data = (topic_sub_data_t *)bus_msg->msg_data;
+    topic_sub_data->channel = channel;
+    topic_sub_data->user_id = user_id;
+    topic_sub_data->sub_cb = sub_cb;
+    topic_sub_data->cb_ctx = cb_ctx;
+    topic_sub_data->topic_num = topic_num;
+    topic_sub_data->range_num = range_num;
+    if (topic_num)
+    {
+        memcpy(topic_sub_data->topic_list, topic_list, sizeof(msgbus_topic_t) * topic_num);
+    }
+    if (range_num)
+    {
+        memcpy(&topic_sub_data->topic_list[topic_num], range_list, sizeof(msgbus_topic_range_t) * range_num);
+    }
+    // 主题0表示列表结束，只对之前的部分排序，排序在调用者线程中完成，不占用系统线程
+    sort_num = 0;
+    while (sort_num < (uint32_t)topic_num && topic_list[sort_num])
+    {
+        sort_num++;
+    }
+    msgbus_topic_sort(topic_sub_data->topic_list, sort_num);
+    res = msgbus_ingress_write(ctx, bus_msg);
+    MBUS_FREE(bus_msg);
+    return res;
+}
+
+int msgbus_subscribe_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                        const msgbus_topic_t *topic_list, int topic_num)
+{
+    return msgbus_subscribe_common(bus, TOPIC_BUS_SUB, channel, user_id, topic_list, topic_num, NULL, 0, NULL, NULL);
+}
+
+int msgbus_subscribe_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_t *topic_list,
+                           int topic_num, msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    if (sub_cb == NULL)
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_SUB, NULL, user_id, topic_list, topic_num, NULL, 0, sub_cb, cb_ctx);
+}
+
+int msgbus_unsubscribe_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                          const msgbus_topic_t *topic_list, int topic_num)
+{
+    return msgbus_subscribe_common(bus, TOPIC_BUS_UNSUB, channel, user_id, topic_list, topic_num, NULL, 0, NULL, NULL);
+}
+
+int msgbus_unsubscribe_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_t *topic_list,
+                             int topic_num, msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    if (sub_cb == NULL)
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_UNSUB, NULL, user_id, topic_list, topic_num, NULL, 0, sub_cb, cb_ctx);
+}
+
+int msgbus_subscribe_range_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                              const msgbus_topic_range_t *range_list, int range_num)
+{
+    if (!msgbus_range_list_valid(range_list, range_num))
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_SUB, channel, user_id, NULL, 0, range_list, range_num, NULL, NULL);
+}
+
+int msgbus_subscribe_range_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                                 int range_num, msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    if (sub_cb == NULL || !msgbus_range_list_valid(range_list, range_num))
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_SUB, NULL, user_id, NULL, 0, range_list, range_num, sub_cb, cb_ctx);
+}
+
+int msgbus_unsubscribe_range_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                                const msgbus_topic_range_t *range_list, int range_num)
+{
+    if (!msgbus_range_list_valid(range_list, range_num))
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_UNSUB, channel, user_id, NULL, 0, range_list, range_num, NULL, NULL);
+}
+
+int msgbus_unsubscribe_range_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                                   int range_num, msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    if (sub_cb == NULL || !msgbus_range_list_valid(range_list, range_num))
+    {
+        return -1;
+    }
+    return msgbus_subscribe_common(bus, TOPIC_BUS_UNSUB, NULL, user_id, NULL, 0, range_list, range_num, sub_cb, cb_ctx);
+}
+
+int msgbus_channel_backpressure_ex(msgbus_t *bus, msgbus_channel_t channel, const msgbus_backpressure_t *bp)
+{
+    msgbus_context_t *ctx = bus;
+    char buff[sizeof(msgbus_msg_t) + sizeof(topic_bp_data_t)];
+    msgbus_msg_t *bus_msg = (msgbus_msg_t *)buff;
+    topic_bp_data_t *bp_data = (topic_bp_data_t *)bus_msg->msg_data;
+
+    if (channel == NULL || bp == NULL || (uint32_t)bp->policy > MSGBUS_BP_SPILL ||
+        (bp->policy == MSGBUS_BP_DROP_OLDEST && bp->queue_len == 0) ||
+        (bp->policy == MSGBUS_BP_BLOCK && bp->timeout_ms < 0) ||
+        (bp->policy == MSGBUS_BP_SPILL && bp->spill_channel == NULL))
+    {
+        return -1;
+    }
+    bus_msg->topic = TOPIC_BUS_BACKPRESSURE;
+    bus_msg->len = sizeof(topic_bp_data_t);
+    bus_msg->user_id = LOCAL_BUS_ID;
+    bp_data->channel = channel;
+    bp_data->bp = *bp;
+
+    return msgbus_ingress_write(ctx, bus_msg);
+}
+
+int msgbus_channel_backpressure_stats_ex(msgbus_t *bus, msgbus_channel_t channel,
+                                         msgbus_backpressure_stats_t *stats)
+{
+    sub_channel_t *sub_chan = msgbus_sub_channel_find(bus, channel);
+
+    if (sub_chan == NULL)
+    {
+        return -1;
+    }
+    stats->queue_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->stats.queue_cnt);
+    stats->spill_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->stats.spill_cnt);
+    stats->block_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->stats.block_cnt);
+    stats->drop_newest_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->stats.drop_newest_cnt);
+    stats->drop_oldest_cnt = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->stats.drop_oldest_cnt);
+    stats->backlog = MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->backlog);
+
+    return 0;
+}
+
+int msgbus_wait_ex(msgbus_t *bus, msgbus_channel_t channel, int timeout_ms)
+{
+    msgbus_context_t *ctx = bus;
+    sub_channel_t *sub_chan = msgbus_sub_channel_find(ctx, channel);
+
+    if (sub_chan && MBUS_ATOMIC_LOAD_RELAXED(&sub_chan->backlog))
+    { // 接收线程读出了通道空间，由接收线程补写积压的消息，不必等待下一次派发
+        MBUS_LOCK(&sub_chan->lock);
+        msgbus_backlog_flush(ctx, sub_chan);
+        MBUS_UNLOCK(&sub_chan->lock);
+    }
+    if (ctx->channel_wait_handler == NULL)
+    {
+        return -1;
+    }
+    return ctx->channel_wait_handler(channel, timeout_ms);
+}
+
+int msgbus_channel_fd_ex(msgbus_t *bus, msgbus_channel_t channel)
+{
+    msgbus_context_t *ctx = bus;
+
+    if (ctx->channel_fd_handler == NULL)
+    {
+        return -1;
+    }
+    return ctx->channel_fd_handler(channel);
+}
+
+int msgbus_ext_input_ex(msgbus_t *bus, msgbus_user_t src_bus_id, const void *data, int len)
+{
+    msgbus_context_t *ctx = bus;
+    msgbus_msg_t *bus_msg;
+    int32_t res;
+
+    if (data == NULL || len <= 0 || src_bus_id == 0 || src_bus_id > MSGBUS_EXT_BUS_MAX)
+    {
+        return -1;
+    }
+    bus_msg = msgbus_wire_decode(data, (uint32_t)len, src_bus_id);
+    if (bus_msg == NULL)
+    {
+        return -1;
+    }
+    res = ctx->channel_write_handler(ctx->sys_channel, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg),
+                                     msgbus_ingress_prio(bus_msg));
+    MBUS_FREE(bus_msg);
+
+    return res;
+}
+
+int msgbus_flush_ex(msgbus_t *bus)
+{
+    int32_t err = 0;
+
+    msgbus_egress_poll(bus, 1, &err);
+    return err;
+}
+
+int msgbus_flush_poll_ex(msgbus_t *bus)
+{
+    int64_t next_us = msgbus_egress_poll(bus, 0, NULL);
+
+    return next_us > INT32_MAX ? INT32_MAX : (int)next_us;
+}
+
+int msgbus_sync_ex(msgbus_t *bus)
+{
+    msgbus_context_t *ctx = bus;
+    msgbus_msg_t msg = {0};
+
+    msg.topic = TOPIC_BUS_SYNC;
+
+    return msgbus_ingress_write(ctx, &msg);
+}
+
+int msgbus_publish_ex(msgbus_t *bus, msgbus_topic_t topic, const void *data, int data_len)
+{
+    msgbus_context_t *ctx = bus;
+    msgbus_msg_t *bus_msg;
+    int32_t res = 0;
+
+    if (topic == MSG_TOPIC_NULL || GET_USER_TOPIC(topic) >= MSG_TOPIC_USER_MAX)
+    {
+        return -1;
     }
+    MBUS_TRACE(MSGBUS_TRACE_PUBLISH, topic, LOCAL_BUS_ID, data_len);
+    MBUS_STAT_ADD(&ctx->counter.publish_cnt, 1);
+    if (ctx->channel_writev_handler && !ctx->direct_flag)
+    { // 消息头与数据分段提交给通道，不需要申请内存拷贝
+        msgbus_msg_t msg = {0};
+        msgbus_iovec_t iov[2];
 
-    return 0;
+        msg.topic = topic;
+        msg.len = data_len;
+        msg.user_id = LOCAL_BUS_ID;
+        iov[0].base = &msg;
+        iov[0].len = sizeof(msgbus_msg_t);
+        iov[1].base = data;
+        iov[1].len = data_len;
+        return ctx->channel_writev_handler(msgbus_ingress_channel(ctx, topic), iov,
+                                           (data != NULL && data_len) ? 2 : 1, MSG_TOPIC_GET_PRIO(topic));
+    }
+    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + data_len);
+    MBUS_ASSERT(bus_msg);
+    bus_msg->topic = topic;
+    bus_msg->len = data_len;
+    bus_msg->user_id = LOCAL_BUS_ID;
+    if (data != NULL && data_len)
+    {
+        memcpy(bus_msg->msg_data, data, data_len);
+    }
+    if (msgbus_direct_ready(ctx))
+    { // 同步完成后直接在发布线程派发，不再经过系统通道
+        uint32_t epoch;
+        topic_snapshot_t *snapshot = msgbus_snapshot_enter(ctx, &epoch);
+
+        if (snapshot)
+        {
+            res = msgbus_snapshot_publish(ctx, snapshot, bus_msg, NULL);
+            msgbus_snapshot_exit(ctx, epoch);
+            MBUS_FREE(bus_msg);
+            return res;
+        }
+        msgbus_snapshot_exit(ctx, epoch);
+    }
+    res = msgbus_ingress_write(ctx, bus_msg);
+    MBUS_FREE(bus_msg);
+
+    return res;
 }
 
-static int32_t msgbus_proc_event_subscribe(msgbus_msg_t *bus_msg)
+/* 将消息列表按批量消息格式依次填入bus_msg */
+static void msgbus_batch_fill(msgbus_context_t *ctx, msgbus_msg_t *bus_msg, const msgbus_pub_item_t *item_list, int item_num)
 {
-    topic_node_t *topic_node;
-    uint32_t in_list = 0;
-    struct slist_head *pos;
-    uint32_t user_topic = 0;
-    sub_user_node_t *sub_user_node;
-    topic_sub_data_t *topic_sub_data = (topic_sub_data_t *)bus_msg->msg_data;
+    uint32_t offset = 0;
+    msgbus_msg_t *item_msg;
 
-    MBUS_PRINTF("[MBUS] proc event sub, user: %" PRIu32 " topic num: %" PRIu32 ",\r\n",
-                (uint32_t)topic_sub_data->user_id,
-                topic_sub_data->topic_num);
-    for (size_t i = 0; i < topic_sub_data->topic_num; i++)
+    for (int i = 0; i < item_num; i++)
     {
-        if (topic_sub_data->topic_list[i] == 0)
+        item_msg = (msgbus_msg_t *)(bus_msg->msg_data + offset);
+        item_msg->topic = item_list[i].topic;
+        item_msg->len = item_list[i].data_len;
+        item_msg->user_id = LOCAL_BUS_ID;
+        if (item_list[i].data != NULL && item_list[i].data_len)
         {
-            break;
+            memcpy(item_msg->msg_data, item_list[i].data, item_list[i].data_len);
         }
-        in_list = 0;
-        user_topic = GET_USER_TOPIC(topic_sub_data->topic_list[i]);
-        MBUS_PRINTF("[MBUS] subscribe, topic key: %" PRIu32 "\r\n", user_topic);
-        topic_node = msg_topic_search(&msgbus_ctx.topic_tree, user_topic);
-        if (topic_node == NULL)
-        { // 当前主题不存在，新建
-            topic_node = msgbus_create_topic_node(user_topic);
-            msgbus_ctx.topic_local_num++;
+        offset += sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN(item_msg->len);
+    }
+}
+
+static int32_t msgbus_batch_writev(msgbus_context_t *ctx, const msgbus_pub_item_t *item_list, int item_num, uint32_t batch_len)
+{
+    msgbus_msg_t *msg_head;
+    msgbus_iovec_t *iov;
+    int iov_num = 0;
+    int32_t res;
+
+    // 消息头与分段描述一次申请，消息数据直接提交给通道
+    msg_head = MBUS_MALLOC(sizeof(msgbus_msg_t) * (item_num + 1) + sizeof(msgbus_iovec_t) * (item_num * 3 + 1));
+    MBUS_ASSERT(msg_head);
+    if (msg_head == NULL)
+    {
+        return -1;
+    }
+    iov = (msgbus_iovec_t *)&msg_head[item_num + 1];
+    msg_head[0].topic = TOPIC_BUS_BATCH;
+    msg_head[0].len = batch_len;
+    msg_head[0].user_id = LOCAL_BUS_ID;
+    iov[iov_num].base = &msg_head[0];
+    iov[iov_num++].len = sizeof(msgbus_msg_t);
+    for (int i = 0; i < item_num; i++)
+    {
+        uint32_t data_len = item_list[i].data_len;
+
+        msg_head[i + 1].topic = item_list[i].topic;
+        msg_head[i + 1].len = data_len;
+        msg_head[i + 1].user_id = LOCAL_BUS_ID;
+        iov[iov_num].base = &msg_head[i + 1];
+        iov[iov_num++].len = sizeof(msgbus_msg_t);
+        if (item_list[i].data != NULL && data_len)
+        {
+            iov[iov_num].base = item_list[i].data;
+            iov[iov_num++].len = data_len;
         }
-        else
+        if (MSGBUS_BATCH_ALIGN(data_len) != data_len)
         {
-            // 检查主题下的订阅列表，判断订阅用户是否为重复订阅
-            slist_for_each(pos, &topic_node->sub_user_list)
+            iov[iov_num].base = msgbus_batch_pad;
+            iov[iov_num++].len = MSGBUS_BATCH_ALIGN(data_len) - data_len;
+        }
+    }
+    res = ctx->channel_writev_handler(ctx->sys_channel, iov, iov_num, MSGBUS_PRIO_DEFAULT);
+    MBUS_FREE(msg_head);
+
+    return res;
+}
+
+int msgbus_publish_batch_ex(msgbus_t *bus, const msgbus_pub_item_t *item_list, int item_num)
+{
+    msgbus_context_t *ctx = bus;
+    msgbus_msg_t *bus_msg;
+    uint32_t batch_len = 0, item_size;
+    int32_t res = 0;
+
+    if (item_list == NULL || item_num <= 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < item_num; i++)
+    {
+        if (item_list[i].topic == MSG_TOPIC_NULL ||
+            GET_USER_TOPIC(item_list[i].topic) >= MSG_TOPIC_USER_MAX ||
+            item_list[i].data_len < 0)
+        {
+            return -1;
+        }
+        // 逐条检查，避免累加溢出
+        item_size = sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN((uint32_t)item_list[i].data_len);
+        if (item_size > MSGBUS_BATCH_LEN_MAX - batch_len)
+        {
+            return -1;
+        }
+        batch_len += item_size;
+    }
+    MBUS_TRACE(MSGBUS_TRACE_PUBLISH, TOPIC_BUS_BATCH, LOCAL_BUS_ID, batch_len);
+    MBUS_STAT_ADD(&ctx->counter.publish_cnt, item_num);
+    if (ctx->channel_writev_handler && !ctx->direct_flag && !ctx->shard_num)
+    { // 分片时整批消息需要按分片拆分，不使用聚合写入
+        return msgbus_batch_writev(ctx, item_list, item_num, batch_len);
+    }
+    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + batch_len);
+    MBUS_ASSERT(bus_msg);
+    if (bus_msg == NULL)
+    {
+        return -1;
+    }
+    bus_msg->topic = TOPIC_BUS_BATCH;
+    bus_msg->len = batch_len;
+    bus_msg->user_id = LOCAL_BUS_ID;
+    msgbus_batch_fill(ctx, bus_msg, item_list, item_num);
+    if (msgbus_direct_ready(ctx))
+    { // 直接派发模式下，整批消息在发布线程中逐条派发
+        uint32_t epoch, offset = 0;
+        topic_snapshot_t *snapshot = msgbus_snapshot_enter(ctx, &epoch);
+
+        if (snapshot)
+        {
+            for (int i = 0; i < item_num; i++)
             {
-                sub_user_node = slist_entry(pos, sub_user_node_t, node);
-                if (sub_user_node->user_id == topic_sub_data->user_id &&
-                    sub_user_node->channel == topic_sub_data->channel)
+                msgbus_msg_t *item_msg = (msgbus_msg_t *)(bus_msg->msg_data + offset);
+
+                offset += sizeof(msgbus_msg_t) + MSGBUS_BATCH_ALIGN(item_msg->len);
+                if (msgbus_snapshot_publish(ctx, snapshot, item_msg, NULL) != 0)
                 {
-                    in_list = 1;
-                    break;
+                    res = -1;
                 }
             }
+            msgbus_snapshot_exit(ctx, epoch);
+            MBUS_FREE(bus_msg);
+            return res;
         }
+        msgbus_snapshot_exit(ctx, epoch);
+    }
+    res = msgbus_ingress_write(ctx, bus_msg);
+    MBUS_FREE(bus_msg);
 
-        if (!in_list)
-        { // 当前用户没有订阅当前主题，创建一个订阅节点
-            sub_user_node = MBUS_MALLOC(sizeof(sub_user_node_t));
-            MBUS_ASSERT(sub_user_node);
-            memset(sub_user_node, 0, sizeof(sub_user_node_t));
-            SINIT_LIST_HEAD(&sub_user_node->node);
-            sub_user_node->user_id = topic_sub_data->user_id;
-            sub_user_node->channel = topic_sub_data->channel;
-            slist_add_tail(&sub_user_node->node, &topic_node->sub_user_list);
-        }
-        if (MSG_TOPIC_IS_LOCAL(topic_sub_data->topic_list[i]))
+    return res;
+}
+
+msgbus_msg_t *msgbus_loan(msgbus_topic_t topic, int data_len)
+{
+    msgbus_shared_buf_t *shared_buf;
+
+    if (topic == MSG_TOPIC_NULL || GET_USER_TOPIC(topic) >= MSG_TOPIC_USER_MAX || data_len < 0)
+    {
+        return NULL;
+    }
+    shared_buf = msgbus_shared_buf_alloc(data_len);
+    if (shared_buf == NULL)
+    {
+        return NULL;
+    }
+    shared_buf->msg.topic = topic;
+    shared_buf->msg.user_id = 0; // 借出的缓冲区不属于任何总线实例，发布时填写总线编号
+
+    return &shared_buf->msg;
+}
+
+int msgbus_publish_loaned_ex(msgbus_t *bus, msgbus_msg_t *loan_msg)
+{
+    msgbus_context_t *ctx = bus;
+    char buff[sizeof(msgbus_msg_t) + sizeof(topic_loan_data_t)];
+    msgbus_msg_t *bus_msg = (msgbus_msg_t *)buff;
+    topic_loan_data_t *topic_loan_data = (topic_loan_data_t *)bus_msg->msg_data;
+    int32_t res = 0;
+
+    if (loan_msg == NULL)
+    {
+        return -1;
+    }
+    if (loan_msg->topic == MSG_TOPIC_NULL || GET_USER_TOPIC(loan_msg->topic) >= MSG_TOPIC_USER_MAX)
+    {
+        msgbus_loan_release(loan_msg);
+        return -1;
+    }
+    loan_msg->user_id = LOCAL_BUS_ID;
+    MBUS_TRACE(MSGBUS_TRACE_PUBLISH, loan_msg->topic, LOCAL_BUS_ID, loan_msg->len);
+    MBUS_STAT_ADD(&ctx->counter.publish_cnt, 1);
+    if (msgbus_direct_ready(ctx))
+    {
+        uint32_t epoch;
+        topic_snapshot_t *snapshot = msgbus_snapshot_enter(ctx, &epoch);
+
+        if (snapshot)
         {
-            sub_user_node->user_local_sub = 1;
+            msgbus_shared_buf_t *shared_buf = container_of(loan_msg, msgbus_shared_buf_t, msg);
+
+            res = msgbus_snapshot_publish(ctx, snapshot, loan_msg, shared_buf);
+            msgbus_snapshot_exit(ctx, epoch);
+            msgbus_shared_buf_put(shared_buf);
+            return res;
         }
+        msgbus_snapshot_exit(ctx, epoch);
+    }
+    bus_msg->topic = TOPIC_BUS_LOANED;
+    bus_msg->len = sizeof(topic_loan_data_t);
+    bus_msg->user_id = LOCAL_BUS_ID;
+    topic_loan_data->loan_msg = loan_msg;
+    res = msgbus_ingress_write(ctx, bus_msg);
+    if (res != 0)
+    { // 未能投递到系统通道，借出的缓冲区由总线回收
+        msgbus_loan_release(loan_msg);
     }
 
-    return 0;
+    return res;
 }
 
-void msgbus_system_msg_handler(msgbus_msg_t *bus_msg)
+void msgbus_loan_release(msgbus_msg_t *loan_msg)
 {
-    switch (bus_msg->topic)
+    if (loan_msg)
     {
-    case TOPIC_BUS_SUB:
-        msgbus_proc_event_subscribe(bus_msg);
-        break;
+        msgbus_shared_buf_put(container_of(loan_msg, msgbus_shared_buf_t, msg));
+    }
+}
 
-    case TOPIC_BUS_SYNC:
-        msgbus_proc_event_sync();
-        break;
+const msgbus_msg_t *msgbus_shared_msg(const msgbus_msg_t *desc_msg)
+{
+    const topic_shared_desc_t *shared_desc = (const topic_shared_desc_t *)desc_msg->msg_data;
 
-    case TOPIC_BUS_EXT_SYNC:
-        msgbus_proc_event_ext_sync(bus_msg);
-        break;
+    if (!MSG_TOPIC_IS_SHARED(desc_msg->topic))
+    { // 不是共享消息描述符，消息本身就是数据
+        return desc_msg;
+    }
 
-    default:
-        msgbus_proc_event_publish(bus_msg);
-        break;
+    return shared_desc->shared_msg;
+}
+
+void msgbus_shared_release(const msgbus_msg_t *desc_msg)
+{
+    const topic_shared_desc_t *shared_desc = (const topic_shared_desc_t *)desc_msg->msg_data;
+
+    if (MSG_TOPIC_IS_SHARED(desc_msg->topic))
+    {
+        msgbus_shared_buf_put(container_of(shared_desc->shared_msg, msgbus_shared_buf_t, msg));
     }
 }
 
-int msgbus_init(msgbus_config_t *config)
+msgbus_msg_t *msgbus_conflated_take(const msgbus_msg_t *desc_msg)
 {
-    memset(&msgbus_ctx, 0, sizeof(msgbus_ctx));
+    conflate_slot_t *slot;
+    msgbus_msg_t *latest;
 
-    msgbus_ctx.sys_channel = config->system_channel;
-    msgbus_ctx.ext_bus_channel = config->port_channel;
-    msgbus_ctx.channel_write_handler = config->channel_msg_write_handler;
-    msgbus_ctx.selfness_flag = config->is_selfness;
-    msgbus_ctx.bus_id = config->local_bus_id;
-    bitmap_copy(&msgbus_ctx.ext_bus_map, &config->ext_bus_map);
+    if (!MSG_TOPIC_IS_CONFLATED(desc_msg->topic))
+    {
+        return NULL;
+    }
+    slot = ((const topic_conflate_desc_t *)desc_msg->msg_data)->slot;
+    latest = MBUS_ATOMIC_XCHG(&slot->latest, NULL);
+    msgbus_conflate_slot_put(slot);
 
-    msgbus_ctx.topic_tree = RB_ROOT;
+    return latest;
+}
 
-    return 0;
+void msgbus_conflated_release(msgbus_msg_t *msg)
+{
+    if (msg)
+    {
+        MBUS_FREE(msg);
+    }
+}
+
+void msgbus_stats_get_ex(msgbus_t *bus, msgbus_stats_t *stats)
+{
+    msgbus_context_t *ctx = bus;
+
+    memset(stats, 0, sizeof(msgbus_stats_t));
+    stats->publish_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->counter.publish_cnt);
+    stats->dispatch_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->counter.dispatch_cnt);
+    stats->no_topic_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->counter.no_topic_cnt);
+    stats->write_fail_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->counter.write_fail_cnt);
+    stats->topic_total = MBUS_ATOMIC_LOAD_RELAXED(&ctx->topic_total);
+    stats->topic_local_num = MBUS_ATOMIC_LOAD_RELAXED(&ctx->topic_local_num);
+    stats->range_total = MBUS_ATOMIC_LOAD_RELAXED(&ctx->range_total);
+    for (uint32_t i = 0; i < MSGBUS_EXT_BUS_MAX; i++)
+    {
+        stats->ext_bus[i].forward_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->ext_bus_stats[i].forward_cnt);
+        stats->ext_bus[i].forward_bytes = MBUS_ATOMIC_LOAD_RELAXED(&ctx->ext_bus_stats[i].forward_bytes);
+        stats->ext_bus[i].forward_fail_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->ext_bus_stats[i].forward_fail_cnt);
+        stats->ext_bus[i].recv_cnt = MBUS_ATOMIC_LOAD_RELAXED(&ctx->ext_bus_stats[i].recv_cnt);
+    }
+}
+
+int msgbus_stats_walk_ex(msgbus_t *bus, msgbus_stats_walk_cb_t walk_cb, void *arg)
+{
+    msgbus_context_t *ctx = bus;
+    char buff[sizeof(msgbus_msg_t) + sizeof(topic_stats_data_t)];
+    msgbus_msg_t *bus_msg = (msgbus_msg_t *)buff;
+    topic_stats_data_t *topic_stats_data = (topic_stats_data_t *)bus_msg->msg_data;
+
+    if (walk_cb == NULL)
+    {
+        return -1;
+    }
+    bus_msg->topic = TOPIC_BUS_STATS;
+    bus_msg->len = sizeof(topic_stats_data_t);
+    bus_msg->user_id = LOCAL_BUS_ID;
+    topic_stats_data->walk_cb = walk_cb;
+    topic_stats_data->arg = arg;
+
+    return msgbus_ingress_write(ctx, bus_msg);
+}
+
+int msgbus_init(msgbus_config_t *config)
+{
+    return msgbus_context_init(&msgbus_default_ctx, config);
 }
 
 int msgbus_subscribe(msgbus_channel_t channel, msgbus_user_t user_id,
                      const msgbus_topic_t *topic_list, int topic_num)
 {
-    msgbus_msg_t *bus_msg;
-    int32_t res = 0;
+    return msgbus_subscribe_ex(&msgbus_default_ctx, channel, user_id, topic_list, topic_num);
+}
+
+int msgbus_subscribe_cb(msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num,
+                        msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    return msgbus_subscribe_cb_ex(&msgbus_default_ctx, user_id, topic_list, topic_num, sub_cb, cb_ctx);
+}
 
-    MBUS_PRINTF("[MBUS] msgbus_subscribe ,user:%" PRIu32 ",topic num:%" PRIu32 "\r\n", user_id, topic_num);
-    MBUS_ASSERT(topic_num);
+int msgbus_unsubscribe(msgbus_channel_t channel, msgbus_user_t user_id,
+                       const msgbus_topic_t *topic_list, int topic_num)
+{
+    return msgbus_unsubscribe_ex(&msgbus_default_ctx, channel, user_id, topic_list, topic_num);
+}
 
-    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + sizeof(topic_sub_data_t) + sizeof(msgbus_topic_t) * topic_num);
-    MBUS_ASSERT(bus_msg);
-    bus_msg->topic = TOPIC_BUS_SUB;
-    bus_msg->len = sizeof(topic_sub_data_t) + sizeof(msgbus_topic_t) * topic_num;
-    topic_sub_data_t *topic_sub_data = (topic_sub_data_t *)bus_msg->msg_data;
-    topic_sub_data->channel = channel;
-    topic_sub_data->user_id = user_id;
-    topic_sub_data->topic_num = topic_num;
-    memcpy(topic_sub_data->topic_list, topic_list, sizeof(msgbus_topic_t) * topic_num);
-    res = msgbus_ctx.channel_write_handler(msgbus_ctx.sys_channel, bus_msg,
-                                           SIZEOF_MSGBUS_MSG(bus_msg));
-    MBUS_FREE(bus_msg);
-    return res;
+int msgbus_unsubscribe_cb(msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num,
+                          msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    return msgbus_unsubscribe_cb_ex(&msgbus_default_ctx, user_id, topic_list, topic_num, sub_cb, cb_ctx);
 }
 
-int msgbus_sync(void)
+int msgbus_subscribe_range(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                           int range_num)
 {
-    msgbus_msg_t msg = {0};
+    return msgbus_subscribe_range_ex(&msgbus_default_ctx, channel, user_id, range_list, range_num);
+}
 
-    msg.topic = TOPIC_BUS_SYNC;
+int msgbus_subscribe_range_cb(msgbus_user_t user_id, const msgbus_topic_range_t *range_list, int range_num,
+                              msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    return msgbus_subscribe_range_cb_ex(&msgbus_default_ctx, user_id, range_list, range_num, sub_cb, cb_ctx);
+}
+
+int msgbus_unsubscribe_range(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                             int range_num)
+{
+    return msgbus_unsubscribe_range_ex(&msgbus_default_ctx, channel, user_id, range_list, range_num);
+}
+
+int msgbus_unsubscribe_range_cb(msgbus_user_t user_id, const msgbus_topic_range_t *range_list, int range_num,
+                                msgbus_sub_cb_t sub_cb, void *cb_ctx)
+{
+    return msgbus_unsubscribe_range_cb_ex(&msgbus_default_ctx, user_id, range_list, range_num, sub_cb, cb_ctx);
+}
+
+int msgbus_channel_backpressure(msgbus_channel_t channel, const msgbus_backpressure_t *bp)
+{
+    return msgbus_channel_backpressure_ex(&msgbus_default_ctx, channel, bp);
+}
+
+int msgbus_channel_backpressure_stats(msgbus_channel_t channel, msgbus_backpressure_stats_t *stats)
+{
+    return msgbus_channel_backpressure_stats_ex(&msgbus_default_ctx, channel, stats);
+}
+
+int msgbus_wait(msgbus_channel_t channel, int timeout_ms)
+{
+    return msgbus_wait_ex(&msgbus_default_ctx, channel, timeout_ms);
+}
 
-    return msgbus_ctx.channel_write_handler(msgbus_ctx.sys_channel, &msg, SIZEOF_MSGBUS_MSG(&msg));
+int msgbus_channel_fd(msgbus_channel_t channel)
+{
+    return msgbus_channel_fd_ex(&msgbus_default_ctx, channel);
+}
+
+int msgbus_ext_input(msgbus_user_t src_bus_id, const void *data, int len)
+{
+    return msgbus_ext_input_ex(&msgbus_default_ctx, src_bus_id, data, len);
+}
+
+int msgbus_flush(void)
+{
+    return msgbus_flush_ex(&msgbus_default_ctx);
+}
+
+int msgbus_flush_poll(void)
+{
+    return msgbus_flush_poll_ex(&msgbus_default_ctx);
+}
+
+int msgbus_sync(void)
+{
+    return msgbus_sync_ex(&msgbus_default_ctx);
 }
 
 int msgbus_publish(msgbus_topic_t topic, const void *data, int data_len)
 {
-    msgbus_msg_t *bus_msg;
-    int32_t res = 0;
+    return msgbus_publish_ex(&msgbus_default_ctx, topic, data, data_len);
+}
 
-    if (topic == MSG_TOPIC_NULL || GET_USER_TOPIC(topic) >= MSG_TOPIC_USER_MAX)
-    {
-        return -1;
-    }
-    bus_msg = MBUS_MALLOC(sizeof(msgbus_msg_t) + data_len);
-    MBUS_ASSERT(bus_msg);
-    bus_msg->topic = topic;
-    bus_msg->len = data_len;
-    bus_msg->user_id = LOCAL_BUS_ID;
-    if (data != NULL && data_len)
-    {
-        memcpy(bus_msg->msg_data, data, data_len);
-    }
-    res = msgbus_ctx.channel_write_handler(msgbus_ctx.sys_channel, bus_msg, SIZEOF_MSGBUS_MSG(bus_msg));
-    MBUS_FREE(bus_msg);
+int msgbus_publish_batch(const msgbus_pub_item_t *item_list, int item_num)
+{
+    return msgbus_publish_batch_ex(&msgbus_default_ctx, item_list, item_num);
+}
 
-    return res;
+int msgbus_publish_loaned(msgbus_msg_t *loan_msg)
+{
+    return msgbus_publish_loaned_ex(&msgbus_default_ctx, loan_msg);
+}
+
+void msgbus_stats_get(msgbus_stats_t *stats)
+{
+    msgbus_stats_get_ex(&msgbus_default_ctx, stats);
+}
+
+int msgbus_stats_walk(msgbus_stats_walk_cb_t walk_cb, void *arg)
+{
+    return msgbus_stats_walk_ex(&msgbus_default_ctx, walk_cb, arg);
+}
+
+void msgbus_system_msg_handler(msgbus_msg_t *bus_msg)
+{
+    msgbus_system_msg_handler_ex(&msgbus_default_ctx, bus_msg);
+}
+
+void msgbus_shard_msg_handler(msgbus_msg_t *bus_msg)
+{
+    msgbus_shard_msg_handler_ex(&msgbus_default_ctx, bus_msg);
 }
@@ -13,6 +13,9 @@ extern "C"
     typedef uint32_t msgbus_user_t;
     typedef void *msgbus_channel_t;
 
+    /* 总线实例句柄，不带句柄参数的接口使用默认实例 */
+    typedef struct msgbus_context msgbus_t;
+
     typedef struct
     {
         msgbus_topic_t topic;  /* 主题 值不能为0*/
@@ -21,23 +24,174 @@ extern "C"
         char msg_data[0];      /* 可能的数据 */
     } msgbus_msg_t;
 
-    typedef int (*channel_msg_write_handler_t)(msgbus_channel_t channel, const void *msg, int msg_size);
+    typedef struct
+    {
+        const void *base; /* 数据地址 */
+        int len;          /* 数据长度 */
+    } msgbus_iovec_t;
+
+    /* 通道消息写入接口，prio为消息优先级（见MSGBUS_PRIO_*），数值越大越优先，不支持优先级的通道可以忽略 */
+    typedef int (*channel_msg_write_handler_t)(msgbus_channel_t channel, const void *msg, int msg_size, int prio);
+    /* 回调订阅的回调函数，msg只在回调期间有效 */
+    typedef void (*msgbus_sub_cb_t)(const msgbus_msg_t *msg, void *cb_ctx);
+    /* 聚合写入接口，将多段数据按顺序拼接为一条消息写入通道 */
+    typedef int (*channel_msg_writev_handler_t)(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio);
+    /* 等待通道中有消息可读，>0：有消息，0：超时，-1：错误；timeout_ms为0时不阻塞，通道为空时登记就绪通知 */
+    typedef int (*channel_wait_handler_t)(msgbus_channel_t channel, int timeout_ms);
+    /* 获取通道的就绪文件描述符，可加入epoll/poll等待，-1：不支持 */
+    typedef int (*channel_fd_handler_t)(msgbus_channel_t channel);
     typedef struct
     {
         uint16_t local_bus_id;                                 /* 本地总线编号 */
         uint16_t is_selfness : 1;                              /* 自私模式，不同步外部总线的主题，对外发布为强制发送 */
+        uint16_t is_direct_dispatch : 1;                       /* 直接派发模式，同步完成后在发布线程直接写入订阅通道，不经过系统通道 */
+        uint16_t is_ext_multicast : 1;                         /* 外部总线组播模式，转发到多个外部总线的消息只写一帧组播帧，见msgbus_multicast_t */
+        uint16_t is_ext_compact : 1;                           /* 外部总线紧凑格式，与同样开启的对端协商后，发给该总线的帧以MSG_TOPIC_EXT_COMPACT编码 */
         bitmap_t ext_bus_map;                                  /* 外部总线表 */
         msgbus_channel_t system_channel;                       /* 系统消息通道 */
         msgbus_channel_t port_channel;                         /* 外部总线消息通道 */
         channel_msg_write_handler_t channel_msg_write_handler; /* 底层通道消息写入接口 */
+        channel_msg_writev_handler_t channel_msg_writev_handler; /* 底层通道消息聚合写入接口，可选 */
+        uint16_t shard_num;                                    /* 分片派发的分片数量，0：不分片，由系统通道的线程派发 */
+        const msgbus_channel_t *shard_channel_list;            /* 各分片的消息通道，每个通道由一个线程调用msgbus_shard_msg_handler() */
+        channel_wait_handler_t channel_wait_handler;           /* 底层通道等待消息接口，可选，供msgbus_wait()使用 */
+        channel_fd_handler_t channel_fd_handler;               /* 底层通道就绪描述符接口，可选，供msgbus_channel_fd()使用 */
+        uint32_t ext_coalesce_bytes;                           /* 转发到外部总线的合并帧长度上限，0：不合并，逐条转发 */
+        uint32_t ext_coalesce_us;                              /* 合并帧中第一条消息的最长等待时间，0：只在帧满或msgbus_flush()时发送 */
     } msgbus_config_t;
 
+/* 外部总线的最大数量，由位图宽度BITMAP_BIT_NUM决定（默认32，可编译为256或1024） */
+#define MSGBUS_EXT_BUS_MAX BITMAP_BIT_NUM
+
+    /* 订阅用户统计 */
+    typedef struct
+    {
+        msgbus_user_t user_id;    /* 用户标识符 */
+        msgbus_channel_t channel; /* 接收数据队列 */
+        uint64_t deliver_cnt;     /* 投递成功次数 */
+        uint64_t deliver_bytes;   /* 投递成功的数据字节数 */
+        uint64_t write_fail_cnt;  /* 通道写入失败次数 */
+        uint64_t drop_cnt;        /* 丢弃的消息数量 */
+        uint64_t conflate_cnt;    /* 合并订阅中被新消息覆盖、未被读取的消息数量 */
+    } msgbus_sub_stats_t;
+
+    /* 主题统计 */
+    typedef struct
+    {
+        msgbus_topic_t topic;               /* 主题，范围订阅时为范围下限 */
+        msgbus_topic_t topic_hi;            /* 范围订阅的上限，精确主题与topic相同 */
+        bitmap_t sub_bus_map;               /* 订阅该主题的外部总线 */
+        uint64_t publish_cnt;               /* 派发次数 */
+        uint64_t publish_bytes;             /* 派发的数据字节数 */
+        uint64_t fanout_cnt;                /* 投递给订阅用户和外部总线的总次数 */
+        uint64_t write_fail_cnt;            /* 通道写入失败次数 */
+        uint64_t drop_cnt;                  /* 没有任何接收者而丢弃的次数 */
+        uint32_t sub_num;                   /* 订阅用户数量 */
+        const msgbus_sub_stats_t *sub_list; /* 订阅用户统计，只在回调期间有效 */
+    } msgbus_topic_stats_t;
+
+    /* 外部总线统计 */
+    typedef struct
+    {
+        uint64_t forward_cnt;      /* 转发次数 */
+        uint64_t forward_bytes;    /* 转发的数据字节数 */
+        uint64_t forward_fail_cnt; /* 转发失败次数 */
+        uint64_t recv_cnt;         /* 收到该总线发布的消息次数 */
+    } msgbus_ext_bus_stats_t;
+
+    /* 总线统计 */
+    typedef struct
+    {
+        uint64_t publish_cnt;                                /* 本地发布次数 */
+        uint64_t dispatch_cnt;                               /* 派发次数（含外部总线发布） */
+        uint64_t no_topic_cnt;                               /* 发布的主题不存在的次数 */
+        uint64_t write_fail_cnt;                             /* 通道写入失败总次数 */
+        uint32_t topic_total;                                /* 主题总数量 */
+        uint32_t topic_local_num;                            /* 本地订阅的主题数量 */
+        uint32_t range_total;                                /* 主题范围总数量（本地+外部总线） */
+        msgbus_ext_bus_stats_t ext_bus[MSGBUS_EXT_BUS_MAX];  /* 各外部总线统计，下标为总线ID-1 */
+    } msgbus_stats_t;
+
+    /* 主题统计遍历回调，每个主题调用一次，遍历结束时以NULL调用一次 */
+    typedef void (*msgbus_stats_walk_cb_t)(const msgbus_topic_stats_t *topic_stats, void *arg);
+
+    /* 批量发布的消息项 */
+    typedef struct
+    {
+        msgbus_topic_t topic; /* 主题 */
+        const void *data;     /* 消息数据 */
+        int data_len;         /* 数据长度 */
+    } msgbus_pub_item_t;
+
+    /* 订阅通道的背压策略，即通道写入失败（通道已满）时的处理方式 */
+    typedef enum
+    {
+        MSGBUS_BP_DROP_NEWEST = 0, /* 丢弃本条消息，未设置策略的通道的默认行为 */
+        MSGBUS_BP_DROP_OLDEST,     /* 消息进入总线管理的溢出环，通道恢复后按顺序补写，溢出环满时丢弃最旧的消息 */
+        MSGBUS_BP_BLOCK,           /* 有限阻塞，重试写入直到超时，超时后丢弃本条消息 */
+        MSGBUS_BP_SPILL,           /* 转存到旁路通道，旁路通道也写入失败时丢弃本条消息 */
+    } msgbus_bp_policy_t;
+
+    /* 订阅通道的背压配置 */
+    typedef struct
+    {
+        msgbus_bp_policy_t policy;      /* 背压策略 */
+        uint32_t queue_len;             /* MSGBUS_BP_DROP_OLDEST：溢出环最多积压的消息数量 */
+        int timeout_ms;                 /* MSGBUS_BP_BLOCK：最长等待时间，等待期间派发线程被阻塞 */
+        msgbus_channel_t spill_channel; /* MSGBUS_BP_SPILL：旁路通道，由用户创建和读取 */
+    } msgbus_backpressure_t;
+
+    /* 订阅通道的背压统计 */
+    typedef struct
+    {
+        uint64_t queue_cnt;       /* 进入溢出环的消息数量 */
+        uint64_t spill_cnt;       /* 转存到旁路通道的消息数量 */
+        uint64_t block_cnt;       /* 通道满时阻塞等待的次数 */
+        uint64_t drop_newest_cnt; /* 丢弃的新消息数量：写入失败、等待超时或旁路通道也写入失败 */
+        uint64_t drop_oldest_cnt; /* 溢出环满时丢弃的最旧消息数量 */
+        uint32_t backlog;         /* 溢出环中当前积压的消息数量 */
+    } msgbus_backpressure_stats_t;
+
+    /* 订阅的主题范围，包含上下限，主题属性（本地、共享）设置在topic_lo上 */
+    typedef struct
+    {
+        msgbus_topic_t topic_lo; /* 范围下限 */
+        msgbus_topic_t topic_hi; /* 范围上限 */
+    } msgbus_topic_range_t;
+
 /* 设置本次发布，主题属性为本地 */
 #define MSG_TOPIC_SET_LOCAL(__topic) ((__topic) | (msgbus_topic_t)(0x80u << 24))
 
 /* 设置本次发布，主题属性为强制派发 */
 #define MSG_TOPIC_SET_DISPATCHED(__topic) ((__topic) | (msgbus_topic_t)(0x40u << 24))
 
+/* 设置本次订阅，主题属性为共享，订阅用户只收到共享消息描述符，多个订阅用户共用同一份数据 */
+#define MSG_TOPIC_SET_SHARED(__topic) ((__topic) | (msgbus_topic_t)(0x20u << 24))
+
+/* 检查收到的消息是否为共享消息描述符 */
+#define MSG_TOPIC_IS_SHARED(__topic) ((__topic) & (0x20u << 24))
+
+/* 设置本次订阅，主题属性为合并（只保留最新值），通道中每个订阅最多只有一条合并通知，读取时取最新的消息 */
+#define MSG_TOPIC_SET_CONFLATED(__topic) ((__topic) | (msgbus_topic_t)(0x10u << 24))
+
+/* 检查收到的消息是否为合并通知 */
+#define MSG_TOPIC_IS_CONFLATED(__topic) ((__topic) & (0x10u << 24))
+
+/* 消息优先级，随消息经通道写入接口传给port层，port层可以据此让高优先级的消息先被读出 */
+#define MSGBUS_PRIO_DEFAULT 0                   /* 默认优先级 */
+#define MSGBUS_PRIO_MAX 3                       /* 用户发布可以使用的最高优先级 */
+#define MSGBUS_PRIO_CONTROL (MSGBUS_PRIO_MAX + 1) /* 订阅、同步等控制消息的优先级，高于所有用户消息 */
+
+/* 设置本次发布的优先级，0~MSGBUS_PRIO_MAX，投递给订阅用户和转发给外部总线时保持不变 */
+#define MSG_TOPIC_SET_PRIO(__topic, __prio) ((__topic) | ((msgbus_topic_t)((__prio) & 0x3u) << 24))
+
+/* 按前缀生成主题范围，低__bits位为通配（__bits小于24），如MSG_TOPIC_RANGE_PREFIX(0x1200, 8)为[0x1200, 0x12FF] */
+#define MSG_TOPIC_RANGE_PREFIX(__prefix, __bits)                  \
+    {                                                             \
+        (msgbus_topic_t)(__prefix) & ~((1u << (__bits)) - 1),     \
+        (msgbus_topic_t)(__prefix) | ((1u << (__bits)) - 1)       \
+    }
+
     /* 主题的限定以及提供一些专用主题 */
     typedef enum
     {
@@ -46,9 +200,33 @@ extern "C"
         MSG_TOPIC_SYNC_OVER,                          // 通知总线同步结束专用主题，在下发同步指令且总线与相邻总线同步结束时，向本地发布，由用户订阅
         MSG_TOPIC_RESYNC,                             // 通知总线出现过重新同步的专用主题，比如对端总线出现过复位。
         MSG_TOPIC_SYSTEM_TOPIC_MAX = 0xFFFFFF - 0x20, // 系统主题最大值
+        MSG_TOPIC_EXT_MULTICAST = 0xFFFFFF - 0x10,    // 外部总线组播帧专用主题，只出现在外部总线通道，数据为msgbus_multicast_t
+        MSG_TOPIC_EXT_COMPACT = 0xFFFFFF - 0x0F,      // 外部总线紧凑格式帧专用主题，user_id为目的总线，数据为紧凑编码的原消息，见msgbus_ext_input()
         MSG_TOPIC_MAX = 0xFFFFFF,                     // 主题最大值
     } msgbus_topic_internal_t;
 
+    /*
+     * 外部总线组播帧（is_ext_multicast）的数据部分。消息要转发到两个以上的外部总线时，总线向外部总线通道
+     * 只写入一帧：topic为MSG_TOPIC_EXT_MULTICAST，user_id为0，msg_data为本结构、目的总线表及原消息。
+     * 目的总线表为word_num个32位字，总线n对应第(n-1)/32个字的第(n-1)%32位，与BITMAP_BIT_NUM无关；
+     * 原消息紧随其后（MSGBUS_MULTICAST_MSG），目的总线都已协商紧凑格式时原消息为MSG_TOPIC_EXT_COMPACT帧。
+     * 移植层可以按目的总线表硬件组播；也可以在广播介质上原样发送，接收总线不在表中时丢弃；
+     * 或者软件扇出，对表中的每个总线将原消息的user_id改为该总线编号，按普通转发消息发送。
+     */
+    typedef struct
+    {
+        uint16_t word_num;    /* 目的总线表的字数量 */
+        uint16_t reserved;    /* 保留，为0 */
+        uint32_t dest_map[0]; /* 目的外部总线表，其后为原消息，user_id为发送总线编号，数据紧随其后 */
+    } msgbus_multicast_t;
+
+/* 组播帧中的原消息 */
+#define MSGBUS_MULTICAST_MSG(__mcast) ((msgbus_msg_t *)&(__mcast)->dest_map[(__mcast)->word_num])
+/* 总线是否在组播帧的目的总线表中 */
+#define MSGBUS_MULTICAST_HAS(__mcast, __bus_id)                                            \
+    ((__bus_id) && ((__bus_id) - 1) / 32 < (__mcast)->word_num &&                          \
+     (((__mcast)->dest_map[((__bus_id) - 1) / 32] >> (((__bus_id) - 1) % 32)) & 1u))
+
     /**
      * @brief 消息总线初始化。
      *
@@ -60,14 +238,183 @@ extern "C"
      * @brief 使用指定消息通道，向消息总线订阅主题。
      *
      * @param channel 消息通道，当订阅的主题有消息发布时，会通过port层的接口向该通道发送。
-     * @param topic_list 主题列表
+     * @param topic_list 主题列表，可以用MSG_TOPIC_SET_LOCAL()、MSG_TOPIC_SET_SHARED()、MSG_TOPIC_SET_CONFLATED()设置订阅属性，
+     *                   合并与共享同时设置时按合并处理
      * @param topic_num 主题数量
      * @return int32_t =0：成功，其他：错误
      */
     int msgbus_subscribe(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num);
 
+    /**
+     * @brief 以回调函数向消息总线订阅主题，有消息发布时由派发线程直接调用回调，不经过消息通道。
+     *        回调在系统线程（分片模式为分片线程，直接派发模式为发布线程）中执行，会阻塞派发，
+     *        只适合更新缓存、计数等轻量处理，不能在回调中等待系统线程。
+     *
+     * @param user_id 订阅的用户
+     * @param topic_list 主题列表
+     * @param topic_num 主题数量
+     * @param sub_cb 回调函数
+     * @param cb_ctx 回调参数
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_subscribe_cb(msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num,
+                            msgbus_sub_cb_t sub_cb, void *cb_ctx);
+
+    /**
+     * @brief 取消使用指定消息通道订阅的主题，参数与订阅时一致。
+     *        取消订阅由系统线程异步执行，返回后通道中仍可能有已投递的消息，需要用户处理。
+     *        主题不再有本地用户和外部总线订阅时被回收，并通知外部总线不再转发该主题。
+     *
+     * @param channel 订阅时使用的消息通道
+     * @param user_id 订阅的用户
+     * @param topic_list 主题列表
+     * @param topic_num 主题数量
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_unsubscribe(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num);
+
+    /**
+     * @brief 取消以回调函数订阅的主题，参数与订阅时一致。
+     *        取消订阅异步执行，返回后回调仍可能被调用，回调参数需要在之后才能释放。
+     *
+     * @param user_id 订阅的用户
+     * @param topic_list 主题列表
+     * @param topic_num 主题数量
+     * @param sub_cb 回调函数
+     * @param cb_ctx 回调参数
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_unsubscribe_cb(msgbus_user_t user_id, const msgbus_topic_t *topic_list, int topic_num,
+                              msgbus_sub_cb_t sub_cb, void *cb_ctx);
+
+    /**
+     * @brief 使用指定消息通道订阅主题范围，发布的主题落在任一范围内时投递给该通道。
+     *        范围保存在区间树中，不展开为单个主题，也以范围的形式同步给外部总线；
+     *        同一主题同时命中精确订阅和范围订阅时，各订阅分别投递。
+     *
+     * @param channel 消息通道
+     * @param user_id 订阅的用户
+     * @param range_list 主题范围列表，下限不能为0且不大于上限，上限小于MSG_TOPIC_USER_MAX
+     * @param range_num 范围数量
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_subscribe_range(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                               int range_num);
+
+    /**
+     * @brief 以回调函数订阅主题范围，回调的执行线程与msgbus_subscribe_cb()相同。
+     *
+     * @param user_id 订阅的用户
+     * @param range_list 主题范围列表
+     * @param range_num 范围数量
+     * @param sub_cb 回调函数
+     * @param cb_ctx 回调参数
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_subscribe_range_cb(msgbus_user_t user_id, const msgbus_topic_range_t *range_list, int range_num,
+                                  msgbus_sub_cb_t sub_cb, void *cb_ctx);
+
+    /**
+     * @brief 取消使用指定消息通道订阅的主题范围，范围需与订阅时完全一致。
+     *
+     * @param channel 订阅时使用的消息通道
+     * @param user_id 订阅的用户
+     * @param range_list 主题范围列表
+     * @param range_num 范围数量
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_unsubscribe_range(msgbus_channel_t channel, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                                 int range_num);
+
+    /**
+     * @brief 取消以回调函数订阅的主题范围，参数与订阅时一致。
+     *
+     * @param user_id 订阅的用户
+     * @param range_list 主题范围列表
+     * @param range_num 范围数量
+     * @param sub_cb 回调函数
+     * @param cb_ctx 回调参数
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_unsubscribe_range_cb(msgbus_user_t user_id, const msgbus_topic_range_t *range_list, int range_num,
+                                    msgbus_sub_cb_t sub_cb, void *cb_ctx);
+
+    /**
+     * @brief 设置订阅通道的背压策略，作用于该通道上的所有订阅（包括之后的订阅），可以重复设置。
+     *        未设置的通道写入失败时丢弃消息；无论哪种策略，一个通道写满都不会使总线停止派发，
+     *        MSGBUS_BP_BLOCK最多阻塞派发线程timeout_ms。设置由系统线程异步执行，
+     *        重新设置时溢出环中的消息先尽量补写，新策略容纳不下的按最旧丢弃。
+     *
+     * @param channel 订阅使用的消息通道
+     * @param bp 背压配置
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_channel_backpressure(msgbus_channel_t channel, const msgbus_backpressure_t *bp);
+
+    /**
+     * @brief 获取订阅通道的背压统计，计数器为无锁读取，可在任意线程调用。
+     *
+     * @param channel 订阅使用的消息通道
+     * @param stats 背压统计
+     * @return int32_t =0：成功，-1：该通道没有设置背压策略
+     */
+    int msgbus_channel_backpressure_stats(msgbus_channel_t channel, msgbus_backpressure_stats_t *stats);
+
+    /**
+     * @brief 在订阅通道上等待消息，由该通道的接收线程调用，需要配置channel_wait_handler。
+     *        通道的溢出环中有积压时先补写到通道，读空通道后调用即可取回积压的消息。
+     *        timeout_ms为0时不阻塞，只检查通道中是否有消息；通道为空时同时登记就绪通知，
+     *        之后有消息写入时msgbus_channel_fd()返回的描述符变为可读。
+     *
+     * @param channel 订阅使用的消息通道
+     * @param timeout_ms 等待时间，0：不等待，<0：一直等待
+     * @return int >0：通道中有消息，0：超时，-1：错误或未配置
+     */
+    int msgbus_wait(msgbus_channel_t channel, int timeout_ms);
+
+    /**
+     * @brief 获取订阅通道的就绪描述符，需要配置channel_fd_handler。一个线程可以将多个订阅通道的描述符
+     *        加入同一个epoll等待，描述符可读后读空通道，再调用msgbus_wait(channel, 0)：返回0表示通道已空
+     *        并已登记通知，可以继续等待epoll；返回>0表示期间又有消息写入，需要继续读取。
+     *
+     * @param channel 订阅使用的消息通道
+     * @return int 文件描述符，-1：不支持或未配置
+     */
+    int msgbus_channel_fd(msgbus_channel_t channel);
+
+    /**
+     * @brief 输入外部总线收到的紧凑格式帧数据，还原为原消息后写入系统通道，由移植层的接收线程调用。
+     *        开启is_ext_compact并与对端协商后，发往该总线的帧为MSG_TOPIC_EXT_COMPACT消息，移植层可以只在链路上
+     *        传输其msg_data（首字节为格式版本号），对端收到后以来源总线编号调用本接口；
+     *        也可以像其它消息一样整帧转发，系统线程收到后自行还原。
+     *
+     * @param src_bus_id 来源总线编号
+     * @param data 紧凑格式帧数据，即MSG_TOPIC_EXT_COMPACT消息的msg_data
+     * @param len 数据长度
+     * @return int =0：成功，-1：版本不支持、数据格式错误或写入系统通道失败
+     */
+    int msgbus_ext_input(msgbus_user_t src_bus_id, const void *data, int len);
+
+    /**
+     * @brief 立即发送所有外部总线上正在合并的帧，需要配置ext_coalesce_bytes。
+     *        合并帧在帧满、第一条消息等待超过ext_coalesce_us或调用本接口时发送，停止总线前应调用一次。
+     *
+     * @return int =0：成功或没有待发送的帧，-1：有合并帧写入外部总线通道失败
+     */
+    int msgbus_flush(void);
+
+    /**
+     * @brief 发送已到期的合并帧。系统线程派发消息时会检查到期的合并帧，总线空闲时没有消息触发检查，
+     *        可由系统线程在读取系统通道前调用，返回值作为读取的超时时间。
+     *
+     * @return int 距下一个合并帧到期的微秒数，-1：没有等待到期的合并帧
+     */
+    int msgbus_flush_poll(void);
+
     /**
      * @brief 在当前总线所有订阅完成后，与其他总线同步主题列表。
+     *        每个相连的总线只收到一次完整的主题表，之后的订阅、取消订阅带来的变化按主题表代数以增量发送，
+     *        同步完成后的订阅也会自动传播到整个星型网络。
      *
      * @return int32_t
      */
@@ -76,20 +423,180 @@ extern "C"
     /**
      * @brief 向指定主题发布消息。
      *
-     * @param topic 主题
+     * @param topic 主题，可以用MSG_TOPIC_SET_PRIO()指定本次发布的优先级
      * @param data 消息数据
      * @param data_len 数据长度
-     * @return int32_t
+     * @return int32_t =0：成功，其他：错误；直接派发模式下多个订阅用户或外部总线写入失败时返回第一次失败的结果，
+     *         失败次数计入各订阅用户和外部总线的统计
      */
     int msgbus_publish(msgbus_topic_t topic, const void *data, int data_len);
 
+    /**
+     * @brief 批量发布消息，整批消息只申请一次内存、只写入一次系统通道，由系统线程整批派发。
+     *        配置了聚合写入接口时，消息数据直接提交给通道，不再申请内存拷贝。
+     *
+     * @param item_list 消息列表
+     * @param item_num 消息数量
+     * @return int32_t =0：成功，其他：错误，任一主题非法时整批不发布
+     */
+    int msgbus_publish_batch(const msgbus_pub_item_t *item_list, int item_num);
+
+    /**
+     * @brief 向消息总线借用一块可写的消息缓冲区，用户直接向msg_data中写入数据后，
+     *        调用msgbus_publish_loaned()发布，发布过程中不再分配内存和拷贝数据。
+     *
+     * @param topic 主题
+     * @param data_len 数据长度
+     * @return msgbus_msg_t* 借出的消息，NULL：失败
+     */
+    msgbus_msg_t *msgbus_loan(msgbus_topic_t topic, int data_len);
+
+    /**
+     * @brief 发布借用的消息，调用后缓冲区归还总线，无论成功与否用户都不能再访问该消息。
+     *
+     * @param loan_msg 由msgbus_loan()借出的消息
+     * @return int32_t =0：成功，其他：错误
+     */
+    int msgbus_publish_loaned(msgbus_msg_t *loan_msg);
+
+    /**
+     * @brief 放弃发布，归还借用的消息缓冲区。
+     *
+     * @param loan_msg 由msgbus_loan()借出的消息
+     */
+    void msgbus_loan_release(msgbus_msg_t *loan_msg);
+
+    /**
+     * @brief 获取共享消息描述符所引用的消息，消息只读，在msgbus_shared_release()前有效。
+     *
+     * @param desc_msg 从通道收到的消息
+     * @return const msgbus_msg_t* 共享消息，非共享描述符时返回desc_msg本身
+     */
+    const msgbus_msg_t *msgbus_shared_msg(const msgbus_msg_t *desc_msg);
+
+    /**
+     * @brief 释放共享消息描述符的引用，最后一个释放者回收消息内存。
+     *
+     * @param desc_msg 从通道收到的消息，非共享描述符时不做处理
+     */
+    void msgbus_shared_release(const msgbus_msg_t *desc_msg);
+
+    /**
+     * @brief 取出合并通知对应的最新消息，通知随之失效，之后发布的消息会投递新的通知。
+     *        订阅者读取慢于发布时，期间的旧消息已被覆盖，只取到最后一次发布的值。
+     *
+     * @param desc_msg 从通道收到的合并通知
+     * @return msgbus_msg_t* 最新消息，需要用msgbus_conflated_release()释放，NULL：不是合并通知或没有待读取的消息
+     */
+    msgbus_msg_t *msgbus_conflated_take(const msgbus_msg_t *desc_msg);
+
+    /**
+     * @brief 释放msgbus_conflated_take()取出的消息。
+     *
+     * @param msg 取出的消息
+     */
+    void msgbus_conflated_release(msgbus_msg_t *msg);
+
+    /**
+     * @brief 获取总线统计快照，计数器为无锁读取，可在任意线程调用。
+     *
+     * @param stats 统计信息
+     */
+    void msgbus_stats_get(msgbus_stats_t *stats);
+
+    /**
+     * @brief 遍历主题表中各主题及其订阅用户的统计。遍历请求经系统通道由系统线程执行，
+     *        回调在系统线程中按主题顺序调用，回调中不能阻塞或调用会等待系统线程的接口。
+     *
+     * @param walk_cb 遍历回调
+     * @param arg 回调参数
+     * @return int32_t =0：成功提交遍历请求，其他：错误
+     */
+    int msgbus_stats_walk(msgbus_stats_walk_cb_t walk_cb, void *arg);
+
     /**
      * @brief 消息总线处理内部的系统消息，供外部线程等调用。
+     *        不分片时，本地的订阅、取消订阅和同步请求不写入系统通道，而是进入总线内部的控制通道，
+     *        只向系统通道写入一条唤醒消息；每次处理消息前先处理完控制通道，控制消息不会排在大量发布消息之后。
+     *        外部总线的同步消息和分片模式下的控制消息以MSGBUS_PRIO_CONTROL写入通道，由port层的优先级保证先被读出。
      *
      * @param bus_msg 消息内容
      */
     void msgbus_system_msg_handler(msgbus_msg_t *bus_msg);
 
+    /**
+     * @brief 分片派发模式下，处理分片通道中的消息，每个分片通道由一个线程调用。
+     *        主题按哈希固定分配到一个分片，同一主题的消息保持发布顺序；订阅、同步等控制消息
+     *        广播到所有分片，各分片都处理到该消息后只执行一次，执行期间其他分片等待。
+     *        分片模式下系统通道只接收外部总线的消息，msgbus_system_msg_handler()将其转发到对应分片。
+     *
+     * @param bus_msg 消息内容
+     */
+    void msgbus_shard_msg_handler(msgbus_msg_t *bus_msg);
+
+    /*
+     * 多实例接口：每个实例拥有独立的主题表、系统通道和系统线程，实例之间不共享状态和缓存行，
+     * 可以按核或按子系统各运行一个总线。以下接口与同名的默认实例接口含义相同，只是多了实例参数。
+     * msgbus_loan()、msgbus_loan_release()、msgbus_shared_msg()、msgbus_shared_release()、
+     * msgbus_conflated_take()和msgbus_conflated_release()与实例无关，
+     * 借出的消息可以通过任一实例发布。
+     */
+
+    /**
+     * @brief 创建一个总线实例。
+     *
+     * @param config 总线配置，系统通道和外部总线通道不能与其他实例共用
+     * @return msgbus_t* 总线实例，NULL：失败
+     */
+    msgbus_t *msgbus_create(msgbus_config_t *config);
+
+    /**
+     * @brief 销毁总线实例，释放主题表，调用前需停止该实例的系统线程和发布线程。
+     *
+     * @param bus 总线实例，对默认实例调用时只释放主题表
+     */
+    void msgbus_destroy(msgbus_t *bus);
+
+    /**
+     * @brief 获取默认总线实例，即msgbus_init()初始化的实例。
+     *
+     * @return msgbus_t* 默认实例
+     */
+    msgbus_t *msgbus_default(void);
+
+    int msgbus_subscribe_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                            const msgbus_topic_t *topic_list, int topic_num);
+    int msgbus_subscribe_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_t *topic_list,
+                               int topic_num, msgbus_sub_cb_t sub_cb, void *cb_ctx);
+    int msgbus_unsubscribe_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                              const msgbus_topic_t *topic_list, int topic_num);
+    int msgbus_unsubscribe_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_t *topic_list,
+                                 int topic_num, msgbus_sub_cb_t sub_cb, void *cb_ctx);
+    int msgbus_subscribe_range_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                                  const msgbus_topic_range_t *range_list, int range_num);
+    int msgbus_subscribe_range_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                                     int range_num, msgbus_sub_cb_t sub_cb, void *cb_ctx);
+    int msgbus_unsubscribe_range_ex(msgbus_t *bus, msgbus_channel_t channel, msgbus_user_t user_id,
+                                    const msgbus_topic_range_t *range_list, int range_num);
+    int msgbus_unsubscribe_range_cb_ex(msgbus_t *bus, msgbus_user_t user_id, const msgbus_topic_range_t *range_list,
+                                       int range_num, msgbus_sub_cb_t sub_cb, void *cb_ctx);
+    int msgbus_channel_backpressure_ex(msgbus_t *bus, msgbus_channel_t channel, const msgbus_backpressure_t *bp);
+    int msgbus_channel_backpressure_stats_ex(msgbus_t *bus, msgbus_channel_t channel,
+                                             msgbus_backpressure_stats_t *stats);
+    int msgbus_wait_ex(msgbus_t *bus, msgbus_channel_t channel, int timeout_ms);
+    int msgbus_channel_fd_ex(msgbus_t *bus, msgbus_channel_t channel);
+    int msgbus_ext_input_ex(msgbus_t *bus, msgbus_user_t src_bus_id, const void *data, int len);
+    int msgbus_flush_ex(msgbus_t *bus);
+    int msgbus_flush_poll_ex(msgbus_t *bus);
+    int msgbus_sync_ex(msgbus_t *bus);
+    int msgbus_publish_ex(msgbus_t *bus, msgbus_topic_t topic, const void *data, int data_len);
+    int msgbus_publish_batch_ex(msgbus_t *bus, const msgbus_pub_item_t *item_list, int item_num);
+    int msgbus_publish_loaned_ex(msgbus_t *bus, msgbus_msg_t *loan_msg);
+    void msgbus_stats_get_ex(msgbus_t *bus, msgbus_stats_t *stats);
+    int msgbus_stats_walk_ex(msgbus_t *bus, msgbus_stats_walk_cb_t walk_cb, void *arg);
+    void msgbus_system_msg_handler_ex(msgbus_t *bus, msgbus_msg_t *bus_msg);
+    void msgbus_shard_msg_handler_ex(msgbus_t *bus, msgbus_msg_t *bus_msg);
+
 #ifdef __cplusplus
 } /* __cplusplus */
 #endif
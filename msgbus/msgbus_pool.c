@@ -0,0 +1,240 @@
+#include "msgbus_pool.h"
+#include "msgbus_port.h"
+
+#ifdef MBUS_USING_POOL
+
+/* 线程缓存中每级内存块的数量上限，超过后归还一半到全局空闲链表 */
+#ifndef MBUS_POOL_CACHE_MAX
+#define MBUS_POOL_CACHE_MAX 64
+#endif
+
+/* 全局空闲链表为空时，一次向系统堆申请的内存块数量 */
+#ifndef MBUS_POOL_REFILL_NUM
+#define MBUS_POOL_REFILL_NUM 16
+#endif
+
+#define POOL_BLOCK_SIZE_MIN 64
+#define POOL_CLASS_LARGE 0xFFu
+#define POOL_BLOCK_MAGIC 0x4D425553u
+
+typedef struct pool_block
+{
+    union
+    {
+        struct pool_block *next; // 空闲时，指向下一个空闲块
+        struct
+        {
+            uint32_t class_idx; // 分配后，记录所属的分级
+            uint32_t magic;     // 块头校验
+        };
+    };
+    uint64_t reserved; // 保证数据区按16byte对齐
+} pool_block_t;
+
+typedef struct
+{
+    pool_block_t *free_list; // 空闲链表
+    uint32_t free_num;       // 空闲块数量
+} pool_list_t;
+
+typedef struct
+{
+    mbus_lock_t lock;                         // 全局空闲链表锁
+    pool_list_t list[MBUS_POOL_CLASS_NUM];    // 全局空闲链表
+    msgbus_pool_stats_t stats;                // 统计信息
+} pool_global_t;
+
+static pool_global_t pool_global;
+static MBUS_TLS pool_list_t pool_cache[MBUS_POOL_CLASS_NUM];
+
+#define POOL_CLASS_SIZE(_idx) ((uint32_t)POOL_BLOCK_SIZE_MIN << (_idx))
+
+static inline uint32_t pool_class_of(size_t size)
+{
+    size_t block_size = size + sizeof(pool_block_t);
+    uint32_t idx = 0;
+
+    while (idx < MBUS_POOL_CLASS_NUM && POOL_CLASS_SIZE(idx) < block_size)
+    {
+        idx++;
+    }
+
+    return idx < MBUS_POOL_CLASS_NUM ? idx : POOL_CLASS_LARGE;
+}
+
+static inline void pool_list_push(pool_list_t *list, pool_block_t *block)
+{
+    block->next = list->free_list;
+    list->free_list = block;
+    list->free_num++;
+}
+
+static inline pool_block_t *pool_list_pop(pool_list_t *list)
+{
+    pool_block_t *block = list->free_list;
+
+    if (block)
+    {
+        list->free_list = block->next;
+        list->free_num--;
+    }
+
+    return block;
+}
+
+/* 从全局空闲链表搬移一批内存块到线程缓存，全局链表为空时向系统堆申请
+ * 返回值 0：从全局链表获取，1：从系统堆获取，-1：失败 */
+static int pool_cache_refill(uint32_t idx)
+{
+    pool_list_t *cache = &pool_cache[idx];
+    pool_list_t *global = &pool_global.list[idx];
+    uint32_t num = 0;
+
+    MBUS_LOCK(&pool_global.lock);
+    while (num < MBUS_POOL_REFILL_NUM && global->free_list)
+    {
+        pool_list_push(cache, pool_list_pop(global));
+        num++;
+    }
+    MBUS_UNLOCK(&pool_global.lock);
+    if (num)
+    {
+        return 0;
+    }
+
+    // 全局空闲链表也为空，向系统堆批量申请
+    char *chunk = MBUS_SYS_MALLOC((size_t)POOL_CLASS_SIZE(idx) * MBUS_POOL_REFILL_NUM);
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+    for (num = 0; num < MBUS_POOL_REFILL_NUM; num++)
+    {
+        pool_list_push(cache, (pool_block_t *)(chunk + (size_t)POOL_CLASS_SIZE(idx) * num));
+    }
+    MBUS_ATOMIC_ADD_RELAXED(&pool_global.stats.class_stats[idx].total, MBUS_POOL_REFILL_NUM);
+
+    return 1;
+}
+
+/* 线程缓存超过上限，归还一半到全局空闲链表 */
+static void pool_cache_drain(uint32_t idx, uint32_t keep_num)
+{
+    pool_list_t *cache = &pool_cache[idx];
+    pool_list_t *global = &pool_global.list[idx];
+
+    MBUS_LOCK(&pool_global.lock);
+    while (cache->free_num > keep_num)
+    {
+        pool_list_push(global, pool_list_pop(cache));
+    }
+    MBUS_UNLOCK(&pool_global.lock);
+}
+
+void *msgbus_pool_alloc(size_t size)
+{
+    pool_block_t *block;
+    uint32_t idx = pool_class_of(size);
+
+    if (idx == POOL_CLASS_LARGE)
+    {
+        block = MBUS_SYS_MALLOC(size + sizeof(pool_block_t));
+        if (block == NULL)
+        {
+            return NULL;
+        }
+        MBUS_ATOMIC_ADD_RELAXED(&pool_global.stats.large_alloc, 1);
+    }
+    else
+    {
+        msgbus_pool_class_stats_t *class_stats = &pool_global.stats.class_stats[idx];
+        uint32_t in_use, high_water;
+        int refill = 0;
+
+        if (pool_cache[idx].free_list == NULL)
+        {
+            refill = pool_cache_refill(idx);
+            if (refill < 0)
+            {
+                return NULL;
+            }
+        }
+        block = pool_list_pop(&pool_cache[idx]);
+        if (refill > 0)
+        {
+            MBUS_ATOMIC_ADD_RELAXED(&class_stats->misses, 1);
+        }
+        else
+        {
+            MBUS_ATOMIC_ADD_RELAXED(&class_stats->hits, 1);
+        }
+        in_use = MBUS_ATOMIC_ADD_RELAXED(&class_stats->in_use, 1);
+        high_water = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->high_water);
+        while (in_use > high_water &&
+               !MBUS_ATOMIC_CAS_RELAXED(&class_stats->high_water, &high_water, in_use))
+        {
+        }
+    }
+    block->class_idx = idx;
+    block->magic = POOL_BLOCK_MAGIC;
+
+    return block + 1;
+}
+
+void msgbus_pool_free(void *ptr)
+{
+    pool_block_t *block;
+    uint32_t idx;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+    block = (pool_block_t *)ptr - 1;
+    if (block->magic != POOL_BLOCK_MAGIC ||
+        (block->class_idx >= MBUS_POOL_CLASS_NUM && block->class_idx != POOL_CLASS_LARGE))
+    { // 不是内存池申请的内存或块头已被改写，放入任何链表都会破坏内存池，宁可泄漏
+        MBUS_LOG_E("[MBUS] pool free invalid block %p\r\n", ptr);
+        return;
+    }
+    idx = block->class_idx;
+    if (idx == POOL_CLASS_LARGE)
+    {
+        MBUS_SYS_FREE(block);
+        return;
+    }
+    MBUS_ATOMIC_SUB_RELAXED(&pool_global.stats.class_stats[idx].in_use, 1);
+    pool_list_push(&pool_cache[idx], block);
+    if (pool_cache[idx].free_num > MBUS_POOL_CACHE_MAX)
+    {
+        pool_cache_drain(idx, MBUS_POOL_CACHE_MAX / 2);
+    }
+}
+
+void msgbus_pool_thread_flush(void)
+{
+    for (uint32_t idx = 0; idx < MBUS_POOL_CLASS_NUM; idx++)
+    {
+        if (pool_cache[idx].free_num)
+        {
+            pool_cache_drain(idx, 0);
+        }
+    }
+}
+
+void msgbus_pool_stats_get(msgbus_pool_stats_t *stats)
+{
+    for (uint32_t idx = 0; idx < MBUS_POOL_CLASS_NUM; idx++)
+    {
+        msgbus_pool_class_stats_t *class_stats = &pool_global.stats.class_stats[idx];
+
+        stats->class_stats[idx].block_size = POOL_CLASS_SIZE(idx);
+        stats->class_stats[idx].in_use = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->in_use);
+        stats->class_stats[idx].high_water = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->high_water);
+        stats->class_stats[idx].total = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->total);
+        stats->class_stats[idx].hits = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->hits);
+        stats->class_stats[idx].misses = MBUS_ATOMIC_LOAD_RELAXED(&class_stats->misses);
+    }
+    stats->large_alloc = MBUS_ATOMIC_LOAD_RELAXED(&pool_global.stats.large_alloc);
+}
+#endif
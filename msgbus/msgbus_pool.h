@@ -0,0 +1,63 @@
+#ifndef __MSGBUS_POOL_H__
+#define __MSGBUS_POOL_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 内存池分级数量，块大小从64byte开始逐级翻倍，最大4096byte，更大的申请直接使用系统堆 */
+#define MBUS_POOL_CLASS_NUM 7
+
+    typedef struct
+    {
+        uint32_t block_size;  /* 块大小（含块头） */
+        uint32_t in_use;      /* 当前已分配的块数量 */
+        uint32_t high_water;  /* 已分配块数量的最高水位 */
+        uint32_t total;       /* 已向系统堆申请的块总数 */
+        uint64_t hits;        /* 从缓存中分配成功的次数 */
+        uint64_t misses;      /* 缓存为空，需要向系统堆申请的次数 */
+    } msgbus_pool_class_stats_t;
+
+    typedef struct
+    {
+        msgbus_pool_class_stats_t class_stats[MBUS_POOL_CLASS_NUM]; /* 各级内存块统计 */
+        uint64_t large_alloc;                                       /* 超过最大分级，直接使用系统堆的次数 */
+    } msgbus_pool_stats_t;
+
+    /**
+     * @brief 从内存池申请内存，优先使用当前线程的缓存，其次为全局空闲链表，都为空时向系统堆批量申请。
+     * 向系统堆申请的内存块只在内存池中复用，不会归还系统堆。
+     *
+     * @param size 申请大小
+     * @return void* 内存地址，NULL：失败
+     */
+    void *msgbus_pool_alloc(size_t size);
+
+    /**
+     * @brief 释放内存到当前线程的缓存，缓存超过上限时批量归还到全局空闲链表。
+     *
+     * @param ptr 由msgbus_pool_alloc()申请的内存
+     */
+    void msgbus_pool_free(void *ptr);
+
+    /**
+     * @brief 将当前线程缓存的内存块全部归还到全局空闲链表。
+     * 调用过总线接口（发布、订阅、处理消息）的线程退出前必须调用，否则该线程缓存的内存块会泄漏。
+     */
+    void msgbus_pool_thread_flush(void);
+
+    /**
+     * @brief 获取内存池统计信息，用于评估内存池的容量。
+     *
+     * @param stats 统计信息
+     */
+    void msgbus_pool_stats_get(msgbus_pool_stats_t *stats);
+
+#ifdef __cplusplus
+} /* __cplusplus */
+#endif
+#endif
@@ -5,10 +5,142 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
+#include <time.h>
 
 #define MBUS_PRINTF printf
-#define MBUS_MALLOC malloc
-#define MBUS_FREE free
+
+/* 日志等级，高于MBUS_LOG_LEVEL的日志在编译时移除，逐条消息的日志为DEBUG等级 */
+#define MBUS_LOG_LVL_NONE 0
+#define MBUS_LOG_LVL_ERROR 1
+#define MBUS_LOG_LVL_WARN 2
+#define MBUS_LOG_LVL_INFO 3
+#define MBUS_LOG_LVL_DEBUG 4
+
+#ifndef MBUS_LOG_LEVEL
+#define MBUS_LOG_LEVEL MBUS_LOG_LVL_INFO
+#endif
+
+#if MBUS_LOG_LEVEL >= MBUS_LOG_LVL_ERROR
+#define MBUS_LOG_E(...) MBUS_PRINTF(__VA_ARGS__)
+#else
+#define MBUS_LOG_E(...) ((void)0)
+#endif
+#if MBUS_LOG_LEVEL >= MBUS_LOG_LVL_WARN
+#define MBUS_LOG_W(...) MBUS_PRINTF(__VA_ARGS__)
+#else
+#define MBUS_LOG_W(...) ((void)0)
+#endif
+#if MBUS_LOG_LEVEL >= MBUS_LOG_LVL_INFO
+#define MBUS_LOG_I(...) MBUS_PRINTF(__VA_ARGS__)
+#else
+#define MBUS_LOG_I(...) ((void)0)
+#endif
+#if MBUS_LOG_LEVEL >= MBUS_LOG_LVL_DEBUG
+#define MBUS_LOG_D(...) MBUS_PRINTF(__VA_ARGS__)
+#else
+#define MBUS_LOG_D(...) ((void)0)
+#endif
+
+/* 运行时统计，计数器使用无同步的原子累加 */
+#define MBUS_USING_STATS
+
+#ifdef MBUS_USING_STATS
+#define MBUS_STAT_ADD(_ptr, _val) MBUS_ATOMIC_ADD_RELAXED((_ptr), (_val))
+#else
+#define MBUS_STAT_ADD(_ptr, _val) ((void)0)
+#endif
+
+/* 二进制跟踪环，定义MBUS_USING_TRACE启用（见msgbus_trace.h），每条消息只记录定长事件，不做格式化 */
+// #define MBUS_USING_TRACE
+#ifndef MBUS_TRACE_SIZE
+#define MBUS_TRACE_SIZE 4096 /* 跟踪事件数量，2的幂 */
+#endif
+/* 系统堆接口 */
+#define MBUS_SYS_MALLOC malloc
+#define MBUS_SYS_FREE free
+
+/* 使用内置的分级内存池管理总线内存，稳定运行后发布路径不再访问系统堆（见msgbus_pool.h）。
+ * 线程缓存依赖MBUS_TLS，调用过总线接口的线程退出前需调用msgbus_pool_thread_flush()，
+ * 池中的内存只在进程内复用，不归还系统堆 */
+// #define MBUS_USING_POOL
+
+#ifdef MBUS_USING_POOL
+#include "msgbus_pool.h"
+#define MBUS_MALLOC msgbus_pool_alloc
+#define MBUS_FREE msgbus_pool_free
+#else
+#define MBUS_MALLOC MBUS_SYS_MALLOC
+#define MBUS_FREE MBUS_SYS_FREE
+#endif
+
+/* 主题查找索引（见topic_index.h），RADIX/HASH以额外内存换取O(1)的主题查找 */
+#ifndef MBUS_TOPIC_INDEX
+#define MBUS_TOPIC_INDEX TOPIC_INDEX_RBTREE
+#endif
+
+/* 分片派发的最大分片数量（见msgbus_config_t.shard_num） */
+#ifndef MBUS_SHARD_MAX
+#define MBUS_SHARD_MAX 16
+#endif
+
+/* 增量同步日志保留的最大帧数量，对端需要更早的增量时改为发送完整的主题表 */
+#ifndef MBUS_SYNC_DELTA_MAX
+#define MBUS_SYNC_DELTA_MAX 64
+#endif
+
+/* 缓存行大小，用于隔离多线程频繁访问的数据 */
+#define MBUS_CACHELINE_SIZE 64
+#define MBUS_CACHELINE_ALIGNED __attribute__((aligned(MBUS_CACHELINE_SIZE)))
+
+/* 环形通道使用eventfd唤醒阻塞的读者（仅Linux） */
+#define MBUS_RING_USING_EVENTFD
+
+/* 单调递增的微秒时间 */
+static inline uint64_t mbus_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000u;
+}
+#define MBUS_TIME_US() mbus_time_us()
+
+/* 线程局部存储 */
+#define MBUS_TLS __thread
+/* 让出CPU */
+#define MBUS_YIELD() sched_yield()
+
+/* 顺序一致的原子操作，加减返回运算后的值，交换返回原值 */
+#define MBUS_ATOMIC_ADD(_ptr, _val) __atomic_add_fetch((_ptr), (_val), __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_SUB(_ptr, _val) __atomic_sub_fetch((_ptr), (_val), __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_LOAD(_ptr) __atomic_load_n((_ptr), __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_STORE(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_XCHG(_ptr, _val) __atomic_exchange_n((_ptr), (_val), __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_CAS(_ptr, _pexpected, _desired) \
+    __atomic_compare_exchange_n((_ptr), (_pexpected), (_desired), 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define MBUS_ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+/* 获取/释放语义的读写，用于单向发布数据 */
+#define MBUS_ATOMIC_LOAD_ACQUIRE(_ptr) __atomic_load_n((_ptr), __ATOMIC_ACQUIRE)
+#define MBUS_ATOMIC_STORE_RELEASE(_ptr, _val) __atomic_store_n((_ptr), (_val), __ATOMIC_RELEASE)
+/* 仅保证原子性的计数操作，用于统计等不需要同步的场景 */
+#define MBUS_ATOMIC_ADD_RELAXED(_ptr, _val) __atomic_add_fetch((_ptr), (_val), __ATOMIC_RELAXED)
+#define MBUS_ATOMIC_SUB_RELAXED(_ptr, _val) __atomic_sub_fetch((_ptr), (_val), __ATOMIC_RELAXED)
+#define MBUS_ATOMIC_LOAD_RELAXED(_ptr) __atomic_load_n((_ptr), __ATOMIC_RELAXED)
+#define MBUS_ATOMIC_CAS_RELAXED(_ptr, _pexpected, _desired) \
+    __atomic_compare_exchange_n((_ptr), (_pexpected), (_desired), 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+/* 自旋锁，只用于保护很短的临界区 */
+typedef uint8_t mbus_lock_t;
+#define MBUS_LOCK(_plock)                                          \
+    do                                                             \
+    {                                                              \
+        while (__atomic_test_and_set((_plock), __ATOMIC_ACQUIRE))  \
+        {                                                          \
+            MBUS_YIELD();                                          \
+        }                                                          \
+    } while (0)
+#define MBUS_UNLOCK(_plock) __atomic_clear((_plock), __ATOMIC_RELEASE)
 #define MBUS_ASSERT(_cond)                                            \
     do                                                                \
     {                                                                 \
@@ -0,0 +1,316 @@
+#include <string.h>
+#include "msgbus_ring.h"
+#include "msgbus_port.h"
+
+#ifdef MBUS_RING_USING_EVENTFD
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+/* 记录按8byte对齐 */
+#define RING_RECORD_ALIGN(_size) (((_size) + 7u) & ~7u)
+
+#define RING_RECORD_DATA 1u
+#define RING_RECORD_PAD 2u
+
+/*
+ * 记录头，size为含记录头的记录长度，由写者最后以释放语义写入，读者读到非0即表示记录已提交。
+ * 读者取走记录后将记录所占区域清零，保证之后落在该区域的记录头在提交前读到的都是0。
+ */
+typedef struct
+{
+    uint32_t size; // 记录长度
+    uint32_t type; // 记录类型
+} ring_record_t;
+
+struct msgbus_ring
+{
+    uint8_t *buff;      // 缓冲区
+    uint32_t size;      // 缓冲区大小
+    uint32_t mask;      // 位置掩码
+    int event_fd;       // 唤醒读者的eventfd，-1：不支持唤醒
+    void *mem;          // 申请的原始内存
+
+    MBUS_CACHELINE_ALIGNED uint64_t head; // 写者预留位置，多写者竞争
+    MBUS_CACHELINE_ALIGNED uint64_t tail; // 读者位置，只有读者修改
+    MBUS_CACHELINE_ALIGNED uint32_t waiting; // 读者已登记等待，由第一个提交的写者清除并唤醒
+};
+
+msgbus_ring_t *msgbus_ring_create(uint32_t size, uint32_t flags)
+{
+    msgbus_ring_t *ring;
+    uint32_t ring_size = 64;
+    void *mem;
+
+    while (ring_size < size && ring_size < 0x80000000u)
+    {
+        ring_size <<= 1;
+    }
+    mem = MBUS_SYS_MALLOC(sizeof(msgbus_ring_t) + ring_size + MBUS_CACHELINE_SIZE);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+    ring = (msgbus_ring_t *)(((uintptr_t)mem + MBUS_CACHELINE_SIZE - 1) & ~(uintptr_t)(MBUS_CACHELINE_SIZE - 1));
+    memset(ring, 0, sizeof(msgbus_ring_t));
+    ring->mem = mem;
+    ring->buff = (uint8_t *)(ring + 1);
+    ring->size = ring_size;
+    ring->mask = ring_size - 1;
+    ring->event_fd = -1;
+    memset(ring->buff, 0, ring_size);
+#ifdef MBUS_RING_USING_EVENTFD
+    if (flags & MSGBUS_RING_FLAG_WAKEUP)
+    {
+        ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring->event_fd < 0)
+        {
+            MBUS_SYS_FREE(mem);
+            return NULL;
+        }
+    }
+#endif
+
+    return ring;
+}
+
+void msgbus_ring_destroy(msgbus_ring_t *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+#ifdef MBUS_RING_USING_EVENTFD
+    if (ring->event_fd >= 0)
+    {
+        close(ring->event_fd);
+    }
+#endif
+    MBUS_SYS_FREE(ring->mem);
+}
+
+/* 预留一条记录的空间，尾部剩余空间不足时先预留填充记录再从头开始，返回记录地址 */
+static ring_record_t *ring_reserve(msgbus_ring_t *ring, uint32_t record_size)
+{
+    uint64_t head, tail, total;
+    uint32_t offset, pad_size;
+
+    // 填充记录小于本记录，记录不超过缓冲区一半时填充加记录小于缓冲区大小，空通道中任意位置都能写入；
+    // 更大的记录在部分位置永远放不下，直接拒绝，避免写者一直重试
+    if (record_size > ring->size / 2)
+    {
+        return NULL;
+    }
+    head = MBUS_ATOMIC_LOAD_RELAXED(&ring->head);
+    do
+    {
+        tail = MBUS_ATOMIC_LOAD_ACQUIRE(&ring->tail);
+        offset = head & ring->mask;
+        pad_size = (ring->size - offset < record_size) ? ring->size - offset : 0;
+        total = (uint64_t)pad_size + record_size;
+        if (head + total - tail > ring->size)
+        { // 通道已满
+            return NULL;
+        }
+    } while (!MBUS_ATOMIC_CAS(&ring->head, &head, head + total));
+
+    if (pad_size)
+    {
+        ring_record_t *pad = (ring_record_t *)(ring->buff + offset);
+
+        pad->type = RING_RECORD_PAD;
+        MBUS_ATOMIC_STORE_RELEASE(&pad->size, pad_size);
+        offset = 0;
+    }
+
+    return (ring_record_t *)(ring->buff + offset);
+}
+
+/* 提交记录，读者已登记等待时唤醒 */
+static void ring_commit(msgbus_ring_t *ring, ring_record_t *record, uint32_t size)
+{
+    record->type = RING_RECORD_DATA;
+    MBUS_ATOMIC_STORE_RELEASE(&record->size, size);
+#ifdef MBUS_RING_USING_EVENTFD
+    if (ring->event_fd >= 0)
+    {
+        MBUS_ATOMIC_FENCE();
+        if (MBUS_ATOMIC_LOAD_RELAXED(&ring->waiting) && MBUS_ATOMIC_XCHG(&ring->waiting, 0))
+        { // 每次登记只由一个写者唤醒，读者再次登记前的后续提交不再写eventfd
+            uint64_t value = 1;
+            ssize_t res = write(ring->event_fd, &value, sizeof value);
+            (void)res;
+        }
+    }
+#endif
+}
+
+int msgbus_ring_write(msgbus_channel_t channel, const void *msg, int msg_size, int prio)
+{
+    msgbus_ring_t *ring = channel;
+    ring_record_t *record;
+    uint32_t size;
+
+    (void)prio;
+
+    if (msg_size <= 0)
+    {
+        return -1;
+    }
+    size = sizeof(ring_record_t) + msg_size;
+    record = ring_reserve(ring, RING_RECORD_ALIGN(size));
+    if (record == NULL)
+    {
+        return -1;
+    }
+    memcpy(record + 1, msg, msg_size);
+    ring_commit(ring, record, size);
+
+    return 0;
+}
+
+int msgbus_ring_writev(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio)
+{
+    msgbus_ring_t *ring = channel;
+    ring_record_t *record;
+    uint32_t size = 0;
+    uint8_t *pos;
+
+    (void)prio;
+    for (int i = 0; i < iov_num; i++)
+    {
+        size += iov[i].len;
+    }
+    if (size == 0)
+    {
+        return -1;
+    }
+    size += sizeof(ring_record_t);
+    record = ring_reserve(ring, RING_RECORD_ALIGN(size));
+    if (record == NULL)
+    {
+        return -1;
+    }
+    pos = (uint8_t *)(record + 1);
+    for (int i = 0; i < iov_num; i++)
+    {
+        memcpy(pos, iov[i].base, iov[i].len);
+        pos += iov[i].len;
+    }
+    ring_commit(ring, record, size);
+
+    return 0;
+}
+
+/* 取出tail处已提交的数据记录，跳过填充记录，返回NULL表示没有可读记录；
+ * 记录已预留但写者还未提交时同样返回NULL，读者登记等待后由写者提交时唤醒，不在此自旋 */
+static ring_record_t *ring_peek(msgbus_ring_t *ring)
+{
+    ring_record_t *record;
+    uint32_t size;
+
+    while (1)
+    {
+        record = (ring_record_t *)(ring->buff + (ring->tail & ring->mask));
+        size = MBUS_ATOMIC_LOAD_ACQUIRE(&record->size);
+        if (size == 0)
+        {
+            return NULL;
+        }
+        if (record->type == RING_RECORD_PAD)
+        {
+            memset(record, 0, size);
+            MBUS_ATOMIC_STORE_RELEASE(&ring->tail, ring->tail + size);
+            continue;
+        }
+        return record;
+    }
+}
+
+/*
+ * 等待可读记录，返回1：有可读记录，0：超时。
+ * 使用eventfd时先清除旧的唤醒计数再登记等待，登记后再次检查通道，避免丢失唤醒；
+ * timeout_ms为0时保持登记直接返回，之后第一条提交的记录使eventfd可读，供外部epoll等待。
+ */
+static int ring_wait(msgbus_ring_t *ring, int timeout_ms)
+{
+#ifdef MBUS_RING_USING_EVENTFD
+    if (ring->event_fd >= 0)
+    {
+        struct pollfd pfd = {.fd = ring->event_fd, .events = POLLIN};
+        uint64_t value;
+        ssize_t res;
+
+        res = read(ring->event_fd, &value, sizeof value);
+        (void)res;
+        MBUS_ATOMIC_STORE(&ring->waiting, 1);
+        MBUS_ATOMIC_FENCE();
+        if (ring_peek(ring))
+        {
+            MBUS_ATOMIC_STORE(&ring->waiting, 0);
+            return 1;
+        }
+        if (timeout_ms == 0)
+        {
+            return 0;
+        }
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+#endif
+    // 不支持唤醒时让出CPU轮询
+    uint64_t deadline = MBUS_TIME_US() + (uint64_t)timeout_ms * 1000u;
+    while (!ring_peek(ring))
+    {
+        if (timeout_ms >= 0 && MBUS_TIME_US() >= deadline)
+        {
+            return 0;
+        }
+        MBUS_YIELD();
+    }
+    return 1;
+}
+
+int msgbus_ring_wait(msgbus_channel_t channel, int timeout_ms)
+{
+    msgbus_ring_t *ring = channel;
+
+    if (ring_peek(ring))
+    {
+        return 1;
+    }
+    return ring_wait(ring, timeout_ms);
+}
+
+int msgbus_ring_fd(msgbus_channel_t channel)
+{
+    msgbus_ring_t *ring = channel;
+
+    return ring->event_fd;
+}
+
+int msgbus_ring_read(msgbus_ring_t *ring, void *buff, int buff_size, int timeout_ms)
+{
+    ring_record_t *record;
+    uint32_t size, msg_size;
+
+    while ((record = ring_peek(ring)) == NULL)
+    {
+        if (timeout_ms == 0 || !ring_wait(ring, timeout_ms))
+        {
+            return 0;
+        }
+    }
+    size = record->size;
+    msg_size = size - sizeof(ring_record_t);
+    if (msg_size <= (uint32_t)buff_size)
+    {
+        memcpy(buff, record + 1, msg_size);
+    }
+    // 放不下的消息也取走，否则之后每次读取都会失败
+    size = RING_RECORD_ALIGN(size);
+    memset(record, 0, size);
+    MBUS_ATOMIC_STORE_RELEASE(&ring->tail, ring->tail + size);
+
+    return msg_size <= (uint32_t)buff_size ? (int)msg_size : -1;
+}
@@ -0,0 +1,95 @@
+#ifndef __MSGBUS_RING_H__
+#define __MSGBUS_RING_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "msgbus.h"
+
+/* 创建环形通道时启用阻塞读者的唤醒 */
+#define MSGBUS_RING_FLAG_WAKEUP 0x01u
+
+    /*
+     * 进程内无锁多生产者/单消费者环形通道，支持变长消息，可直接作为消息总线的底层通道：
+     * msgbus_config_t.channel_msg_write_handler = msgbus_ring_write
+     * msgbus_config_t.channel_msg_writev_handler = msgbus_ring_writev
+     * msgbus_config_t.channel_wait_handler = msgbus_ring_wait
+     * msgbus_config_t.channel_fd_handler = msgbus_ring_fd
+     * 环形通道按写入顺序读出，不区分消息优先级。
+     */
+    typedef struct msgbus_ring msgbus_ring_t;
+
+    /**
+     * @brief 创建环形通道。
+     *
+     * @param size 缓冲区大小，向上取整为2的幂，单条消息（含8byte记录头）不能超过缓冲区的一半
+     * @param flags MSGBUS_RING_FLAG_WAKEUP：读者可以阻塞等待消息
+     * @return msgbus_ring_t* NULL：失败
+     */
+    msgbus_ring_t *msgbus_ring_create(uint32_t size, uint32_t flags);
+
+    /**
+     * @brief 销毁环形通道，调用前需保证没有读写者。
+     *
+     * @param ring 环形通道
+     */
+    void msgbus_ring_destroy(msgbus_ring_t *ring);
+
+    /**
+     * @brief 写入一条消息，可多线程并发调用，不阻塞。
+     *
+     * @param channel 环形通道
+     * @param msg 消息
+     * @param msg_size 消息长度
+     * @param prio 消息优先级，不使用
+     * @return int =0：成功，-1：通道已满或消息过大（含8byte记录头超过缓冲区的一半）
+     */
+    int msgbus_ring_write(msgbus_channel_t channel, const void *msg, int msg_size, int prio);
+
+    /**
+     * @brief 将多段数据拼接为一条消息写入，可多线程并发调用，不阻塞。
+     *
+     * @param channel 环形通道
+     * @param iov 数据分段
+     * @param iov_num 分段数量
+     * @param prio 消息优先级，不使用
+     * @return int =0：成功，-1：通道已满或消息过大（含8byte记录头超过缓冲区的一半）
+     */
+    int msgbus_ring_writev(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio);
+
+    /**
+     * @brief 读取一条消息，只能由一个线程调用。
+     *
+     * @param ring 环形通道
+     * @param buff 接收缓冲区
+     * @param buff_size 接收缓冲区大小，小于消息长度时丢弃该消息并返回错误
+     * @param timeout_ms 等待时间，0：不等待，<0：一直等待
+     * @return int >0：消息长度，0：超时，-1：错误
+     */
+    int msgbus_ring_read(msgbus_ring_t *ring, void *buff, int buff_size, int timeout_ms);
+
+    /**
+     * @brief 等待通道中有消息可读，只能由读者线程调用。
+     *        通道为空时登记等待，之后第一条写入的消息使msgbus_ring_fd()可读，同一次登记内的后续写入不再重复唤醒。
+     *
+     * @param channel 环形通道
+     * @param timeout_ms 等待时间，0：不等待，只检查并登记，<0：一直等待
+     * @return int 1：有消息，0：超时
+     */
+    int msgbus_ring_wait(msgbus_channel_t channel, int timeout_ms);
+
+    /**
+     * @brief 获取通道的就绪描述符，可加入epoll等待；描述符可读后读空通道，再调用msgbus_ring_wait(channel, 0)重新登记。
+     *
+     * @param channel 环形通道
+     * @return int eventfd描述符，-1：创建时未指定MSGBUS_RING_FLAG_WAKEUP或平台不支持
+     */
+    int msgbus_ring_fd(msgbus_channel_t channel);
+
+#ifdef __cplusplus
+} /* __cplusplus */
+#endif
+#endif
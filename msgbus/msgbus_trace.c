@@ -0,0 +1,104 @@
+#include <string.h>
+#include "msgbus_trace.h"
+#include "msgbus_port.h"
+
+#ifdef MBUS_USING_TRACE
+/* 跟踪环只在启用跟踪时占用内存，解析工具只使用事件名称 */
+#define TRACE_MASK (MBUS_TRACE_SIZE - 1u)
+
+typedef struct
+{
+    uint64_t seq;               // 写入完成后的事件序号+1，为0或与写入序号不符表示正在写入
+    msgbus_trace_event_t event; // 事件
+} trace_slot_t;
+
+typedef struct
+{
+    MBUS_CACHELINE_ALIGNED uint64_t write_seq; // 下一个事件序号
+    trace_slot_t slot[MBUS_TRACE_SIZE];        // 跟踪环
+} trace_ring_t;
+
+static trace_ring_t trace_ring;
+
+void msgbus_trace_record(uint16_t event, uint32_t topic, uint32_t user_id, uint32_t len)
+{
+    uint64_t seq = MBUS_ATOMIC_ADD_RELAXED(&trace_ring.write_seq, 1) - 1;
+    trace_slot_t *slot = &trace_ring.slot[seq & TRACE_MASK];
+
+    MBUS_ATOMIC_STORE_RELEASE(&slot->seq, 0);
+    MBUS_ATOMIC_FENCE();
+    slot->event.timestamp = MBUS_TIME_US();
+    slot->event.topic = topic;
+    slot->event.user_id = user_id;
+    slot->event.len = len;
+    slot->event.event = event;
+    slot->event.seq = (uint16_t)seq;
+    MBUS_ATOMIC_STORE_RELEASE(&slot->seq, seq + 1);
+}
+
+int msgbus_trace_dump(void *buff, int buff_size)
+{
+    msgbus_trace_header_t *header = buff;
+    msgbus_trace_event_t *event_list = (msgbus_trace_event_t *)(header + 1);
+    uint64_t end_seq, start_seq;
+    uint32_t event_max, event_num = 0;
+
+    if (buff_size < (int)sizeof(msgbus_trace_header_t))
+    {
+        return 0;
+    }
+    event_max = (buff_size - sizeof(msgbus_trace_header_t)) / sizeof(msgbus_trace_event_t);
+    end_seq = MBUS_ATOMIC_LOAD_ACQUIRE(&trace_ring.write_seq);
+    start_seq = end_seq > MBUS_TRACE_SIZE ? end_seq - MBUS_TRACE_SIZE : 0;
+    if (end_seq - start_seq > event_max)
+    {
+        start_seq = end_seq - event_max;
+    }
+    for (uint64_t seq = start_seq; seq < end_seq; seq++)
+    {
+        trace_slot_t *slot = &trace_ring.slot[seq & TRACE_MASK];
+
+        if (MBUS_ATOMIC_LOAD_ACQUIRE(&slot->seq) != seq + 1)
+        { // 正在写入或已被覆盖
+            continue;
+        }
+        memcpy(&event_list[event_num], &slot->event, sizeof(msgbus_trace_event_t));
+        MBUS_ATOMIC_FENCE();
+        if (MBUS_ATOMIC_LOAD_ACQUIRE(&slot->seq) == seq + 1)
+        { // 拷贝期间没有被覆盖
+            event_num++;
+        }
+    }
+    header->magic = MSGBUS_TRACE_MAGIC;
+    header->version = MSGBUS_TRACE_VERSION;
+    header->event_size = sizeof(msgbus_trace_event_t);
+    header->event_num = event_num;
+    header->lost_num = (uint32_t)(end_seq - event_num);
+
+    return sizeof(msgbus_trace_header_t) + sizeof(msgbus_trace_event_t) * event_num;
+}
+#endif /* MBUS_USING_TRACE */
+
+static const char *const trace_event_name[MSGBUS_TRACE_EVENT_MAX] = {
+    [MSGBUS_TRACE_PUBLISH] = "publish",
+    [MSGBUS_TRACE_DISPATCH] = "dispatch",
+    [MSGBUS_TRACE_DELIVER] = "deliver",
+    [MSGBUS_TRACE_DELIVER_FAIL] = "deliver_fail",
+    [MSGBUS_TRACE_FORWARD] = "forward",
+    [MSGBUS_TRACE_FORWARD_FAIL] = "forward_fail",
+    [MSGBUS_TRACE_NO_TOPIC] = "no_topic",
+    [MSGBUS_TRACE_SUBSCRIBE] = "subscribe",
+    [MSGBUS_TRACE_SYNC] = "sync",
+    [MSGBUS_TRACE_EXT_SYNC] = "ext_sync",
+    [MSGBUS_TRACE_UNSUBSCRIBE] = "unsubscribe",
+    [MSGBUS_TRACE_EXT_DELTA] = "ext_delta",
+};
+
+const char *msgbus_trace_event_name(uint16_t event)
+{
+    if (event < MSGBUS_TRACE_EVENT_MAX && trace_event_name[event])
+    {
+        return trace_event_name[event];
+    }
+    return "unknown";
+}
@@ -0,0 +1,82 @@
+#ifndef __MSGBUS_TRACE_H__
+#define __MSGBUS_TRACE_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/* 跟踪文件格式：文件头后紧跟按时间顺序排列的事件 */
+#define MSGBUS_TRACE_MAGIC 0x5254424Du /* "MBTR" */
+#define MSGBUS_TRACE_VERSION 1u
+
+    /* 跟踪事件类型 */
+    typedef enum
+    {
+        MSGBUS_TRACE_PUBLISH = 1,  /* 用户发布 */
+        MSGBUS_TRACE_DISPATCH,     /* 系统线程开始派发 */
+        MSGBUS_TRACE_DELIVER,      /* 写入订阅用户通道 */
+        MSGBUS_TRACE_DELIVER_FAIL, /* 写入订阅用户通道失败 */
+        MSGBUS_TRACE_FORWARD,      /* 转发到外部总线 */
+        MSGBUS_TRACE_FORWARD_FAIL, /* 转发到外部总线失败 */
+        MSGBUS_TRACE_NO_TOPIC,     /* 发布的主题不存在 */
+        MSGBUS_TRACE_SUBSCRIBE,    /* 处理订阅 */
+        MSGBUS_TRACE_SYNC,         /* 开始同步 */
+        MSGBUS_TRACE_EXT_SYNC,     /* 收到外部总线同步 */
+        MSGBUS_TRACE_UNSUBSCRIBE,  /* 处理取消订阅 */
+        MSGBUS_TRACE_EXT_DELTA,    /* 收到外部总线增量同步 */
+        MSGBUS_TRACE_EVENT_MAX,
+    } msgbus_trace_type_t;
+
+    /* 定长跟踪事件 */
+    typedef struct
+    {
+        uint64_t timestamp; /* 微秒时间戳 */
+        uint32_t topic;     /* 主题 */
+        uint32_t user_id;   /* 用户ID或总线ID */
+        uint32_t len;       /* 消息数据长度 */
+        uint16_t event;     /* 事件类型 */
+        uint16_t seq;       /* 事件序号低16位，用于发现丢失的事件 */
+    } msgbus_trace_event_t;
+
+    /* 跟踪文件头 */
+    typedef struct
+    {
+        uint32_t magic;      /* MSGBUS_TRACE_MAGIC */
+        uint16_t version;    /* MSGBUS_TRACE_VERSION */
+        uint16_t event_size; /* sizeof(msgbus_trace_event_t) */
+        uint32_t event_num;  /* 事件数量 */
+        uint32_t lost_num;   /* 被覆盖的事件数量 */
+    } msgbus_trace_header_t;
+
+    /**
+     * @brief 记录一条跟踪事件，无锁，可多线程并发调用，跟踪环满时覆盖最旧的事件。仅定义MBUS_USING_TRACE时提供。
+     */
+    void msgbus_trace_record(uint16_t event, uint32_t topic, uint32_t user_id, uint32_t len);
+
+    /**
+     * @brief 按跟踪文件格式导出跟踪环中的事件，导出结果可由msgbus_trace_decode工具解析。仅定义MBUS_USING_TRACE时提供。
+     *
+     * @param buff 导出缓冲区
+     * @param buff_size 缓冲区大小，不足时只导出最新的事件
+     * @return int 导出的字节数
+     */
+    int msgbus_trace_dump(void *buff, int buff_size);
+
+    /**
+     * @brief 获取事件类型名称。
+     */
+    const char *msgbus_trace_event_name(uint16_t event);
+
+#ifdef MBUS_USING_TRACE
+#define MBUS_TRACE(_event, _topic, _user_id, _len) msgbus_trace_record((_event), (_topic), (_user_id), (_len))
+#else
+#define MBUS_TRACE(_event, _topic, _user_id, _len) ((void)0)
+#endif
+
+#ifdef __cplusplus
+} /* __cplusplus */
+#endif
+#endif
@@ -32,7 +32,9 @@
 #include "rbtree.h"
 #include <stdbool.h>
 
+#ifndef __always_inline
 #define __always_inline inline
+#endif
 /*
  * Please note - only struct rb_augment_callbacks and the prototypes for
  * rb_insert_augmented() and rb_erase_augmented() are intended to be public.
@@ -0,0 +1,459 @@
+#include <string.h>
+#include "topic_index.h"
+#include "rbtree.h"
+#include "msgbus_port.h"
+
+/*
+ * 红黑树索引
+ */
+typedef struct
+{
+    struct rb_node node; // 树节点
+    uint32_t key;        // 主题键
+    void *value;         // 主题值
+} rbtree_index_node_t;
+
+static int rbtree_index_init(topic_index_t *index)
+{
+    struct rb_root *root = MBUS_MALLOC(sizeof(struct rb_root));
+
+    if (root == NULL)
+    {
+        return -1;
+    }
+    *root = RB_ROOT;
+    index->priv = root;
+
+    return 0;
+}
+
+static void rbtree_index_deinit(topic_index_t *index)
+{
+    struct rb_root *root = index->priv;
+    struct rb_node *node;
+
+    while ((node = rb_first(root)) != NULL)
+    {
+        rb_erase(node, root);
+        MBUS_FREE(rb_entry(node, rbtree_index_node_t, node));
+    }
+    MBUS_FREE(root);
+    index->priv = NULL;
+    index->num = 0;
+}
+
+static rbtree_index_node_t *rbtree_index_find(struct rb_root *root, uint32_t key)
+{
+    struct rb_node *node = root->rb_node;
+
+    while (node)
+    {
+        rbtree_index_node_t *data = rb_entry(node, rbtree_index_node_t, node);
+
+        if (key < data->key)
+            node = node->rb_left;
+        else if (key > data->key)
+            node = node->rb_right;
+        else
+            return data;
+    }
+    return NULL;
+}
+
+static void *rbtree_index_search(topic_index_t *index, uint32_t key)
+{
+    rbtree_index_node_t *data = rbtree_index_find(index->priv, key);
+
+    return data ? data->value : NULL;
+}
+
+static int rbtree_index_insert(topic_index_t *index, uint32_t key, void *value)
+{
+    struct rb_root *root = index->priv;
+    struct rb_node **new = &(root->rb_node), *parent = NULL;
+    rbtree_index_node_t *data;
+
+    while (*new)
+    {
+        rbtree_index_node_t *this = rb_entry(*new, rbtree_index_node_t, node);
+
+        parent = *new;
+        if (key < this->key)
+            new = &((*new)->rb_left);
+        else if (key > this->key)
+            new = &((*new)->rb_right);
+        else
+            return -1;
+    }
+    data = MBUS_MALLOC(sizeof(rbtree_index_node_t));
+    if (data == NULL)
+    {
+        return -1;
+    }
+    data->key = key;
+    data->value = value;
+    rb_link_node(&data->node, parent, new);
+    rb_insert_color(&data->node, root);
+    index->num++;
+
+    return 0;
+}
+
+static void *rbtree_index_erase(topic_index_t *index, uint32_t key)
+{
+    rbtree_index_node_t *data = rbtree_index_find(index->priv, key);
+    void *value;
+
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    value = data->value;
+    rb_erase(&data->node, index->priv);
+    MBUS_FREE(data);
+    index->num--;
+
+    return value;
+}
+
+const topic_index_ops_t topic_index_rbtree_ops = {
+    .name = "rbtree",
+    .init = rbtree_index_init,
+    .deinit = rbtree_index_deinit,
+    .search = rbtree_index_search,
+    .insert = rbtree_index_insert,
+    .erase = rbtree_index_erase,
+};
+
+/*
+ * 两级直接映射索引，24bit主题分为高12bit目录和低12bit叶子，查找只需两次访存
+ */
+#define RADIX_BITS 12
+#define RADIX_SIZE (1u << RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE - 1)
+#define RADIX_KEY_MAX ((1u << (RADIX_BITS * 2)) - 1)
+
+typedef struct
+{
+    uint32_t used;            // 叶子中已使用的项数
+    void *slot[RADIX_SIZE];   // 主题值
+} radix_leaf_t;
+
+typedef struct
+{
+    radix_leaf_t *leaf[RADIX_SIZE]; // 目录
+} radix_dir_t;
+
+static int radix_index_init(topic_index_t *index)
+{
+    radix_dir_t *dir = MBUS_MALLOC(sizeof(radix_dir_t));
+
+    if (dir == NULL)
+    {
+        return -1;
+    }
+    memset(dir, 0, sizeof(radix_dir_t));
+    index->priv = dir;
+
+    return 0;
+}
+
+static void radix_index_deinit(topic_index_t *index)
+{
+    radix_dir_t *dir = index->priv;
+
+    for (uint32_t i = 0; i < RADIX_SIZE; i++)
+    {
+        if (dir->leaf[i])
+        {
+            MBUS_FREE(dir->leaf[i]);
+        }
+    }
+    MBUS_FREE(dir);
+    index->priv = NULL;
+    index->num = 0;
+}
+
+static void *radix_index_search(topic_index_t *index, uint32_t key)
+{
+    radix_dir_t *dir = index->priv;
+    radix_leaf_t *leaf;
+
+    if (key > RADIX_KEY_MAX)
+    {
+        return NULL;
+    }
+    leaf = dir->leaf[key >> RADIX_BITS];
+
+    return leaf ? leaf->slot[key & RADIX_MASK] : NULL;
+}
+
+static int radix_index_insert(topic_index_t *index, uint32_t key, void *value)
+{
+    radix_dir_t *dir = index->priv;
+    radix_leaf_t *leaf;
+
+    if (key > RADIX_KEY_MAX || value == NULL)
+    {
+        return -1;
+    }
+    leaf = dir->leaf[key >> RADIX_BITS];
+    if (leaf == NULL)
+    {
+        leaf = MBUS_MALLOC(sizeof(radix_leaf_t));
+        if (leaf == NULL)
+        {
+            return -1;
+        }
+        memset(leaf, 0, sizeof(radix_leaf_t));
+        dir->leaf[key >> RADIX_BITS] = leaf;
+    }
+    if (leaf->slot[key & RADIX_MASK])
+    {
+        return -1;
+    }
+    leaf->slot[key & RADIX_MASK] = value;
+    leaf->used++;
+    index->num++;
+
+    return 0;
+}
+
+static void *radix_index_erase(topic_index_t *index, uint32_t key)
+{
+    radix_dir_t *dir = index->priv;
+    radix_leaf_t *leaf;
+    void *value;
+
+    if (key > RADIX_KEY_MAX || (leaf = dir->leaf[key >> RADIX_BITS]) == NULL)
+    {
+        return NULL;
+    }
+    value = leaf->slot[key & RADIX_MASK];
+    if (value)
+    {
+        leaf->slot[key & RADIX_MASK] = NULL;
+        index->num--;
+        if (--leaf->used == 0)
+        { // 叶子已空，回收
+            dir->leaf[key >> RADIX_BITS] = NULL;
+            MBUS_FREE(leaf);
+        }
+    }
+
+    return value;
+}
+
+const topic_index_ops_t topic_index_radix_ops = {
+    .name = "radix",
+    .init = radix_index_init,
+    .deinit = radix_index_deinit,
+    .search = radix_index_search,
+    .insert = radix_index_insert,
+    .erase = radix_index_erase,
+};
+
+/*
+ * 开放寻址（线性探测）哈希索引，键与值分开存放，探测时只访问紧凑的键数组
+ */
+#define HASH_CAPACITY_MIN 64u
+#define HASH_KEY_EMPTY 0u           // 主题不能为0，用作空位
+#define HASH_KEY_DELETED 0xFFFFFFFFu // 超出24bit的主题不存在，用作删除标记
+
+typedef struct
+{
+    uint32_t capacity; // 容量，2的幂
+    uint32_t shift;    // 哈希值右移位数
+    uint32_t deleted;  // 删除标记数量
+    uint32_t *keys;    // 键数组
+    void **values;     // 值数组
+} hash_table_t;
+
+static inline uint32_t hash_index_slot(const hash_table_t *table, uint32_t key)
+{
+    return (key * 0x9E3779B1u) >> table->shift;
+}
+
+static int hash_table_alloc(hash_table_t *table, uint32_t capacity)
+{
+    uint32_t shift = 32;
+
+    for (uint32_t cap = capacity; cap > 1; cap >>= 1)
+    {
+        shift--;
+    }
+    table->keys = MBUS_MALLOC(sizeof(uint32_t) * capacity);
+    table->values = MBUS_MALLOC(sizeof(void *) * capacity);
+    if (table->keys == NULL || table->values == NULL)
+    {
+        if (table->keys)
+        {
+            MBUS_FREE(table->keys);
+        }
+        if (table->values)
+        {
+            MBUS_FREE(table->values);
+        }
+        return -1;
+    }
+    memset(table->keys, 0, sizeof(uint32_t) * capacity);
+    table->capacity = capacity;
+    table->shift = shift;
+    table->deleted = 0;
+
+    return 0;
+}
+
+static int hash_index_init(topic_index_t *index)
+{
+    hash_table_t *table = MBUS_MALLOC(sizeof(hash_table_t));
+
+    if (table == NULL)
+    {
+        return -1;
+    }
+    if (hash_table_alloc(table, HASH_CAPACITY_MIN) != 0)
+    {
+        MBUS_FREE(table);
+        return -1;
+    }
+    index->priv = table;
+
+    return 0;
+}
+
+static void hash_index_deinit(topic_index_t *index)
+{
+    hash_table_t *table = index->priv;
+
+    MBUS_FREE(table->keys);
+    MBUS_FREE(table->values);
+    MBUS_FREE(table);
+    index->priv = NULL;
+    index->num = 0;
+}
+
+static void *hash_index_search(topic_index_t *index, uint32_t key)
+{
+    hash_table_t *table = index->priv;
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash_index_slot(table, key);
+
+    while (table->keys[slot] != HASH_KEY_EMPTY)
+    {
+        if (table->keys[slot] == key)
+        {
+            return table->values[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+static void hash_table_put(hash_table_t *table, uint32_t key, void *value)
+{
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash_index_slot(table, key);
+
+    while (table->keys[slot] != HASH_KEY_EMPTY)
+    {
+        slot = (slot + 1) & mask;
+    }
+    table->keys[slot] = key;
+    table->values[slot] = value;
+}
+
+/* 负载（含删除标记）超过3/4时重建，主题较多时扩容 */
+static int hash_index_rehash(topic_index_t *index)
+{
+    hash_table_t *table = index->priv;
+    hash_table_t new_table;
+    uint32_t capacity = table->capacity;
+
+    if ((index->num + 1) * 2 > capacity)
+    {
+        capacity *= 2;
+    }
+    if (hash_table_alloc(&new_table, capacity) != 0)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < table->capacity; i++)
+    {
+        if (table->keys[i] != HASH_KEY_EMPTY && table->keys[i] != HASH_KEY_DELETED)
+        {
+            hash_table_put(&new_table, table->keys[i], table->values[i]);
+        }
+    }
+    MBUS_FREE(table->keys);
+    MBUS_FREE(table->values);
+    *table = new_table;
+
+    return 0;
+}
+
+static int hash_index_insert(topic_index_t *index, uint32_t key, void *value)
+{
+    hash_table_t *table = index->priv;
+
+    if (key == HASH_KEY_EMPTY || key == HASH_KEY_DELETED || hash_index_search(index, key))
+    {
+        return -1;
+    }
+    if ((index->num + table->deleted + 1) * 4 > table->capacity * 3 &&
+        hash_index_rehash(index) != 0)
+    {
+        return -1;
+    }
+    hash_table_put(table, key, value);
+    index->num++;
+
+    return 0;
+}
+
+static void *hash_index_erase(topic_index_t *index, uint32_t key)
+{
+    hash_table_t *table = index->priv;
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash_index_slot(table, key);
+
+    while (table->keys[slot] != HASH_KEY_EMPTY)
+    {
+        if (table->keys[slot] == key)
+        {
+            table->keys[slot] = HASH_KEY_DELETED;
+            table->deleted++;
+            index->num--;
+            return table->values[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+const topic_index_ops_t topic_index_hash_ops = {
+    .name = "hash",
+    .init = hash_index_init,
+    .deinit = hash_index_deinit,
+    .search = hash_index_search,
+    .insert = hash_index_insert,
+    .erase = hash_index_erase,
+};
+
+const topic_index_ops_t *topic_index_ops_get(int type)
+{
+    switch (type)
+    {
+    case TOPIC_INDEX_RBTREE:
+        return &topic_index_rbtree_ops;
+
+    case TOPIC_INDEX_RADIX:
+        return &topic_index_radix_ops;
+
+    case TOPIC_INDEX_HASH:
+        return &topic_index_hash_ops;
+
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef __TOPIC_INDEX_H__
+#define __TOPIC_INDEX_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+
+/* 主题索引类型 */
+#define TOPIC_INDEX_RBTREE 0 /* 红黑树，O(log n)，内存最省 */
+#define TOPIC_INDEX_RADIX 1  /* 两级直接映射表，O(1)，适合编号密集的主题 */
+#define TOPIC_INDEX_HASH 2   /* 开放寻址哈希表，O(1)，适合编号稀疏的主题 */
+
+    typedef struct topic_index topic_index_t;
+
+    /* 主题索引接口，键为24bit主题编号（不能为0），值为任意指针 */
+    typedef struct
+    {
+        const char *name;
+        int (*init)(topic_index_t *index);
+        void (*deinit)(topic_index_t *index);
+        void *(*search)(topic_index_t *index, uint32_t key);
+        int (*insert)(topic_index_t *index, uint32_t key, void *value);
+        void *(*erase)(topic_index_t *index, uint32_t key);
+    } topic_index_ops_t;
+
+    struct topic_index
+    {
+        const topic_index_ops_t *ops; // 索引实现
+        void *priv;                   // 索引实现的私有数据
+        uint32_t num;                 // 索引中的主题数量
+    };
+
+    extern const topic_index_ops_t topic_index_rbtree_ops;
+    extern const topic_index_ops_t topic_index_radix_ops;
+    extern const topic_index_ops_t topic_index_hash_ops;
+
+    /**
+     * @brief 获取指定类型的主题索引实现。
+     *
+     * @param type TOPIC_INDEX_RBTREE/TOPIC_INDEX_RADIX/TOPIC_INDEX_HASH
+     * @return const topic_index_ops_t* NULL：不支持的类型
+     */
+    const topic_index_ops_t *topic_index_ops_get(int type);
+
+    static inline int topic_index_init(topic_index_t *index, const topic_index_ops_t *ops)
+    {
+        index->ops = ops;
+        index->priv = NULL;
+        index->num = 0;
+        return ops->init(index);
+    }
+
+    static inline void topic_index_deinit(topic_index_t *index)
+    {
+        index->ops->deinit(index);
+    }
+
+    static inline void *topic_index_search(topic_index_t *index, uint32_t key)
+    {
+        return index->ops->search(index, key);
+    }
+
+    /* 插入主题，=0：成功，其他：主题已存在或内存不足 */
+    static inline int topic_index_insert(topic_index_t *index, uint32_t key, void *value)
+    {
+        return index->ops->insert(index, key, value);
+    }
+
+    /* 删除主题，返回被删除主题的值，NULL：主题不存在 */
+    static inline void *topic_index_erase(topic_index_t *index, uint32_t key)
+    {
+        return index->ops->erase(index, key);
+    }
+
+#ifdef __cplusplus
+} /* __cplusplus */
+#endif
+#endif
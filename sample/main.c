@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <mqueue.h>
 
 #include "msgbus.h"
@@ -12,9 +15,41 @@ enum msg_topic
     MSG_TOPIC_TEST1 = 1,
 };
 
-int msgbus_port_channel_send(msgbus_channel_t channel, const void *msg, int msg_size)
+int msgbus_port_channel_send(msgbus_channel_t channel, const void *msg, int msg_size, int prio)
 {
-    return mq_send((mqd_t)channel, msg, msg_size, 0);
+    // POSIX消息队列按优先级出队，总线的优先级直接作为消息优先级
+    return mq_send((mqd_t)channel, msg, msg_size, prio);
+}
+
+int msgbus_port_channel_sendv(msgbus_channel_t channel, const msgbus_iovec_t *iov, int iov_num, int prio)
+{
+    char msg_buff[1024];
+    int msg_size = 0;
+
+    // POSIX消息队列没有聚合写入接口，拼接后一次发送
+    for (int i = 0; i < iov_num; i++)
+    {
+        if (msg_size + iov[i].len > (int)sizeof msg_buff)
+        {
+            return -1;
+        }
+        memcpy(msg_buff + msg_size, iov[i].base, iov[i].len);
+        msg_size += iov[i].len;
+    }
+    return mq_send((mqd_t)channel, msg_buff, msg_size, prio);
+}
+
+int msgbus_port_channel_wait(msgbus_channel_t channel, int timeout_ms)
+{
+    // Linux的POSIX消息队列描述符可以直接poll，队列非空即可读
+    struct pollfd pfd = {.fd = (mqd_t)channel, .events = POLLIN};
+
+    return poll(&pfd, 1, timeout_ms);
+}
+
+int msgbus_port_channel_fd(msgbus_channel_t channel)
+{
+    return (mqd_t)channel;
 }
 
 mqd_t create_msgbus_channel(const char *mq_name)
@@ -65,6 +100,9 @@ void msgbus_sys_init(mqd_t sys_mq, mqd_t ext_mq)
             .system_channel = sys_mq,
             .port_channel = ext_mq,
             .channel_msg_write_handler = msgbus_port_channel_send,
+            .channel_msg_writev_handler = msgbus_port_channel_sendv,
+            .channel_wait_handler = msgbus_port_channel_wait,
+            .channel_fd_handler = msgbus_port_channel_fd,
         };
     msgbus_init(&msgbus_config);
     pthread_create(&sys_thread, NULL, (void *)msgbus_sys_thread_handler, (void *)sys_mq);
@@ -73,24 +111,36 @@ void msgbus_sys_init(mqd_t sys_mq, mqd_t ext_mq)
 static void *msgbus_test_thread_handler(void *arg)
 {
     char msg_buff[2048];
-    mqd_t msg_mq = (mqd_t)arg;
     msgbus_msg_t *msg = (msgbus_msg_t *)msg_buff;
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = arg};
+    int epoll_fd = epoll_create1(0);
+
+    // 一个线程可以将多个订阅通道加入同一个epoll等待
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, msgbus_channel_fd(arg), &event);
     while (1)
     {
-        ssize_t res = mq_receive(msg_mq, msg_buff, sizeof msg_buff, NULL);
-        printf("msgbus_test_thread_handler: topic:%d,msg len:%d\n", msg->topic, msg->len);
-        if (res > 0)
+        if (epoll_wait(epoll_fd, &event, 1, -1) <= 0)
+        {
+            continue;
+        }
+        // 读空通道后再回到epoll等待
+        while (msgbus_wait(event.data.ptr, 0) > 0)
         {
-            switch (msg->topic)
+            ssize_t res = mq_receive((mqd_t)event.data.ptr, msg_buff, sizeof msg_buff, NULL);
+            printf("msgbus_test_thread_handler: topic:%d,msg len:%d\n", msg->topic, msg->len);
+            if (res > 0)
             {
-            case MSG_TOPIC_SYNC_OVER:
-                break;
+                switch (msg->topic)
+                {
+                case MSG_TOPIC_SYNC_OVER:
+                    break;
 
-            case MSG_TOPIC_TEST1:
-                break;
+                case MSG_TOPIC_TEST1:
+                    break;
 
-            default:
-                break;
+                default:
+                    break;
+                }
             }
         }
     }
@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "msgbus_trace.h"
+
+/* 解析msgbus_trace_dump()导出的跟踪文件，按CSV格式输出 */
+
+int main(int argc, char **argv)
+{
+    msgbus_trace_header_t header;
+    msgbus_trace_event_t event;
+    uint64_t first_time = 0;
+    FILE *fp;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        return 1;
+    }
+    if (fread(&header, sizeof header, 1, fp) != 1 || header.magic != MSGBUS_TRACE_MAGIC)
+    {
+        fprintf(stderr, "%s: not a msgbus trace file\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    if (header.version != MSGBUS_TRACE_VERSION || header.event_size != sizeof(msgbus_trace_event_t))
+    {
+        fprintf(stderr, "%s: unsupported trace version %u, event size %u\n", argv[1],
+                header.version, header.event_size);
+        fclose(fp);
+        return 1;
+    }
+    printf("# events:%" PRIu32 " lost:%" PRIu32 "\n", header.event_num, header.lost_num);
+    printf("seq,time_us,event,topic,user_id,len\n");
+    for (uint32_t i = 0; i < header.event_num; i++)
+    {
+        if (fread(&event, sizeof event, 1, fp) != 1)
+        {
+            fprintf(stderr, "%s: truncated at event %" PRIu32 "\n", argv[1], i);
+            break;
+        }
+        if (i == 0)
+        {
+            first_time = event.timestamp;
+        }
+        printf("%u,%" PRIu64 ",%s,0x%" PRIx32 ",%" PRIu32 ",%" PRIu32 "\n", event.seq,
+               event.timestamp - first_time, msgbus_trace_event_name(event.event),
+               event.topic, event.user_id, event.len);
+    }
+    fclose(fp);
+
+    return 0;
+}